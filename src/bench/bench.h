@@ -0,0 +1,39 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2019 Thomas Bernard
+    Copyright 2007-2011 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+#define BENCH(func) int Bench_ ## func (void);
+#include "benchlist.h"
+#undef BENCH
+
+/**
+ * Monotonic clock, in seconds.
+ */
+double Bench_time(void);
+
+/**
+ * Number of iterations to run so the measure lasts long enough
+ */
+extern int Bench_iterations;
+
+#endif
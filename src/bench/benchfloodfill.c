@@ -0,0 +1,213 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2019 Thomas Bernard
+    Copyright 2007-2011 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file benchfloodfill.c
+/// Benchmark of the flood fill.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../struct.h"
+#include "../gfx2mem.h"
+#include "../floodfill.h"
+#include "bench.h"
+
+/**
+ * The fill algorithm used before Span_fill() : sweeps all the lines
+ * down then up, until nothing changes.
+ */
+static void Multipass_fill(byte * pixels, int width, int height, short x, short y)
+{
+  short line, start_x, end_x, x_pos;
+  short limit_top = y, limit_bottom = (y + 1 < height) ? y + 1 : y;
+  int changes_made = 1;
+  int direction;
+
+  pixels[y * width + x] = 2;
+  while (changes_made)
+  {
+    changes_made = 0;
+    for (direction = 1; direction >= -1; direction -= 2)
+    {
+      if (direction < 0 && limit_top > 0)
+        limit_top--;
+      for (line = (direction > 0) ? limit_top : limit_bottom;
+           line >= limit_top && line <= limit_bottom;
+           line += direction)
+      {
+        byte * row = pixels + line * width;
+        // Line where the color comes from : above when going down
+        byte * previous = row - direction * width;
+        int has_previous = (direction > 0) ? line > 0 : line < height - 1;
+        int line_is_modified = 0;
+
+        for (start_x = 0; start_x < width; start_x = end_x + 1)
+        {
+          int can_propagate;
+
+          while (start_x < width && row[start_x] != 1)
+            start_x++;
+          if (start_x >= width)
+            break;
+          for (end_x = start_x + 1; end_x < width && row[end_x] == 1; end_x++)
+            ;
+          can_propagate = (start_x > 0 && row[start_x - 1] == 2)
+                       || (end_x < width && row[end_x] == 2);
+          if (!can_propagate && has_previous)
+            for (x_pos = start_x; x_pos < end_x; x_pos++)
+              if (previous[x_pos] == 2)
+              {
+                can_propagate = 1;
+                break;
+              }
+          if (can_propagate)
+          {
+            memset(row + start_x, 2, end_x - start_x);
+            changes_made = 1;
+            line_is_modified = 1;
+          }
+        }
+        if (line_is_modified)
+        {
+          if (direction > 0 && line == limit_bottom && limit_bottom < height - 1)
+            limit_bottom++;
+          else if (direction < 0 && line == limit_top && limit_top > 0)
+            limit_top--;
+        }
+      }
+    }
+  }
+}
+
+/// A corridor of 1 pixel which turns around towards the center.
+static void Draw_spiral(byte * pixels, int size)
+{
+  int left = 1, top = 1, right = size - 2, bottom = size - 2;
+  int i;
+
+  memset(pixels, 0, (long)size * size);
+  while (left <= right && top <= bottom)
+  {
+    for (i = left; i <= right; i++)
+      pixels[top * size + i] = 1;
+    for (i = top; i <= bottom; i++)
+      pixels[i * size + right] = 1;
+    for (i = left; i <= right; i++)
+      pixels[bottom * size + i] = 1;
+    for (i = top + 2; i <= bottom; i++)
+      pixels[i * size + left] = 1;
+    // Door to the next ring
+    if (top + 2 <= bottom)
+      pixels[(top + 2) * size + left + 1] = 1;
+    left += 2;
+    top += 2;
+    right -= 2;
+    bottom -= 2;
+  }
+}
+
+/// Squares of 4x4 pixels, linked by a grid of lines every 16 pixels.
+static void Draw_checkerboard(byte * pixels, int size)
+{
+  int x, y;
+
+  for (y = 0; y < size; y++)
+    for (x = 0; x < size; x++)
+      pixels[y * size + x] = ((((x >> 2) ^ (y >> 2)) & 1) || (x & 15) == 1 || (y & 15) == 1) ? 1 : 0;
+}
+
+/**
+ * Compares the time of Span_fill() and of the former multi-pass
+ * algorithm, on a spiral and on a checkerboard.
+ */
+int Bench_Flood_fill(void)
+{
+  static const struct
+  {
+    const char * name;
+    void (*draw)(byte * pixels, int size);
+    int size;
+  } images[] = {
+    { "spiral", Draw_spiral, 256 },
+    { "spiral", Draw_spiral, 1024 },
+    { "checkerboard", Draw_checkerboard, 256 },
+    { "checkerboard", Draw_checkerboard, 1024 },
+  };
+  unsigned int i;
+  int ok = 1;
+
+  for (i = 0; i < sizeof(images)/sizeof(images[0]) && ok; i++)
+  {
+    int size = images[i].size;
+    long pixels = (long)size * size;
+    byte * source = GFX2_malloc(pixels);
+    byte * multipass = GFX2_malloc(pixels);
+    byte * span = GFX2_malloc(pixels);
+    double start, multipass_time, span_time;
+    short top, bottom, left, right;
+    long filled = 0, p;
+    int n;
+
+    if (source == NULL || multipass == NULL || span == NULL)
+    {
+      free(source);
+      free(multipass);
+      free(span);
+      return 0;
+    }
+    images[i].draw(source, size);
+
+    start = Bench_time();
+    for (n = 0; n < Bench_iterations; n++)
+    {
+      memcpy(multipass, source, pixels);
+      Multipass_fill(multipass, size, size, 1, 1);
+    }
+    multipass_time = Bench_time() - start;
+
+    start = Bench_time();
+    for (n = 0; n < Bench_iterations; n++)
+    {
+      memcpy(span, source, pixels);
+      if (!Span_fill(span, size, 0, 0, size - 1, size - 1, 1, 1, &top, &bottom, &left, &right))
+        ok = 0;
+    }
+    span_time = Bench_time() - start;
+
+    if (memcmp(multipass, span, pixels) != 0)
+    {
+      printf("  Span_fill() gives a different result on %s %d\n", images[i].name, size);
+      ok = 0;
+    }
+    for (p = 0; p < pixels; p++)
+      if (span[p] == 2)
+        filled++;
+
+    printf("  %-12s %4dx%-4d %8ld pixels   multi-pass %9.3f ms   span %8.3f ms\n",
+           images[i].name, size, size, filled,
+           multipass_time * 1000.0 / Bench_iterations,
+           span_time * 1000.0 / Bench_iterations);
+    free(source);
+    free(multipass);
+    free(span);
+  }
+  return ok;
+}
@@ -0,0 +1,173 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2019 Thomas Bernard
+    Copyright 2007-2011 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file benchgif.c
+/// Benchmarks of the GIF LZW decoder and encoder.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../struct.h"
+#include "../gfx2mem.h"
+#include "../giflzw.h"
+#include "bench.h"
+
+#define FRAME_WIDTH 1920
+#define FRAME_HEIGHT 1080
+#define NB_FRAMES 8
+#define MIN_CODE_SIZE 8
+
+static void Bench_GIF_get_row(void * data, word y, byte * pixels, word width)
+{
+  memcpy(pixels, (const byte *)data + (long)y * FRAME_WIDTH, width);
+}
+
+static void Bench_GIF_row(void * data, word y, const byte * pixels, word width)
+{
+  memcpy((byte *)data + (long)y * FRAME_WIDTH, pixels, width);
+}
+
+/// Makes 8 full HD frames, a mix of flat areas, patterns and noise.
+static byte * Bench_GIF_frames(void)
+{
+  long pixels = (long)FRAME_WIDTH * FRAME_HEIGHT;
+  byte * frames = GFX2_malloc(pixels * NB_FRAMES);
+  byte * p = frames;
+  int frame, x, y;
+
+  if (frames == NULL)
+    return NULL;
+  srand(FRAME_WIDTH);
+  for (frame = 0; frame < NB_FRAMES; frame++)
+    for (y = 0; y < FRAME_HEIGHT; y++)
+      for (x = 0; x < FRAME_WIDTH; x++)
+      {
+        if (y < FRAME_HEIGHT / 3)
+          *p++ = (byte)(y / 8 + frame);
+        else if (y < 2 * FRAME_HEIGHT / 3)
+          *p++ = (byte)(((x + frame * 4) / 5) ^ (y / 3));
+        else
+          *p++ = (byte)(rand() & 0x3f);
+      }
+  return frames;
+}
+
+/**
+ * Encodes an animation of 8 full HD frames in a temporary file.
+ */
+int Bench_GIF_encode(void)
+{
+  long pixels = (long)FRAME_WIDTH * FRAME_HEIGHT;
+  byte * frames = Bench_GIF_frames();
+  FILE * file = tmpfile();
+  double start, elapsed;
+  long size = 0;
+  int n, frame;
+  int ok = 1;
+
+  if (frames == NULL || file == NULL)
+  {
+    free(frames);
+    if (file != NULL)
+      fclose(file);
+    return 0;
+  }
+  start = Bench_time();
+  for (n = 0; n < Bench_iterations && ok; n++)
+  {
+    rewind(file);
+    for (frame = 0; frame < NB_FRAMES && ok; frame++)
+    {
+      fputc(MIN_CODE_SIZE, file);
+      if (GIF_LZW_encode(file, MIN_CODE_SIZE, FRAME_WIDTH, FRAME_HEIGHT, Bench_GIF_get_row, frames + frame * pixels) != 0)
+      {
+        printf("  frame %d could not be encoded\n", frame);
+        ok = 0;
+      }
+    }
+    size = ftell(file);
+  }
+  elapsed = Bench_time() - start;
+  printf("  %d frames %dx%d, %ld KB  %7.1f frames/s  %7.1f Mpixels/s\n",
+         NB_FRAMES, FRAME_WIDTH, FRAME_HEIGHT, size / 1024,
+         n * NB_FRAMES / (elapsed > 0.0 ? elapsed : 1e-9),
+         n * NB_FRAMES * (pixels / 1000000.0) / (elapsed > 0.0 ? elapsed : 1e-9));
+  fclose(file);
+  free(frames);
+  return ok;
+}
+
+/**
+ * Decodes an animation of 8 full HD frames, read from a temporary file.
+ */
+int Bench_GIF_decode(void)
+{
+  long pixels = (long)FRAME_WIDTH * FRAME_HEIGHT;
+  byte * frames = Bench_GIF_frames();
+  byte * decoded = GFX2_malloc(pixels);
+  FILE * file = tmpfile();
+  double start, elapsed;
+  long size;
+  int n, frame;
+  int ok = 1;
+
+  if (frames == NULL || decoded == NULL || file == NULL)
+  {
+    free(frames);
+    free(decoded);
+    if (file != NULL)
+      fclose(file);
+    return 0;
+  }
+  for (frame = 0; frame < NB_FRAMES; frame++)
+  {
+    fputc(MIN_CODE_SIZE, file);
+    GIF_LZW_encode(file, MIN_CODE_SIZE, FRAME_WIDTH, FRAME_HEIGHT, Bench_GIF_get_row, frames + frame * pixels);
+  }
+  size = ftell(file);
+
+  start = Bench_time();
+  for (n = 0; n < Bench_iterations && ok; n++)
+  {
+    rewind(file);
+    for (frame = 0; frame < NB_FRAMES; frame++)
+    {
+      int code_size = fgetc(file);
+
+      if (GIF_LZW_decode(file, (byte)code_size, FRAME_WIDTH, FRAME_HEIGHT, 0, Bench_GIF_row, decoded) != 0
+          || memcmp(decoded, frames + frame * pixels, pixels) != 0)
+      {
+        printf("  frame %d is not decoded correctly\n", frame);
+        ok = 0;
+        break;
+      }
+    }
+  }
+  elapsed = Bench_time() - start;
+  printf("  %d frames %dx%d, %ld KB  %7.1f frames/s  %7.1f Mpixels/s\n",
+         NB_FRAMES, FRAME_WIDTH, FRAME_HEIGHT, size / 1024,
+         n * NB_FRAMES / (elapsed > 0.0 ? elapsed : 1e-9),
+         n * NB_FRAMES * (pixels / 1000000.0) / (elapsed > 0.0 ? elapsed : 1e-9));
+  fclose(file);
+  free(frames);
+  free(decoded);
+  return ok;
+}
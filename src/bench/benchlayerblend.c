@@ -0,0 +1,117 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2019 Thomas Bernard
+    Copyright 2007-2011 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file benchlayerblend.c
+/// Benchmark of the layer blending kernels.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../struct.h"
+#include "../gfx2mem.h"
+#include "../layerblend.h"
+#include "bench.h"
+
+static double MB_per_second(long bytes, double seconds)
+{
+  if (seconds <= 0.0)
+    seconds = 1e-9;
+  return (double)bytes / (seconds * 1048576.0);
+}
+
+/**
+ * Measures the MB/s of Blend_layer_line() and Depth_layer_line()
+ * for each kernel supported by the CPU, on several canvas sizes.
+ */
+int Bench_Layer_blend(void)
+{
+  static const int sizes[] = { 256, 1024, 4096 };
+  unsigned int s;
+  int ok = 1;
+
+  for (s = 0; s < sizeof(sizes)/sizeof(sizes[0]) && ok; s++)
+  {
+    long pixels = (long)sizes[s] * sizes[s];
+    byte * layer = GFX2_malloc(pixels);
+    byte * visible = GFX2_malloc(pixels);
+    byte * depth = GFX2_malloc(pixels);
+    byte * reference = GFX2_malloc(2 * pixels);
+    int kernel;
+    long i;
+
+    if (layer == NULL || visible == NULL || depth == NULL || reference == NULL)
+    {
+      free(layer);
+      free(visible);
+      free(depth);
+      free(reference);
+      return 0;
+    }
+    // about half of the pixels are transparent (color 0)
+    srand(sizes[s]);
+    for (i = 0; i < pixels; i++)
+      layer[i] = (rand() & 1) ? (byte)rand() : 0;
+
+    for (kernel = 0; kernel < LAYER_BLEND_KERNEL_COUNT; kernel++)
+    {
+      double start, blend_time, depth_time;
+      int n;
+
+      if (!Select_layer_blend_kernel((enum LAYER_BLEND_KERNEL)kernel))
+        continue;
+
+      memset(visible, 1, pixels);
+      memset(depth, 0, pixels);
+      start = Bench_time();
+      for (n = 0; n < Bench_iterations; n++)
+        Blend_layer_line(visible, depth, layer, (int)pixels, 0, (byte)(n + 1));
+      blend_time = Bench_time() - start;
+
+      start = Bench_time();
+      for (n = 0; n < Bench_iterations; n++)
+        Depth_layer_line(depth, layer, (int)pixels, 0, (byte)(n + 1));
+      depth_time = Bench_time() - start;
+
+      // All kernels must give the same result as the plain C one
+      if (kernel == LAYER_BLEND_SCALAR)
+      {
+        memcpy(reference, visible, pixels);
+        memcpy(reference + pixels, depth, pixels);
+      }
+      else if (memcmp(reference, visible, pixels) != 0 || memcmp(reference + pixels, depth, pixels) != 0)
+      {
+        printf("  %s kernel gives a different result\n", Layer_blend_kernel_name((enum LAYER_BLEND_KERNEL)kernel));
+        ok = 0;
+      }
+
+      printf("  %4dx%-4d %-6s blend %8.1f MB/s   depth %8.1f MB/s\n",
+             sizes[s], sizes[s], Layer_blend_kernel_name((enum LAYER_BLEND_KERNEL)kernel),
+             MB_per_second(pixels * Bench_iterations, blend_time),
+             MB_per_second(pixels * Bench_iterations, depth_time));
+    }
+    free(layer);
+    free(visible);
+    free(depth);
+    free(reference);
+  }
+  Select_best_layer_blend_kernel();
+  return ok;
+}
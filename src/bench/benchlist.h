@@ -0,0 +1,9 @@
+/* list of benchmarks
+ * BENCH(function_to_measure) */
+
+BENCH(Layer_blend)
+BENCH(Flood_fill)
+BENCH(Zoom_line)
+BENCH(Palette_expand)
+BENCH(GIF_decode)
+BENCH(GIF_encode)
@@ -0,0 +1,95 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2019 Thomas Bernard
+    Copyright 2007-2011 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file benchmain.c
+/// Micro benchmarks.
+///
+/// Run with "make bench". Each benchmark prints its own measures.
+/// A benchmark name can be given on the command line to run only this one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(WIN32)
+#include <windows.h>
+#endif
+#include "../struct.h"
+#include "../gfx2log.h"
+#include "bench.h"
+
+int Bench_iterations = 10;
+
+static const struct {
+  int (*bench_func)(void);
+  const char * bench_name;
+} benchs[] = {
+#define BENCH(func) { Bench_ ## func, # func },
+#include "benchlist.h"
+#undef BENCH
+  { NULL, NULL}
+};
+
+double Bench_time(void)
+{
+#if defined(WIN32)
+  LARGE_INTEGER counter, frequency;
+
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec / 1000000000.0;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ * Benchmark program entry point
+ */
+int main(int argc, char * * argv)
+{
+  int i;
+  int fail = 0;
+
+  GFX2_verbosity_level = GFX2_INFO;
+  if (argc > 2)
+    Bench_iterations = atoi(argv[2]);
+  if (Bench_iterations < 1)
+    Bench_iterations = 1;
+
+  for (i = 0; benchs[i].bench_func != 0; i++)
+  {
+    if (argc > 1 && strcmp(argv[1], "all") != 0 && strcmp(argv[1], benchs[i].bench_name) != 0)
+      continue;
+    printf("Benchmark %s :\n", benchs[i].bench_name);
+    if (!benchs[i].bench_func())
+    {
+      printf("  FAILED\n");
+      fail++;
+    }
+  }
+  return fail ? 1 : 0;
+}
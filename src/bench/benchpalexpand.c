@@ -0,0 +1,110 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file benchpalexpand.c
+/// Benchmark of the 8-bit to 32-bit screen conversion.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../struct.h"
+#include "../gfx2mem.h"
+#include "../palexpand.h"
+#include "bench.h"
+
+#define FRAME_WIDTH 3840
+#define FRAME_HEIGHT 2160
+
+/**
+ * Measures the frames per second of the conversion of a 4K screen
+ * for each kernel supported by the CPU.
+ * "two passes" is the conversion to an intermediate 32-bit surface
+ * followed by a copy to the texture, as was done before.
+ */
+int Bench_Palette_expand(void)
+{
+  long pixels = (long)FRAME_WIDTH * FRAME_HEIGHT;
+  byte * screen = GFX2_malloc(pixels);
+  dword * copy = GFX2_malloc(pixels * sizeof(dword));
+  dword * texture = GFX2_malloc(pixels * sizeof(dword));
+  dword * reference = GFX2_malloc(pixels * sizeof(dword));
+  dword palette[256];
+  double start, elapsed;
+  int kernel, n, y;
+  long i;
+  int ok = 1;
+
+  if (screen == NULL || copy == NULL || texture == NULL || reference == NULL)
+  {
+    free(screen);
+    free(copy);
+    free(texture);
+    free(reference);
+    return 0;
+  }
+  srand(FRAME_WIDTH);
+  for (i = 0; i < 256; i++)
+    palette[i] = 0xff000000 | ((dword)rand() & 0xffffff);
+  for (i = 0; i < pixels; i++)
+    screen[i] = (byte)rand();
+
+  Select_palette_expand_kernel(PALETTE_EXPAND_SCALAR);
+  start = Bench_time();
+  for (n = 0; n < Bench_iterations; n++)
+  {
+    for (y = 0; y < FRAME_HEIGHT; y++)
+      Expand_palette_line(copy + y * FRAME_WIDTH, screen + y * FRAME_WIDTH, FRAME_WIDTH, palette);
+    for (y = 0; y < FRAME_HEIGHT; y++)
+      memcpy(reference + y * FRAME_WIDTH, copy + y * FRAME_WIDTH, FRAME_WIDTH * sizeof(dword));
+  }
+  elapsed = Bench_time() - start;
+  printf("  %dx%d two passes    %7.1f frames/s\n", FRAME_WIDTH, FRAME_HEIGHT,
+         Bench_iterations / (elapsed > 0.0 ? elapsed : 1e-9));
+
+  for (kernel = 0; kernel < PALETTE_EXPAND_KERNEL_COUNT; kernel++)
+  {
+    if (!Select_palette_expand_kernel((enum PALETTE_EXPAND_KERNEL)kernel))
+      continue;
+
+    memset(texture, 0, pixels * sizeof(dword));
+    start = Bench_time();
+    for (n = 0; n < Bench_iterations; n++)
+    {
+      for (y = 0; y < FRAME_HEIGHT; y++)
+        Expand_palette_line(texture + y * FRAME_WIDTH, screen + y * FRAME_WIDTH, FRAME_WIDTH, palette);
+    }
+    elapsed = Bench_time() - start;
+
+    if (memcmp(reference, texture, pixels * sizeof(dword)) != 0)
+    {
+      printf("  %s kernel gives a different result\n", Palette_expand_kernel_name((enum PALETTE_EXPAND_KERNEL)kernel));
+      ok = 0;
+    }
+    printf("  %dx%d %-6s        %7.1f frames/s\n", FRAME_WIDTH, FRAME_HEIGHT,
+           Palette_expand_kernel_name((enum PALETTE_EXPAND_KERNEL)kernel),
+           Bench_iterations / (elapsed > 0.0 ? elapsed : 1e-9));
+  }
+  free(screen);
+  free(copy);
+  free(texture);
+  free(reference);
+  Select_best_palette_expand_kernel();
+  return ok;
+}
@@ -0,0 +1,119 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file benchzoomline.c
+/// Benchmark of the magnifier pixel replication.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../struct.h"
+#include "../gfx2mem.h"
+#include "../zoomline.h"
+#include "bench.h"
+
+#define FRAME_WIDTH 3840
+#define FRAME_HEIGHT 2160
+
+typedef void (*Zoom_func)(const byte * original_line, byte * zoomed_line, word factor, word width);
+
+/**
+ * Draws a magnified frame the way Display_part_of_screen_scaled_simple()
+ * does : each line of the image is zoomed once, then copied on
+ * factor lines of the frame.
+ */
+static void Magnified_frame(Zoom_func zoom, const byte * image, int image_width, byte * frame, byte * buffer, int factor)
+{
+  int width = FRAME_WIDTH / factor;
+  int y = 0;
+
+  while (y < FRAME_HEIGHT)
+  {
+    int i;
+
+    zoom(image, buffer, (word)factor, (word)width);
+    for (i = 0; i < factor && y < FRAME_HEIGHT; i++, y++)
+      memcpy(frame + y * FRAME_WIDTH, buffer, width * factor);
+    image += image_width;
+  }
+}
+
+/**
+ * Measures the magnified frames per second of a 4K screen, with the
+ * plain C Zoom_a_line_scalar() and with Zoom_a_line().
+ */
+int Bench_Zoom_line(void)
+{
+  static const int factors[] = { 2, 3, 4, 6, 8, 12, 16, 24, 32 };
+  const int image_width = FRAME_WIDTH / 2;
+  byte * image = GFX2_malloc(image_width * (FRAME_HEIGHT / 2));
+  byte * frame = GFX2_malloc(FRAME_WIDTH * FRAME_HEIGHT);
+  byte * reference = GFX2_malloc(FRAME_WIDTH * FRAME_HEIGHT);
+  byte * buffer = GFX2_malloc(FRAME_WIDTH);
+  unsigned int f;
+  long i;
+  int ok = 1;
+
+  if (image == NULL || frame == NULL || reference == NULL || buffer == NULL)
+  {
+    free(image);
+    free(frame);
+    free(reference);
+    free(buffer);
+    return 0;
+  }
+  srand(42);
+  for (i = 0; i < (long)image_width * (FRAME_HEIGHT / 2); i++)
+    image[i] = (byte)rand();
+
+  for (f = 0; f < sizeof(factors)/sizeof(factors[0]); f++)
+  {
+    double start, scalar_time, zoom_time;
+    int n;
+
+    start = Bench_time();
+    for (n = 0; n < Bench_iterations; n++)
+      Magnified_frame(Zoom_a_line_scalar, image, image_width, reference, buffer, factors[f]);
+    scalar_time = Bench_time() - start;
+
+    start = Bench_time();
+    for (n = 0; n < Bench_iterations; n++)
+      Magnified_frame(Zoom_a_line, image, image_width, frame, buffer, factors[f]);
+    zoom_time = Bench_time() - start;
+
+    if (memcmp(reference, frame, FRAME_WIDTH * FRAME_HEIGHT) != 0)
+    {
+      printf("  factor %d gives a different result\n", factors[f]);
+      ok = 0;
+    }
+    if (scalar_time <= 0.0)
+      scalar_time = 1e-9;
+    if (zoom_time <= 0.0)
+      zoom_time = 1e-9;
+    printf("  %dx%d factor %2d : scalar %7.1f frames/s   Zoom_a_line %7.1f frames/s\n",
+           FRAME_WIDTH, FRAME_HEIGHT, factors[f],
+           Bench_iterations / scalar_time, Bench_iterations / zoom_time);
+  }
+  free(image);
+  free(frame);
+  free(reference);
+  free(buffer);
+  return ok;
+}
@@ -933,11 +933,12 @@ void Button_Tilemap_menu(void)
   byte flip_x=Config.Tilemap_allow_flipped_x;
   byte flip_y=Config.Tilemap_allow_flipped_y;
   byte count=Config.Tilemap_show_count;
+  byte stats=Config.Tilemap_show_stats;
 
-  Open_window(166,120,"Tilemap options");
+  Open_window(166,138,"Tilemap options");
 
-  Window_set_normal_button(6,102,51,14,"Cancel",0,1,KEY_ESC);  // 1
-  Window_set_normal_button(110,102,51,14,"OK"    ,0,1,KEY_RETURN); // 2
+  Window_set_normal_button(6,120,51,14,"Cancel",0,1,KEY_ESC);  // 1
+  Window_set_normal_button(110,120,51,14,"OK"    ,0,1,KEY_RETURN); // 2
 
   Print_in_window(24,21, "Detect mirrored",MC_Dark,MC_Light);
   Window_display_frame(5,17,155,56);
@@ -951,6 +952,9 @@ void Button_Tilemap_menu(void)
   Print_in_window(27,81, "Show count",MC_Black,MC_Light);
   Window_set_normal_button(7,78,13,13,count?"X":"",0,1,0);  // 5
 
+  Print_in_window(27,99, "Live stats",MC_Black,MC_Light);
+  Window_set_normal_button(7,96,13,13,stats?"X":"",0,1,0);  // 6
+
   Update_window_area(0,0,Window_width, Window_height);
 
   Display_cursor();
@@ -979,6 +983,12 @@ void Button_Tilemap_menu(void)
         Print_in_window(10,81,count?"X":" ", MC_Black, MC_Light);
         Display_cursor();
         break;      
+      case 6 : // Stats
+        stats=!stats;
+        Hide_cursor();
+        Print_in_window(10,99,stats?"X":" ", MC_Black, MC_Light);
+        Display_cursor();
+        break;
     }
     if (Is_shortcut(Key,0x100+BUTTON_HELP))
       Window_help(BUTTON_EFFECTS, "TILEMAP");
@@ -995,6 +1005,7 @@ void Button_Tilemap_menu(void)
     Config.Tilemap_allow_flipped_x=flip_x;
     Config.Tilemap_allow_flipped_y=flip_y;
     Config.Tilemap_show_count=count;
+    Config.Tilemap_show_stats=stats;
     
     if (changed)
     {
@@ -111,9 +111,18 @@ void CT_set(CT_Tree* colorTree, byte Rmin, byte Gmin, byte Bmin,
  * pre condition: node contains (rgb)
  */
 byte CT_get(CT_Tree* tree, byte r, byte g, byte b)
-{	
-	
-	CT_Node* node = &tree->nodes[0];
+{
+	return CT_get_from(tree, 0, r, g, b);
+}
+
+/**
+ * find the leaf that also contains (rgb), starting from a given node
+ *
+ * pre condition: the node contains (rgb)
+ */
+byte CT_get_from(const CT_Tree* tree, word start, byte r, byte g, byte b)
+{
+	const CT_Node* node = &tree->nodes[start];
 	
 	for(;;) {
 		if(node->children[0] == 0)
@@ -121,7 +130,7 @@ byte CT_get(CT_Tree* tree, byte r, byte g, byte b)
 			return node->children[1];
 		else {
 			// Left or right ?
-			CT_Node* child0 = &tree->nodes[node->children[0]];
+			const CT_Node* child0 = &tree->nodes[node->children[0]];
 			if (child0->Rmin <= r
 				&& child0->Gmin <= g
 				&& child0->Bmin <= b
@@ -143,3 +152,52 @@ void CT_delete(CT_Tree* tree)
 {
 	free(tree);
 }
+
+/**
+ * Flatten the tree in a lookup table.
+ *
+ * For each cube of colors, the tree is walked the same way as CT_get()
+ * does, as long as the whole cube goes in the same direction.
+ */
+CT_Table* CT_table_new(const CT_Tree* tree)
+{
+	CT_Table* table;
+	int r, g, b;
+	const int size = 1 << (8-CT_TABLE_BITS);
+
+	table = malloc(sizeof(CT_Table));
+	if (table == NULL)
+		return NULL;
+
+	for (r = 0; r < 256; r += size)
+		for (g = 0; g < 256; g += size)
+			for (b = 0; b < 256; b += size)
+			{
+				word n = 0;
+				const int r2 = r + size - 1, g2 = g + size - 1, b2 = b + size - 1;
+
+				while (tree->nodes[n].children[0] != 0)
+				{
+					const CT_Node* child0 = &tree->nodes[tree->nodes[n].children[0]];
+
+					if (child0->Rmin <= r && child0->Gmin <= g && child0->Bmin <= b
+						&& child0->Rmax >= r2 && child0->Gmax >= g2 && child0->Bmax >= b2)
+						n = tree->nodes[n].children[0]; // whole cube in child 0
+					else if (child0->Rmin > r2 || child0->Gmin > g2 || child0->Bmin > b2
+						|| child0->Rmax < r || child0->Gmax < g || child0->Bmax < b)
+						n = tree->nodes[n].children[1]; // whole cube out of child 0
+					else
+						break; // the cube is split between the two children
+				}
+				if (tree->nodes[n].children[0] == 0)
+					table->entries[CT_TABLE_INDEX(r,g,b)] = CT_TABLE_LEAF | tree->nodes[n].children[1];
+				else
+					table->entries[CT_TABLE_INDEX(r,g,b)] = n;
+			}
+	return table;
+}
+
+void CT_table_delete(CT_Table* table)
+{
+	free(table);
+}
@@ -73,9 +73,36 @@ typedef struct ColorTree_S {
 	CT_Node nodes[511];
 } CT_Tree;
 
+/// Number of bits kept for each component in the index of a ::CT_Table
+#define CT_TABLE_BITS 6
+
+/// Index of the entry of a ::CT_Table for a color
+#define CT_TABLE_INDEX(r,g,b) \
+	((((r) >> (8-CT_TABLE_BITS)) << (2*CT_TABLE_BITS)) \
+	| (((g) >> (8-CT_TABLE_BITS)) << CT_TABLE_BITS) \
+	| ((b) >> (8-CT_TABLE_BITS)))
+
+/// Flag of the ::CT_Table entries which directly hold a palette index
+#define CT_TABLE_LEAF 0x8000
+
+/**
+ * Color Tree flattened in a direct lookup table.
+ *
+ * Each entry covers a cube of (256>>CT_TABLE_BITS)^3 colors. When all the
+ * colors of the cube map to the same leaf, the entry is CT_TABLE_LEAF|index.
+ * Otherwise, it is the deepest node of the tree which contains the whole
+ * cube, and the search continues from there with CT_get_from().
+ */
+typedef struct ColorTable_S {
+	word entries[1 << (3*CT_TABLE_BITS)];
+} CT_Table;
+
 CT_Tree* CT_new();
 void CT_delete(CT_Tree* t);
 byte CT_get(CT_Tree* t,byte r,byte g,byte b);
+byte CT_get_from(const CT_Tree* t, word node, byte r, byte g, byte b);
+CT_Table* CT_table_new(const CT_Tree* t);
+void CT_table_delete(CT_Table* table);
 void CT_set(CT_Tree* colorTree, byte Rmin, byte Gmin, byte Bmin,
 	byte Rmax, byte Gmax, byte Bmax, byte index);
 
@@ -0,0 +1,462 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2019 Thomas Bernard
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file convert.c
+/// Command line conversion of pictures (-convert), without user interface.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#if defined(__linux__) || defined(__macosx__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+// The loaders and savers share global variables (File_error...), so the
+// pictures are split between processes instead of threads.
+#define CONVERT_USE_FORK
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+#if defined(_MSC_VER)
+#define strdup _strdup
+#endif
+
+#include "struct.h"
+#include "global.h"
+#include "loadsave.h"
+#include "filesel.h"
+#include "io.h"
+#include "misc.h"
+#include "gfx2surface.h"
+#include "gfx2thread.h"
+#include "gfx2log.h"
+#include "gfx2mem.h"
+#include "convert.h"
+
+/// The pictures to convert, with their full path
+typedef struct
+{
+  char ** Names;
+  int Count;
+  int Size;           ///< Allocated entries in Names
+  const char * Directory; ///< Directory being scanned for a pattern
+  const char * Pattern;   ///< File name with wildcards
+} T_Convert_list;
+
+///
+/// Checks a file name against a pattern with the wildcards '*' and '?'.
+/// The case is ignored on Windows.
+static int Match_wildcards(const char * name, const char * pattern)
+{
+  for (; *pattern != '\0'; pattern++, name++)
+  {
+    if (*pattern == '*')
+    {
+      for (;;)
+      {
+        if (Match_wildcards(name, pattern + 1))
+          return 1;
+        if (*name == '\0')
+          return 0;
+        name++;
+      }
+    }
+    if (*name == '\0')
+      return 0;
+#if defined(WIN32)
+    if (*pattern != '?' && tolower(*pattern) != tolower(*name))
+#else
+    if (*pattern != '?' && *pattern != *name)
+#endif
+      return 0;
+  }
+  return *name == '\0';
+}
+
+static int Add_to_list(T_Convert_list * list, char * full_name)
+{
+  if (full_name == NULL)
+    return 0;
+  if (list->Count >= list->Size)
+  {
+    char ** names;
+
+    list->Size = list->Size ? list->Size * 2 : 64;
+    names = realloc(list->Names, list->Size * sizeof(char *));
+    if (names == NULL)
+    {
+      free(full_name);
+      return 0;
+    }
+    list->Names = names;
+  }
+  list->Names[list->Count++] = full_name;
+  return 1;
+}
+
+/// Callback for For_each_directory_entry(): adds the files matching the pattern
+static void Add_matching_file(void * pdata, const char * filename, const word * unicode_filename, byte is_file, byte is_directory, byte is_hidden)
+{
+  T_Convert_list * list = (T_Convert_list *)pdata;
+  (void)unicode_filename;
+  (void)is_directory;
+  (void)is_hidden;
+
+  if (is_file && Match_wildcards(filename, list->Pattern))
+    Add_to_list(list, Filepath_append_to_dir(list->Directory, filename));
+}
+
+static int Compare_names(const void * a, const void * b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+///
+/// Adds the files of an input to the list, expanding the wildcards.
+/// @return the number of files found
+static int Add_input(T_Convert_list * list, const char * input)
+{
+  char * directory;
+  char * pattern;
+  int first = list->Count;
+
+  if (strpbrk(input, "*?") == NULL)
+  {
+    if (!File_exists(input))
+      return 0;
+    Add_to_list(list, strdup(input));
+    return list->Count - first;
+  }
+  directory = strdup(input);
+  if (directory == NULL)
+    return 0;
+  pattern = Find_last_separator(directory);
+  if (pattern != NULL)
+  {
+    pattern[1] = '\0'; // keep the separator, for the root directory
+    list->Pattern = input + (pattern + 1 - directory);
+  }
+  else
+  {
+    directory[0] = '\0';
+    list->Pattern = input;
+  }
+  list->Directory = directory;
+  For_each_directory_entry(directory[0] != '\0' ? directory : ".", list, Add_matching_file);
+  // Same order as the shell would give
+  qsort(list->Names + first, list->Count - first, sizeof(char *), Compare_names);
+  free(directory);
+  return list->Count - first;
+}
+
+///
+/// Finds a format which can save pictures, from one of its extensions.
+static const T_Format * Find_save_format(const char * extension)
+{
+  unsigned int index;
+
+  if (extension == NULL || extension[0] == '\0')
+    return NULL;
+  for (index = FORMAT_ALL_FILES + 1; index < Nb_known_formats(); index++)
+  {
+    const T_Format * format = File_formats + index;
+    const char * ext = format->Extensions;
+
+    if (format->Save == NULL || format->Palette_only)
+      continue;
+    while (ext != NULL)
+    {
+      if (Check_extension(extension, ext))
+        return format;
+      ext = strchr(ext, ';');
+      if (ext)
+        ext++;
+    }
+  }
+  return NULL;
+}
+
+///
+/// Loads a picture and saves it in another format.
+/// @param input full path of the picture
+/// @param output full path of the converted picture
+/// @return 0 on success, 1 on failure
+static int Convert_picture(const char * input, const char * output, const T_Format * format)
+{
+  T_IO_Context context;
+  char * directory;
+  char * name;
+  int result = 0;
+
+  directory = strdup(input);
+  name = Find_last_separator(directory);
+  if (name != NULL)
+    *name++ = '\0';
+  else
+    name = directory;
+  Init_context_surface(&context, name, name == directory ? "" : directory);
+  free(directory);
+  // The picture is saved as a single layer
+  context.Flatten_layers = 1;
+  Load_image(&context);
+  if (File_error || context.Surface == NULL)
+  {
+    GFX2_Log(GFX2_ERROR, "%s: cannot load the picture\n", input);
+    result = 1;
+  }
+  else
+  {
+    if (context.Image_mode == IMAGE_MODE_ANIMATION && context.Current_layer > 0)
+      GFX2_Log(GFX2_WARNING, "%s: only the first frame of the animation is converted\n", input);
+    // The palette, transparent color, comment and color cycles of the
+    // loaded picture stay in the context: only the destination changes.
+    free(context.File_name);
+    free(context.File_name_unicode);
+    context.File_name_unicode = NULL;
+    free(context.File_directory);
+    directory = strdup(output);
+    name = Find_last_separator(directory);
+    if (name != NULL)
+      *name++ = '\0';
+    else
+      name = directory;
+    context.File_name = strdup(name);
+    context.File_directory = strdup(name == directory ? "" : directory);
+    free(directory);
+    context.Format = format->Identifier;
+    context.Nb_layers = 1;
+    context.Current_layer = 0;
+    context.Width = context.Surface->w;
+    context.Height = context.Surface->h;
+    context.Target_address = context.Surface->pixels;
+    context.Pitch = context.Surface->w;
+    Save_image(&context);
+    if (File_error)
+    {
+      GFX2_Log(GFX2_ERROR, "%s: cannot save the picture\n", output);
+      result = 1;
+    }
+    else
+      GFX2_Log(GFX2_DEBUG, "%s -> %s\n", input, output);
+  }
+  if (context.Surface != NULL)
+    Free_GFX2_Surface(context.Surface);
+  context.Surface = NULL;
+  Destroy_context(&context);
+  return result;
+}
+
+///
+/// Gives the name of the converted picture in the output directory :
+/// same name as the input, with the default extension of the format.
+static char * Output_name(const char * input, const char * output_directory, const T_Format * format)
+{
+  const char * name;
+  char * new_name;
+  char * path;
+  int pos_last_dot;
+
+  name = Find_last_separator(input);
+  name = (name != NULL) ? name + 1 : input;
+  new_name = GFX2_malloc(strlen(name) + strlen(format->Default_extension) + 2);
+  if (new_name == NULL)
+    return NULL;
+  strcpy(new_name, name);
+  pos_last_dot = Position_last_dot(new_name);
+  if (pos_last_dot >= 0)
+    new_name[pos_last_dot] = '\0';
+  strcat(new_name, ".");
+  strcat(new_name, format->Default_extension);
+  path = Filepath_append_to_dir(output_directory, new_name);
+  free(new_name);
+  return path;
+}
+
+/// Converts one entry of the list
+static int Convert_entry(T_Convert_list * list, int index, const char * output, int output_is_directory, const T_Format * format)
+{
+  char * output_name;
+  int result;
+
+  if (!output_is_directory)
+    return Convert_picture(list->Names[index], output, format);
+  output_name = Output_name(list->Names[index], output, format);
+  if (output_name == NULL)
+    return 1;
+  result = Convert_picture(list->Names[index], output_name, format);
+  free(output_name);
+  return result;
+}
+
+#if defined(CONVERT_USE_FORK)
+///
+/// Converts the list in several processes. The parent writes the indexes
+/// of the pictures in a pipe, each child reads the next one when it is done
+/// with the previous picture, so a few big pictures don't make one process
+/// work alone at the end.
+/// @return the number of errors, or -1 if no process could be started
+static int Convert_in_processes(T_Convert_list * list, int nb_processes, const char * output, int output_is_directory, const T_Format * format)
+{
+  int fds[2];
+  int started = 0;
+  int errors = 0;
+  int i;
+
+  if (pipe(fds) < 0)
+    return -1;
+  fflush(stdout);
+  fflush(stderr);
+  for (i = 0; i < nb_processes; i++)
+  {
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      int index;
+      int child_errors = 0;
+
+      close(fds[1]);
+      while (read(fds[0], &index, sizeof(index)) == (ssize_t)sizeof(index))
+        child_errors += Convert_entry(list, index, output, output_is_directory, format);
+      fflush(stdout);
+      fflush(stderr);
+      _exit(child_errors > 255 ? 255 : child_errors);
+    }
+    if (pid < 0)
+    {
+      GFX2_Log(GFX2_WARNING, "fork() failed, using %d processes\n", started);
+      break;
+    }
+    started++;
+  }
+  close(fds[0]);
+  if (started == 0)
+  {
+    close(fds[1]);
+    return -1;
+  }
+  // If all the children died, write() fails instead of killing us
+  signal(SIGPIPE, SIG_IGN);
+  for (i = 0; i < list->Count; i++)
+  {
+    if (write(fds[1], &i, sizeof(i)) != (ssize_t)sizeof(i))
+    {
+      errors += list->Count - i;
+      break;
+    }
+  }
+  close(fds[1]);
+  while (started > 0)
+  {
+    int status;
+
+    if (wait(&status) < 0)
+      break;
+    if (WIFEXITED(status))
+      errors += WEXITSTATUS(status);
+    else
+      errors++; // crashed on a picture
+    started--;
+  }
+  return errors;
+}
+#endif
+
+int Convert_pictures(char ** inputs, int nb_inputs, const char * output, const char * format_name)
+{
+  T_Convert_list list;
+  const T_Format * format;
+  int output_is_directory;
+  int nb_processes;
+  int nb_pictures;
+  int errors = 0;
+  int i;
+  dword start, duration;
+
+  memset(&list, 0, sizeof(list));
+  for (i = 0; i < nb_inputs; i++)
+  {
+    if (Add_input(&list, inputs[i]) == 0)
+    {
+      GFX2_Log(GFX2_ERROR, "%s: no such file\n", inputs[i]);
+      errors++;
+    }
+  }
+
+  nb_pictures = list.Count;
+  output_is_directory = Directory_exists(output);
+  if (!output_is_directory && nb_pictures > 1)
+  {
+    GFX2_Log(GFX2_ERROR, "%s: the output must be a directory to convert several pictures\n", output);
+    errors += nb_pictures;
+    nb_pictures = 0;
+  }
+  if (format_name == NULL && !output_is_directory)
+  {
+    int pos_last_dot = Position_last_dot(output);
+    if (pos_last_dot >= 0)
+      format_name = output + pos_last_dot + 1;
+  }
+  format = Find_save_format(format_name);
+  if (format == NULL)
+  {
+    GFX2_Log(GFX2_ERROR, "%s: unknown output format, use -format with one of :\n",
+             format_name != NULL ? format_name : output);
+    for (i = FORMAT_ALL_FILES + 1; i < (int)Nb_known_formats(); i++)
+    {
+      if (File_formats[i].Save != NULL && !File_formats[i].Palette_only)
+        GFX2_Log(GFX2_ERROR, " %s", File_formats[i].Extensions);
+    }
+    GFX2_Log(GFX2_ERROR, "\n");
+    errors += nb_pictures;
+    nb_pictures = 0;
+  }
+
+  start = GFX2_GetTicks();
+  nb_processes = GFX2_Thread_count();
+  if (nb_processes > nb_pictures)
+    nb_processes = nb_pictures;
+#if defined(CONVERT_USE_FORK)
+  if (nb_processes > 1)
+  {
+    int result = Convert_in_processes(&list, nb_processes, output, output_is_directory, format);
+    if (result >= 0)
+    {
+      errors += result;
+      nb_processes = 0;   // done
+    }
+  }
+#endif
+  if (nb_processes > 0)
+  {
+    for (i = 0; i < nb_pictures; i++)
+      errors += Convert_entry(&list, i, output, output_is_directory, format);
+  }
+  duration = GFX2_GetTicks() - start;
+
+  if (nb_pictures > 0)
+    printf("%d picture(s) in %lu ms: %.1f pictures/s, %d error(s)\n",
+           nb_pictures, (unsigned long)duration,
+           nb_pictures * 1000.0 / (duration > 0 ? duration : 1), errors);
+
+  for (i = 0; i < list.Count; i++)
+    free(list.Names[i]);
+  free(list.Names);
+  return errors ? 1 : 0;
+}
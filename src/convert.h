@@ -0,0 +1,43 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2019 Thomas Bernard
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file convert.h
+/// Command line conversion of pictures (-convert), without user interface.
+///
+/// The pictures are loaded in a surface, so 24-bit pictures are reduced
+/// to 256 colors and layers or frames are flattened, then saved in the
+/// requested format. On Unix, the pictures are split between processes.
+#ifndef CONVERT_H_INCLUDED
+#define CONVERT_H_INCLUDED
+
+///
+/// Converts pictures to another file format.
+/// @param inputs the pictures to convert. The file name part (not the
+///        directory) can have the wildcards '*' and '?'.
+/// @param nb_inputs number of entries in @a inputs
+/// @param output the directory where the converted pictures are written,
+///        with the default extension of the format. When there is only
+///        one picture, it can also be the name of the converted picture.
+/// @param format_name an extension of the output format, or NULL to use
+///        the extension of @a output.
+/// @return 0 when all the pictures were converted, 1 otherwise
+int Convert_pictures(char ** inputs, int nb_inputs, const char * output, const char * format_name);
+
+#endif
@@ -0,0 +1,144 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file dirtyrect.c
+/// List of the modified rectangles of the screen, waiting to be displayed.
+
+#include "dirtyrect.h"
+
+/// Smallest rectangle which contains a and b.
+static T_Dirty_rect Rect_union(const T_Dirty_rect * a, const T_Dirty_rect * b)
+{
+  T_Dirty_rect result;
+  int x2 = (a->x + a->w > b->x + b->w) ? a->x + a->w : b->x + b->w;
+  int y2 = (a->y + a->h > b->y + b->h) ? a->y + a->h : b->y + b->h;
+
+  result.x = (a->x < b->x) ? a->x : b->x;
+  result.y = (a->y < b->y) ? a->y : b->y;
+  result.w = x2 - result.x;
+  result.h = y2 - result.y;
+  return result;
+}
+
+static long Rect_area(const T_Dirty_rect * rect)
+{
+  return (long)rect->w * rect->h;
+}
+
+/// Pixels which are displayed for nothing when a and b are merged.
+/// It is negative when they overlap enough.
+static long Merge_cost(const T_Dirty_rect * a, const T_Dirty_rect * b)
+{
+  T_Dirty_rect merged = Rect_union(a, b);
+
+  return Rect_area(&merged) - Rect_area(a) - Rect_area(b);
+}
+
+/// Checks if two rectangles have pixels in common.
+static int Rect_intersect(const T_Dirty_rect * a, const T_Dirty_rect * b)
+{
+  return a->x < b->x + b->w && b->x < a->x + a->w
+      && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+/// Index of a rectangle of the region which has pixels in common with
+/// rect, or -1 if there is none.
+static int Intersecting_rect(const T_Dirty_region * region, const T_Dirty_rect * rect)
+{
+  int i;
+
+  for (i = 0; i < region->count; i++)
+    if (Rect_intersect(rect, region->rects + i))
+      return i;
+  return -1;
+}
+
+/// Index of the rectangle of the region which is the cheapest to merge
+/// with rect, or -1 if the region is empty.
+static int Cheapest_merge(const T_Dirty_region * region, const T_Dirty_rect * rect, long * cost)
+{
+  int best = -1;
+  int i;
+
+  for (i = 0; i < region->count; i++)
+  {
+    long c = Merge_cost(rect, region->rects + i);
+    if (best < 0 || c < *cost)
+    {
+      best = i;
+      *cost = c;
+    }
+  }
+  return best;
+}
+
+void Dirty_region_init(T_Dirty_region * region, long overhead)
+{
+  region->count = 0;
+  region->overhead = overhead;
+}
+
+void Dirty_region_clear(T_Dirty_region * region)
+{
+  region->count = 0;
+}
+
+void Dirty_region_add(T_Dirty_region * region, int x, int y, int w, int h)
+{
+  T_Dirty_rect rect;
+  int i;
+  long cost = 0;
+
+  if (w <= 0 || h <= 0)
+    return;
+  rect.x = x;
+  rect.y = y;
+  rect.w = w;
+  rect.h = h;
+
+  // The merged rectangle can be worth merging with another one,
+  // so start again until no merge is needed.
+  for (;;)
+  {
+    // Overlapping rectangles are always merged, so no pixel is
+    // displayed twice.
+    i = Intersecting_rect(region, &rect);
+    if (i < 0)
+    {
+      i = Cheapest_merge(region, &rect, &cost);
+      if (i < 0 || (cost >= region->overhead && region->count < DIRTY_RECTS_MAX))
+        break;
+    }
+    rect = Rect_union(&rect, region->rects + i);
+    region->rects[i] = region->rects[--region->count];
+  }
+  region->rects[region->count++] = rect;
+}
+
+long Dirty_region_pixels(const T_Dirty_region * region)
+{
+  long pixels = 0;
+  int i;
+
+  for (i = 0; i < region->count; i++)
+    pixels += Rect_area(region->rects + i);
+  return pixels;
+}
@@ -0,0 +1,70 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file dirtyrect.h
+/// List of the modified rectangles of the screen, waiting to be displayed.
+///
+/// Each new rectangle is merged with a rectangle of the list when they
+/// overlap, or when the pixels wasted by the merge cost less than
+/// displaying one more rectangle. So two small rectangles in opposite
+/// corners of the screen stay separate, while close or overlapping ones
+/// become one, and the rectangles of a region never overlap.
+
+#ifndef DIRTYRECT_H_INCLUDED
+#define DIRTYRECT_H_INCLUDED
+
+/// Maximum number of rectangles in a region
+#define DIRTY_RECTS_MAX 32
+
+typedef struct
+{
+  int x;
+  int y;
+  int w;
+  int h;
+} T_Dirty_rect;
+
+typedef struct
+{
+  int count;                           ///< Number of rectangles in the list
+  long overhead;                       ///< Cost of one more rectangle, in pixels
+  T_Dirty_rect rects[DIRTY_RECTS_MAX];
+} T_Dirty_region;
+
+///
+/// Empties a region, and sets the cost of one rectangle.
+/// @param overhead  number of pixels which cost as much to display as
+///                  one more rectangle.
+void Dirty_region_init(T_Dirty_region * region, long overhead);
+
+/// Empties a region.
+void Dirty_region_clear(T_Dirty_region * region);
+
+///
+/// Adds a rectangle to a region, merging it with the rectangles of the
+/// region which overlap it, or when it is cheaper. When the list is full,
+/// the rectangle is merged with the one which wastes the least pixels.
+void Dirty_region_add(T_Dirty_region * region, int x, int y, int w, int h);
+
+/// Total number of pixels of the rectangles of a region.
+long Dirty_region_pixels(const T_Dirty_region * region);
+
+#endif
@@ -1185,6 +1185,7 @@ void Main_handler(void)
                 break;
               case SPECIAL_EXCLUDE_COLORS_MENU : // Exclude colors menu
                 Menu_tag_colors("Tag colors to exclude",Exclude_color,&temp,1, NULL, SPECIAL_EXCLUDE_COLORS_MENU);
+                Palette_generation++;
                 action++;
                 break;
               case SPECIAL_INVERT_SIEVE :
@@ -161,6 +161,20 @@ do { \
   if (!lua_isfunction(L, (index))) return luaL_error(L, "%s: Argument %d is not a function.", func_name, index); \
 } while (0)
 
+///
+/// This macro reads a Lua argument into a pixel buffer, see New_pixel_buffer().
+/// If argument is invalid, it will break the caller and raise a verbose message.
+/// This macro uses 2 existing symbols: L for the context, and nb_args=lua_gettop(L)
+/// @param index     Index of the argument to check, starting at 1.
+/// @param func_name The name of the lua callback, to display a message in case of error.
+/// @param dest      Destination pointer, a T_Lua_pixel_buffer *.
+#define LUA_ARG_PIXEL_BUFFER(index, func_name, dest) \
+do { \
+  if (nb_args < (index)) return luaL_error(L, "%s: Argument %d is missing.", func_name, index); \
+  dest = To_pixel_buffer(L, (index)); \
+  if (dest == NULL) return luaL_error(L, "%s: Argument %d is not a pixel buffer.", func_name, index); \
+} while (0)
+
 /// Check if 'num' arguments were provided exactly
 #define LUA_ARG_LIMIT(num, func_name) \
 do { \
@@ -719,6 +733,373 @@ int L_GetLayerPixel(lua_State* L)
   return 1;
 }
 
+// Pixel buffers
+
+/// Name of the Lua metatable of the pixel buffers
+#define PIXEL_BUFFER_TYPE "grafx2.pixelbuffer"
+
+///
+/// A rectangle of pixels, owned by Lua as a full userdata.
+/// Scripts use it to read and write whole areas of the picture with one
+/// call, instead of one getpicturepixel() / putpicturepixel() call per pixel.
+/// The pixels follow the header, line by line.
+typedef struct
+{
+  word Width;
+  word Height;
+} T_Lua_pixel_buffer;
+
+/// Pixels of a buffer
+#define PIXEL_BUFFER_DATA(buffer) ((byte *)((buffer) + 1))
+
+/// Pushes a new pixel buffer on the Lua stack. Its pixels are not initialized.
+static T_Lua_pixel_buffer * New_pixel_buffer(lua_State* L, word width, word height)
+{
+  T_Lua_pixel_buffer * buffer;
+
+  buffer = (T_Lua_pixel_buffer *)lua_newuserdata(L, sizeof(T_Lua_pixel_buffer) + (size_t)width * height);
+  buffer->Width = width;
+  buffer->Height = height;
+  luaL_getmetatable(L, PIXEL_BUFFER_TYPE);
+  lua_setmetatable(L, -2);
+  return buffer;
+}
+
+/// Returns the pixel buffer at this index of the Lua stack, or NULL.
+static T_Lua_pixel_buffer * To_pixel_buffer(lua_State* L, int index)
+{
+  void * data = lua_touserdata(L, index);
+  int is_buffer = 0;
+
+  if (data != NULL && lua_getmetatable(L, index))
+  {
+    luaL_getmetatable(L, PIXEL_BUFFER_TYPE);
+    is_buffer = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2);
+  }
+  return is_buffer ? (T_Lua_pixel_buffer *)data : NULL;
+}
+
+///
+/// Clips a rectangle of the picture, at (x, y) and of the size of the buffer.
+/// @param image_width  Width of the picture.
+/// @param image_height Height of the picture.
+/// @param x_start      Receives the first visible column, in buffer space.
+/// @param x_end        Receives the column after the last visible one, in buffer space.
+/// @return 0 if the rectangle is completely outside the picture.
+static int Clip_pixel_buffer(const T_Lua_pixel_buffer * buffer, int x, int y, int image_width, int image_height, int * x_start, int * x_end)
+{
+  if (x >= image_width || y >= image_height || x <= -buffer->Width || y <= -buffer->Height)
+    return 0;
+  *x_start = x < 0 ? -x : 0;
+  *x_end = image_width - x < buffer->Width ? image_width - x : buffer->Width;
+  return 1;
+}
+
+/// Where Get_pixel_buffer() reads the pixels
+enum PIXEL_BUFFER_SOURCE
+{
+  PIXELS_FROM_PICTURE, ///< The visible picture, like getpicturepixel()
+  PIXELS_FROM_LAYER,   ///< The current layer, like getlayerpixel()
+  PIXELS_FROM_BACKUP,  ///< The picture before the script, like getbackuppixel()
+};
+
+///
+/// Common code of getpicturepixels(), getlayerpixels() and getbackuppixels().
+/// Arguments are x, y, width, height, and the function returns a new
+/// pixel buffer. The pixels outside the picture get its transparent color.
+static int Get_pixel_buffer(lua_State* L, const char * func_name, enum PIXEL_BUFFER_SOURCE source)
+{
+  int x;
+  int y;
+  int width;
+  int height;
+  int image_width;
+  int image_height;
+  int x_start;
+  int x_end;
+  int j;
+  byte transparent_color;
+  T_Lua_pixel_buffer * buffer;
+  int nb_args=lua_gettop(L);
+
+  LUA_ARG_LIMIT (4, func_name);
+  LUA_ARG_NUMBER(1, func_name, x, INT_MIN, INT_MAX);
+  LUA_ARG_NUMBER(2, func_name, y, INT_MIN, INT_MAX);
+  LUA_ARG_NUMBER(3, func_name, width, 1, 65535);
+  LUA_ARG_NUMBER(4, func_name, height, 1, 65535);
+
+  if (source == PIXELS_FROM_BACKUP)
+  {
+    image_width = Main_backup_page->Width;
+    image_height = Main_backup_page->Height;
+    transparent_color = Main_backup_page->Transparent_color;
+  }
+  else
+  {
+    image_width = Main.image_width;
+    image_height = Main.image_height;
+    transparent_color = Main.backups->Pages->Transparent_color;
+  }
+
+  buffer = New_pixel_buffer(L, (word)width, (word)height);
+  if (!Clip_pixel_buffer(buffer, x, y, image_width, image_height, &x_start, &x_end))
+  {
+    memset(PIXEL_BUFFER_DATA(buffer), transparent_color, (size_t)width * height);
+    return 1;
+  }
+  for (j = 0; j < height; j++)
+  {
+    byte * dest = PIXEL_BUFFER_DATA(buffer) + (size_t)j * width;
+    int line = y + j;
+    int i;
+
+    if (line < 0 || line >= image_height)
+    {
+      memset(dest, transparent_color, width);
+      continue;
+    }
+    memset(dest, transparent_color, x_start);
+    memset(dest + x_end, transparent_color, width - x_end);
+    switch (source)
+    {
+      case PIXELS_FROM_PICTURE:
+        if (Main.backups->Pages->Image_mode == IMAGE_MODE_ANIMATION)
+          memcpy(dest + x_start, Main.backups->Pages->Image[Main.current_layer].Pixels + line * image_width + x + x_start, x_end - x_start);
+        else
+          for (i = x_start; i < x_end; i++)
+            dest[i] = Read_pixel_from_current_screen(x + i, line);
+        break;
+      case PIXELS_FROM_LAYER:
+        memcpy(dest + x_start, Main.backups->Pages->Image[Main.current_layer].Pixels + line * image_width + x + x_start, x_end - x_start);
+        break;
+      case PIXELS_FROM_BACKUP:
+        // Same as getbackuppixel(): the backup can have other dimensions
+        memcpy(dest + x_start, Main_backup_screen + line * image_width + x + x_start, x_end - x_start);
+        break;
+    }
+  }
+  return 1;
+}
+
+int L_GetPicturePixels(lua_State* L)
+{
+  return Get_pixel_buffer(L, "getpicturepixels", PIXELS_FROM_PICTURE);
+}
+
+int L_GetLayerPixels(lua_State* L)
+{
+  return Get_pixel_buffer(L, "getlayerpixels", PIXELS_FROM_LAYER);
+}
+
+int L_GetBackupPixels(lua_State* L)
+{
+  return Get_pixel_buffer(L, "getbackuppixels", PIXELS_FROM_BACKUP);
+}
+
+int L_PutPicturePixels(lua_State* L)
+{
+  int x;
+  int y;
+  int x_start;
+  int x_end;
+  int j;
+  T_Lua_pixel_buffer * buffer;
+  int nb_args=lua_gettop(L);
+
+  LUA_ARG_LIMIT (3, "putpicturepixels");
+  LUA_ARG_NUMBER(1, "putpicturepixels", x, INT_MIN, INT_MAX);
+  LUA_ARG_NUMBER(2, "putpicturepixels", y, INT_MIN, INT_MAX);
+  LUA_ARG_PIXEL_BUFFER(3, "putpicturepixels", buffer);
+
+  // Parts outside the picture are silently ignored
+  if (!Clip_pixel_buffer(buffer, x, y, Main.image_width, Main.image_height, &x_start, &x_end))
+    return 0;
+  for (j = 0; j < buffer->Height; j++)
+  {
+    const byte * src = PIXEL_BUFFER_DATA(buffer) + (size_t)j * buffer->Width;
+    int line = y + j;
+    int i;
+
+    if (line < 0 || line >= Main.image_height)
+      continue;
+    if (Main.backups->Pages->Image_mode == IMAGE_MODE_ANIMATION)
+      memcpy(Main.backups->Pages->Image[Main.current_layer].Pixels + line * Main.image_width + x + x_start, src + x_start, x_end - x_start);
+    else
+      // Layers and constrained modes need the full pixel renderer
+      for (i = x_start; i < x_end; i++)
+        Pixel_in_current_screen(x + i, line, src[i]);
+  }
+  return 0; // no values returned for lua
+}
+
+int L_NewPixelBuffer(lua_State* L)
+{
+  int width;
+  int height;
+  int c = 0;
+  T_Lua_pixel_buffer * buffer;
+  int nb_args=lua_gettop(L);
+
+  if (nb_args < 2 || nb_args > 3)
+  {
+    return luaL_error(L, "newpixelbuffer: Expected 2 or 3 arguments, but found %d.", nb_args);
+  }
+  LUA_ARG_NUMBER(1, "newpixelbuffer", width, 1, 65535);
+  LUA_ARG_NUMBER(2, "newpixelbuffer", height, 1, 65535);
+  if (nb_args > 2)
+  {
+    LUA_ARG_NUMBER(3, "newpixelbuffer", c, INT_MIN, INT_MAX);
+  }
+
+  buffer = New_pixel_buffer(L, (word)width, (word)height);
+  memset(PIXEL_BUFFER_DATA(buffer), (byte)c, (size_t)width * height);
+  return 1;
+}
+
+// Methods of the pixel buffers: buffer:get(x, y), etc.
+// As for the picture, coordinates start at 0 and pixels outside
+// the buffer are silently ignored.
+
+int L_PixelBuffer_Get(lua_State* L)
+{
+  int x;
+  int y;
+  T_Lua_pixel_buffer * buffer;
+  int nb_args=lua_gettop(L);
+
+  LUA_ARG_LIMIT (3, "pixelbuffer:get");
+  LUA_ARG_PIXEL_BUFFER(1, "pixelbuffer:get", buffer);
+  LUA_ARG_NUMBER(2, "pixelbuffer:get", x, INT_MIN, INT_MAX);
+  LUA_ARG_NUMBER(3, "pixelbuffer:get", y, INT_MIN, INT_MAX);
+
+  if (x<0 || y<0 || x>=buffer->Width || y>=buffer->Height)
+    lua_pushinteger(L, 0);
+  else
+    lua_pushinteger(L, PIXEL_BUFFER_DATA(buffer)[x + y * buffer->Width]);
+  return 1;
+}
+
+int L_PixelBuffer_Set(lua_State* L)
+{
+  int x;
+  int y;
+  int c;
+  T_Lua_pixel_buffer * buffer;
+  int nb_args=lua_gettop(L);
+
+  LUA_ARG_LIMIT (4, "pixelbuffer:set");
+  LUA_ARG_PIXEL_BUFFER(1, "pixelbuffer:set", buffer);
+  LUA_ARG_NUMBER(2, "pixelbuffer:set", x, INT_MIN, INT_MAX);
+  LUA_ARG_NUMBER(3, "pixelbuffer:set", y, INT_MIN, INT_MAX);
+  LUA_ARG_NUMBER(4, "pixelbuffer:set", c, INT_MIN, INT_MAX);
+
+  if (x>=0 && y>=0 && x<buffer->Width && y<buffer->Height)
+    PIXEL_BUFFER_DATA(buffer)[x + y * buffer->Width] = (byte)c;
+  return 0;
+}
+
+int L_PixelBuffer_Size(lua_State* L)
+{
+  T_Lua_pixel_buffer * buffer;
+  int nb_args=lua_gettop(L);
+
+  LUA_ARG_LIMIT (1, "pixelbuffer:size");
+  LUA_ARG_PIXEL_BUFFER(1, "pixelbuffer:size", buffer);
+
+  lua_pushinteger(L, buffer->Width);
+  lua_pushinteger(L, buffer->Height);
+  return 2;
+}
+
+int L_PixelBuffer_Fill(lua_State* L)
+{
+  int c;
+  T_Lua_pixel_buffer * buffer;
+  int nb_args=lua_gettop(L);
+
+  LUA_ARG_LIMIT (2, "pixelbuffer:fill");
+  LUA_ARG_PIXEL_BUFFER(1, "pixelbuffer:fill", buffer);
+  LUA_ARG_NUMBER(2, "pixelbuffer:fill", c, INT_MIN, INT_MAX);
+
+  memset(PIXEL_BUFFER_DATA(buffer), (byte)c, (size_t)buffer->Width * buffer->Height);
+  return 0;
+}
+
+/// buffer:getrow(y) returns the line as a table, from row[1] to row[width].
+int L_PixelBuffer_GetRow(lua_State* L)
+{
+  int y;
+  int i;
+  const byte * src;
+  T_Lua_pixel_buffer * buffer;
+  int nb_args=lua_gettop(L);
+
+  LUA_ARG_LIMIT (2, "pixelbuffer:getrow");
+  LUA_ARG_PIXEL_BUFFER(1, "pixelbuffer:getrow", buffer);
+  LUA_ARG_NUMBER(2, "pixelbuffer:getrow", y, 0, buffer->Height - 1);
+
+  src = PIXEL_BUFFER_DATA(buffer) + (size_t)y * buffer->Width;
+  lua_createtable(L, buffer->Width, 0);
+  for (i = 0; i < buffer->Width; i++)
+  {
+    lua_pushinteger(L, src[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  return 1;
+}
+
+/// buffer:setrow(y, row) is the reverse of getrow(). Missing entries are left unchanged.
+int L_PixelBuffer_SetRow(lua_State* L)
+{
+  int y;
+  int i;
+  byte * dest;
+  T_Lua_pixel_buffer * buffer;
+  int nb_args=lua_gettop(L);
+
+  LUA_ARG_LIMIT (3, "pixelbuffer:setrow");
+  LUA_ARG_PIXEL_BUFFER(1, "pixelbuffer:setrow", buffer);
+  LUA_ARG_NUMBER(2, "pixelbuffer:setrow", y, 0, buffer->Height - 1);
+  if (!lua_istable(L, 3))
+    return luaL_error(L, "%s: Argument %d is not a table.", "pixelbuffer:setrow", 3);
+
+  dest = PIXEL_BUFFER_DATA(buffer) + (size_t)y * buffer->Width;
+  for (i = 0; i < buffer->Width; i++)
+  {
+    lua_rawgeti(L, 3, i + 1);
+    if (lua_isnumber(L, -1))
+      dest[i] = (byte)lua_tonumber(L, -1);
+    lua_pop(L, 1);
+  }
+  return 0;
+}
+
+/// Creates the metatable of the pixel buffers, which holds their methods.
+static void Register_pixel_buffer(lua_State* L)
+{
+  static const luaL_Reg methods[] = {
+    {"get", L_PixelBuffer_Get},
+    {"set", L_PixelBuffer_Set},
+    {"size", L_PixelBuffer_Size},
+    {"fill", L_PixelBuffer_Fill},
+    {"getrow", L_PixelBuffer_GetRow},
+    {"setrow", L_PixelBuffer_SetRow},
+    {NULL, NULL}
+  };
+  const luaL_Reg * method;
+
+  luaL_newmetatable(L, PIXEL_BUFFER_TYPE);
+  lua_newtable(L);
+  for (method = methods; method->name != NULL; method++)
+  {
+    lua_pushcfunction(L, method->func);
+    lua_setfield(L, -2, method->name);
+  }
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
 // Spare
 
 int L_GetSparePictureSize(lua_State* L)
@@ -791,6 +1172,30 @@ int L_GetSpareTransColor(lua_State* L)
 }
 
 
+/// Size of the cache of matchcolor2() results
+#define MATCH_COLOR_CACHE_SIZE 16384
+
+///
+/// What matchcolor2() needs from the palette, computed once per palette:
+/// the colors which are not excluded and their lightness. It also keeps
+/// the recent results for integer RGB values, as remapping scripts ask
+/// the same colors again and again.
+/// setcolor() empties it, and so does each new script.
+static struct
+{
+  byte Is_valid;
+  int Nb_colors;                        ///< Number of colors not excluded
+  byte Color[256];                      ///< The colors not excluded
+  double R[256];                        ///< Components of the colors not excluded
+  double G[256];
+  double B[256];
+  double Brightness[256];               ///< Perceptual lightness of each color
+  int Last;                             ///< Position in Color[] of the last result
+  double Weight;                        ///< Lightness weight of the cached results
+  dword Key[MATCH_COLOR_CACHE_SIZE];    ///< 1 and RGB of a cached result, or 0 when the entry is empty
+  byte Result[MATCH_COLOR_CACHE_SIZE];
+} Match_color_data;
+
 int L_SetColor(lua_State* L)
 {
   byte c;
@@ -809,6 +1214,8 @@ int L_SetColor(lua_State* L)
   Main.palette[c].B=Round_palette_component(clamp_byte(b));
   // Set_color(c, r, g, b); Not needed. Update screen when script is finished
   Palette_has_changed=1;
+  Palette_generation++;
+  Match_color_data.Is_valid=0;
   return 0;
 }
 
@@ -864,11 +1271,141 @@ int L_MatchColor(lua_State* L)
   return 1;
 }
 
+static void Prepare_match_color(void)
+{
+  int col;
+
+  Match_color_data.Nb_colors = 0;
+  for (col=0; col<256; col++)
+  {
+    if (Exclude_color[col])
+      continue;
+    Match_color_data.Color[Match_color_data.Nb_colors] = col;
+    Match_color_data.R[Match_color_data.Nb_colors] = Main.palette[col].R;
+    Match_color_data.G[Match_color_data.Nb_colors] = Main.palette[col].G;
+    Match_color_data.B[Match_color_data.Nb_colors] = Main.palette[col].B;
+    Match_color_data.Nb_colors++;
+    // Similar to Perceptual_lightness();
+    Match_color_data.Brightness[col] = sqrt(0.26*0.26*(Main.palette[col].R*Main.palette[col].R) + 0.55*0.55*(Main.palette[col].G*Main.palette[col].G) + 0.19*0.19*(Main.palette[col].B*Main.palette[col].B));
+  }
+  memset(Match_color_data.Key, 0, sizeof(Match_color_data.Key));
+  Match_color_data.Last = 0;
+  Match_color_data.Is_valid = 1;
+}
+
+///
+/// Color search of matchcolor2().
+/// Similar to Best_color_perceptual(), but with floating point.
+static byte Match_color2(double r, double g, double b, double l_weight)
+{
+  int i;
+  int index = 0;
+  dword key = 0;
+  byte best_color = 0;
+  double best_diff=9e99;
+  double target_bri;
+  double diff_b, diff_c, diff;
+  double color_weight = 1.0 - l_weight;
+
+  if (!Match_color_data.Is_valid)
+    Prepare_match_color();
+
+  if (r<0.0)
+    r=0;
+  else if (r>255.0)
+    r=255.0;
+  if (g<0.0)
+    g=0;
+  else if (g>255.0)
+    g=255.0;
+  if (b<0.0)
+    b=0;
+  else if (b>255.0)
+    b=255.0;
+
+  // Only integer colors are cached
+  if (r == (int)r && g == (int)g && b == (int)b)
+  {
+    if (l_weight != Match_color_data.Weight)
+    {
+      memset(Match_color_data.Key, 0, sizeof(Match_color_data.Key));
+      Match_color_data.Weight = l_weight;
+    }
+    key = (1u << 24) | ((dword)r << 16) | ((dword)g << 8) | (dword)b;
+    // Multiplicative hashing, keeps the 14 upper bits
+    index = (int)((key * 2654435761u) >> 18) & (MATCH_COLOR_CACHE_SIZE - 1);
+    if (Match_color_data.Key[index] == key)
+      return Match_color_data.Result[index];
+  }
+
+  // Similar to Perceptual_lightness();
+  target_bri = sqrt(0.26*r*0.26*r + 0.55*g*0.55*g + 0.19*b*0.19*b);
+
+  // The previous result is usually close, it gives a first candidate
+  if (Match_color_data.Nb_colors > 0)
+  {
+    i = Match_color_data.Last;
+    best_color = Match_color_data.Color[i];
+    diff_c = sqrt(
+      (0.26*(Match_color_data.R[i]-r))*
+      (0.26*(Match_color_data.R[i]-r))+
+      (0.55*(Match_color_data.G[i]-g))*
+      (0.55*(Match_color_data.G[i]-g))+
+      (0.19*(Match_color_data.B[i]-b))*
+      (0.19*(Match_color_data.B[i]-b)));
+    diff_b = fabs(target_bri-Match_color_data.Brightness[best_color]);
+    best_diff = l_weight*(diff_b-diff_c)+diff_c;
+  }
+
+  for (i=0; i<Match_color_data.Nb_colors; i++)
+  {
+    byte col = Match_color_data.Color[i];
+    double dist2 =
+      (0.26*(Match_color_data.R[i]-r))*
+      (0.26*(Match_color_data.R[i]-r))+
+      (0.55*(Match_color_data.G[i]-g))*
+      (0.55*(Match_color_data.G[i]-g))+
+      (0.19*(Match_color_data.B[i]-b))*
+      (0.19*(Match_color_data.B[i]-b));
+
+    // diff can't be less than color_weight*diff_c: skip the square roots
+    // of the colors which are already too far. The small margin keeps
+    // the rounding errors on the safe side.
+    if (dist2 >= 1.0 && color_weight*color_weight*dist2 > best_diff*best_diff*1.000001)
+      continue;
+    diff_c = sqrt(dist2);
+    // Exact match
+    if (diff_c<1.0)
+    {
+      best_color=col;
+      Match_color_data.Last=i;
+      break;
+    }
+
+    diff_b = fabs(target_bri-Match_color_data.Brightness[col]);
+
+    diff=l_weight*(diff_b-diff_c)+diff_c;
+    // On a tie, the first color wins, even if it comes after the candidate
+    if (diff<best_diff || (diff==best_diff && col<best_color))
+    {
+      best_diff=diff;
+      best_color=col;
+      Match_color_data.Last=i;
+    }
+  }
+
+  if (key != 0)
+  {
+    Match_color_data.Key[index] = key;
+    Match_color_data.Result[index] = best_color;
+  }
+  return best_color;
+}
+
 int L_MatchColor2(lua_State* L)
 {
   double r, g, b;
   double l_weight = 0.25;
-  byte best_color = 0;
   int nb_args=lua_gettop(L);
 
   if (nb_args < 3 || nb_args > 4)
@@ -882,64 +1419,75 @@ int L_MatchColor2(lua_State* L)
   {
     LUA_ARG_NUMBER(4, "matchcolor2", l_weight, 0.0, 1.0);
   }
-  
-  // Similar to Best_color_perceptual(), but with floating point
+
+  lua_pushinteger(L, Match_color2(r, g, b, l_weight));
+  return 1;
+}
+
+///
+/// Common code of matchcolors() and matchcolors2().
+/// The first argument is a table of colors, as consecutive red, green and
+/// blue values: {r1, g1, b1, r2, g2, b2, ...}. Returns a table with the
+/// matching color of each one.
+/// @param l_weight Lightness weight for matchcolor2(), or a negative value for matchcolor().
+static int Match_colors(lua_State* L, const char * func_name, double l_weight)
+{
+  int i;
+
+  if (!lua_istable(L, 1))
+    return luaL_error(L, "%s: Argument %d is not a table.", func_name, 1);
+
+  lua_newtable(L);
+  for (i = 0; ; i++)
   {
-    int col;  
-    double best_diff=9e99;
-    double target_bri;
-    double bri;
-    double diff_b, diff_c, diff;
-  
-    if (r<0.0)
-      r=0;
-    else if (r>255.0)
-      r=255.0;
-    if (g<0.0)
-      g=0;
-    else if (g>255.0)
-      g=255.0;
-    if (b<0.0)
-      b=0;
-    else if (b>255.0)
-      b=255.0;
-  
-    // Similar to Perceptual_lightness();
-    target_bri = sqrt(0.26*r*0.26*r + 0.55*g*0.55*g + 0.19*b*0.19*b);
-    
-    for (col=0; col<256; col++)
+    double rgb[3];
+    int component;
+    byte color;
+
+    for (component = 0; component < 3; component++)
     {
-      if (Exclude_color[col])
-        continue;
-  
-      diff_c = sqrt(
-        (0.26*(Main.palette[col].R-r))*
-        (0.26*(Main.palette[col].R-r))+
-        (0.55*(Main.palette[col].G-g))*
-        (0.55*(Main.palette[col].G-g))+
-        (0.19*(Main.palette[col].B-b))*
-        (0.19*(Main.palette[col].B-b)));
-      // Exact match
-      if (diff_c<1.0)
+      lua_rawgeti(L, 1, i*3 + component + 1);
+      if (lua_isnil(L, -1) && component == 0)
       {
-          lua_pushinteger(L, col);
-          return 1;
+        lua_pop(L, 1);
+        return 1;
       }
-  
-      bri = sqrt(0.26*0.26*(Main.palette[col].R*Main.palette[col].R) + 0.55*0.55*(Main.palette[col].G*Main.palette[col].G) + 0.19*0.19*(Main.palette[col].B*Main.palette[col].B));
-      diff_b = fabs(target_bri-bri);
-  
-      diff=l_weight*(diff_b-diff_c)+diff_c;
-      if (diff<best_diff)
-      {
-        best_diff=diff;
-        best_color=col;
-      } 
+      if (!lua_isnumber(L, -1))
+        return luaL_error(L, "%s: Entry %d of the table is not a number.", func_name, i*3 + component + 1);
+      rgb[component] = lua_tonumber(L, -1);
+      lua_pop(L, 1);
     }
+    if (l_weight < 0.0)
+      color = Best_color_nonexcluded(clamp_byte(rgb[0]), clamp_byte(rgb[1]), clamp_byte(rgb[2]));
+    else
+      color = Match_color2(rgb[0], rgb[1], rgb[2], l_weight);
+    lua_pushinteger(L, color);
+    lua_rawseti(L, -2, i + 1);
   }
-  
-  lua_pushinteger(L, best_color);
-  return 1;
+}
+
+int L_MatchColors(lua_State* L)
+{
+  int nb_args=lua_gettop(L);
+
+  LUA_ARG_LIMIT (1, "matchcolors");
+  return Match_colors(L, "matchcolors", -1.0);
+}
+
+int L_MatchColors2(lua_State* L)
+{
+  double l_weight = 0.25;
+  int nb_args=lua_gettop(L);
+
+  if (nb_args < 1 || nb_args > 2)
+  {
+    return luaL_error(L, "matchcolors2: Expected 1 or 2 arguments, but found %d.", nb_args);
+  }
+  if (nb_args > 1)
+  {
+    LUA_ARG_NUMBER(2, "matchcolors2", l_weight, 0.0, 1.0);
+  }
+  return Match_colors(L, "matchcolors2", l_weight);
 }
 
 int L_GetForeColor(lua_State* L)
@@ -2032,35 +2580,293 @@ int L_GetFileName(lua_State* L)
   return 2;
 }
 
-/// Run a script while changing the current directory
-int L_Run(lua_State* L)
+// Compiled chunks and kept states
+
+/// A Lua script or module, compiled, see Load_lua_file()
+typedef struct T_Lua_chunk
 {
-  const char * script_arg;
-  const char * message;
-  char * saved_directory;
-  char * full_path;
-  const char * path;
-  char * file_name;
-  static int nested_calls = 0;
-    
-  int nb_args = lua_gettop(L);
-  
-  LUA_ARG_LIMIT (1, "run");
-  LUA_ARG_STRING(1, "run", script_arg);
+  char * Path;                ///< Full path of the file
+  time_t Modified;            ///< Modification time of the file when it was compiled
+  unsigned long Size;         ///< Size of the file when it was compiled
+  char * Bytecode;            ///< Output of lua_dump()
+  size_t Bytecode_size;
+  struct T_Lua_chunk * Next;
+} T_Lua_chunk;
 
-  nested_calls++;
-  if (nested_calls > 100)
-    return luaL_error(L, "run: too many nested calls (100)");
-    
-  // store the current directory (on the stack)
-  saved_directory = Get_current_directory(NULL, NULL, 0);
+/// Compiled scripts and modules, most recently used first
+static T_Lua_chunk * Lua_chunks = NULL;
 
-  full_path = strdup(script_arg);
-  #if defined (__AROS__)
-  // Convert path written on Linux/Windows norms to AROS norms :
-  // Each element like ../ and ..\ is replaced by /
-  // Each path separator \ is replaced by /
-  {
+/// A Lua state kept between the runs of the scripts of a directory,
+/// see T_Config::Lua_keep_state
+typedef struct T_Kept_lua_state
+{
+  char * Directory;           ///< Directory of the scripts which used it
+  lua_State * L;
+  struct T_Kept_lua_state * Next;
+} T_Kept_lua_state;
+
+static T_Kept_lua_state * Kept_lua_states = NULL;
+
+static void Free_lua_chunk(T_Lua_chunk * chunk)
+{
+  free(chunk->Path);
+  free(chunk->Bytecode);
+  free(chunk);
+}
+
+/// lua_Writer for lua_dump(), which appends the bytecode to a T_Lua_chunk
+static int Chunk_writer(lua_State* L, const void* p, size_t size, void* ud)
+{
+  T_Lua_chunk * chunk = (T_Lua_chunk *)ud;
+  char * bytecode;
+
+  (void)L; // unused
+  bytecode = realloc(chunk->Bytecode, chunk->Bytecode_size + size);
+  if (bytecode == NULL)
+    return 1;
+  memcpy(bytecode + chunk->Bytecode_size, p, size);
+  chunk->Bytecode = bytecode;
+  chunk->Bytecode_size += size;
+  return 0;
+}
+
+///
+/// Loads a Lua file as a function on top of the stack, like luaL_loadfile().
+/// The file is only compiled the first time: the bytecode is kept, and loaded
+/// again as long as the modification time and the size of the file are the
+/// same.
+/// @return 0 on success, or the error code of luaL_loadfile() with the error
+///         message on the stack.
+static int Load_lua_file(lua_State* L, const char * filename)
+{
+  T_Lua_chunk * chunk;
+  T_Lua_chunk ** previous;
+  char * full_path;
+  time_t modified;
+  unsigned long size;
+  int result;
+
+  full_path = Realpath(filename, NULL);
+  if (full_path == NULL)
+    return luaL_loadfile(L, filename);
+  modified = File_modification_time(full_path);
+  size = File_length(full_path);
+
+  for (previous = &Lua_chunks; (chunk = *previous) != NULL; previous = &chunk->Next)
+    if (!strcmp(chunk->Path, full_path))
+      break;
+  if (chunk != NULL)
+  {
+    *previous = chunk->Next;
+    if (modified != 0 && chunk->Modified == modified && chunk->Size == size)
+    {
+      if (luaL_loadbuffer(L, chunk->Bytecode, chunk->Bytecode_size, filename) == 0)
+      {
+        // move it first in the list
+        chunk->Next = Lua_chunks;
+        Lua_chunks = chunk;
+        free(full_path);
+        return 0;
+      }
+      lua_pop(L, 1); // error message
+    }
+    Free_lua_chunk(chunk);
+  }
+
+  result = luaL_loadfile(L, filename);
+  if (result != 0 || modified == 0)
+  {
+    free(full_path);
+    return result;
+  }
+  chunk = (T_Lua_chunk *)GFX2_malloc(sizeof(T_Lua_chunk));
+  if (chunk == NULL)
+  {
+    free(full_path);
+    return 0;
+  }
+  chunk->Path = full_path;
+  chunk->Modified = modified;
+  chunk->Size = size;
+  chunk->Bytecode = NULL;
+  chunk->Bytecode_size = 0;
+  // The debug information is kept, for the line numbers in error messages
+#if LUA_VERSION_NUM >= 503
+  if (lua_dump(L, Chunk_writer, chunk, 0) != 0 || chunk->Bytecode_size == 0)
+#else
+  if (lua_dump(L, Chunk_writer, chunk) != 0 || chunk->Bytecode_size == 0)
+#endif
+  {
+    Free_lua_chunk(chunk);
+    return 0;
+  }
+  chunk->Next = Lua_chunks;
+  Lua_chunks = chunk;
+  return 0;
+}
+
+///
+/// Searcher of Lua modules for require(), which replaces the standard one for
+/// Lua files. It looks for the module along package.path the same way, but
+/// loads the file with Load_lua_file().
+static int L_Search_lua_file(lua_State* L)
+{
+  const char * name;
+  const char * templates;
+  const char * end;
+  const char * module_path;
+
+  name = luaL_checkstring(L, 1);
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "path");
+  templates = lua_tostring(L, -1);
+  if (templates == NULL)
+    return luaL_error(L, "package.path must be a string");
+  module_path = luaL_gsub(L, name, ".", "/");
+  lua_pushliteral(L, ""); // the list of files tried, for the error message
+
+  for (; *templates != '\0'; templates = end)
+  {
+    const char * filename;
+
+    while (*templates == ';')
+      templates++;
+    if (*templates == '\0')
+      break;
+    end = strchr(templates, ';');
+    if (end == NULL)
+      end = templates + strlen(templates);
+    lua_pushlstring(L, templates, end - templates);
+    filename = luaL_gsub(L, lua_tostring(L, -1), "?", module_path);
+    lua_remove(L, -2);
+    if (File_exists(filename))
+    {
+      if (Load_lua_file(L, filename) != 0)
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s",
+                          name, filename, lua_tostring(L, -1));
+      lua_pushstring(L, filename); // 2nd argument of the loader since Lua 5.2
+      return 2;
+    }
+    lua_pushfstring(L, "\n\tno file '%s'", filename);
+    lua_remove(L, -2);
+    lua_concat(L, 2);
+  }
+  return 1;
+}
+
+/// Installs L_Search_lua_file() in place of the searcher of Lua files
+static void Register_lua_searcher(lua_State* L)
+{
+  lua_getglobal(L, "package");
+  if (lua_istable(L, -1))
+  {
+#if LUA_VERSION_NUM >= 502
+    lua_getfield(L, -1, "searchers");
+#else
+    lua_getfield(L, -1, "loaders");
+#endif
+    if (lua_istable(L, -1))
+    {
+      // 1 is the preload searcher, 2 the one for Lua files
+      lua_pushcfunction(L, L_Search_lua_file);
+      lua_rawseti(L, -2, 2);
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+}
+
+///
+/// Takes the state kept for a directory out of the list.
+/// @return the state, or NULL if there is none.
+static lua_State * Take_kept_lua_state(const char * directory)
+{
+  T_Kept_lua_state * kept;
+  T_Kept_lua_state ** previous;
+
+  for (previous = &Kept_lua_states; (kept = *previous) != NULL; previous = &kept->Next)
+  {
+    if (!strcmp(kept->Directory, directory))
+    {
+      lua_State * L = kept->L;
+
+      *previous = kept->Next;
+      free(kept->Directory);
+      free(kept);
+      return L;
+    }
+  }
+  return NULL;
+}
+
+///
+/// Keeps a state for the next script of a directory.
+/// @param directory allocated string, which is freed with the list on success
+/// @return 1 on success, 0 if there is not enough memory.
+static int Keep_lua_state(char * directory, lua_State* L)
+{
+  T_Kept_lua_state * kept;
+
+  kept = (T_Kept_lua_state *)GFX2_malloc(sizeof(T_Kept_lua_state));
+  if (kept == NULL)
+    return 0;
+  lua_settop(L, 0);
+  kept->Directory = directory;
+  kept->L = L;
+  kept->Next = Kept_lua_states;
+  Kept_lua_states = kept;
+  return 1;
+}
+
+void Free_script_cache(void)
+{
+  while (Kept_lua_states != NULL)
+  {
+    T_Kept_lua_state * kept = Kept_lua_states;
+
+    Kept_lua_states = kept->Next;
+    lua_close(kept->L);
+    free(kept->Directory);
+    free(kept);
+  }
+  while (Lua_chunks != NULL)
+  {
+    T_Lua_chunk * chunk = Lua_chunks;
+
+    Lua_chunks = chunk->Next;
+    Free_lua_chunk(chunk);
+  }
+}
+
+/// Run a script while changing the current directory
+int L_Run(lua_State* L)
+{
+  const char * script_arg;
+  const char * message;
+  char * saved_directory;
+  char * full_path;
+  const char * path;
+  char * file_name;
+  static int nested_calls = 0;
+    
+  int nb_args = lua_gettop(L);
+  
+  LUA_ARG_LIMIT (1, "run");
+  LUA_ARG_STRING(1, "run", script_arg);
+
+  nested_calls++;
+  if (nested_calls > 100)
+    return luaL_error(L, "run: too many nested calls (100)");
+    
+  // store the current directory (on the stack)
+  saved_directory = Get_current_directory(NULL, NULL, 0);
+
+  full_path = strdup(script_arg);
+  #if defined (__AROS__)
+  // Convert path written on Linux/Windows norms to AROS norms :
+  // Each element like ../ and ..\ is replaced by /
+  // Each path separator \ is replaced by /
+  {
     const char *src = script_arg;
     char *dst = full_path;
     char c;
@@ -2115,7 +2921,7 @@ int L_Run(lua_State* L)
     file_name = full_path;
   }
 
-  if (luaL_loadfile(L, file_name) != 0)
+  if (Load_lua_file(L, file_name) != 0)
   {
     int r;
     nb_args = lua_gettop(L);
@@ -2159,11 +2965,13 @@ DECLARE_UNSAVED(L_DrawDisk)
 DECLARE_UNSAVED(L_DrawFilledRect)
 DECLARE_UNSAVED(L_DrawLine)
 DECLARE_UNSAVED(L_PutPicturePixel)
+DECLARE_UNSAVED(L_PutPicturePixels)
 
 /// Bindings for screen-drawing Lua functions, if the current image is backed up.
 void Register_main_writable(lua_State* L)
 {
   lua_register(L,"putpicturepixel",L_PutPicturePixel);
+  lua_register(L,"putpicturepixels",L_PutPicturePixels);
   lua_register(L,"drawline",L_DrawLine);
   lua_register(L,"drawfilledrect",L_DrawFilledRect);
   lua_register(L,"drawcircle",L_DrawCircle);
@@ -2175,6 +2983,7 @@ void Register_main_writable(lua_State* L)
 void Register_main_readonly(lua_State* L)
 {
   lua_register(L,"putpicturepixel",L_PutPicturePixel_unsaved);
+  lua_register(L,"putpicturepixels",L_PutPicturePixels_unsaved);
   lua_register(L,"drawline",L_DrawLine_unsaved);
   lua_register(L,"drawfilledrect",L_DrawFilledRect_unsaved);
   lua_register(L,"drawcircle",L_DrawCircle_unsaved);
@@ -2373,66 +3182,143 @@ static char * Last_run_script = NULL;
 
 // Before: Cursor hidden
 // After: Cursor shown
-void Run_script(const char *script_subdirectory, const char *script_filename)
-{
-  lua_State* L;
-  const char* message;
-  byte  old_cursor_shape = Cursor_shape;
-  char * path;
-  int original_image_width = Main.image_width;
-  int original_image_height = Main.image_height;
-  int original_current_layer = Main.current_layer;
+// Batch mode versions of the user interface functions.
+// There is no window to show, and nobody to answer.
 
-  // Some scripts are slow
-  Cursor_shape = CURSOR_SHAPE_HOURGLASS;
-  Display_cursor();
-  Flush_update();
-  Cursor_is_visible=1;
+/// messagebox() writes the message on the standard output
+int L_MessageBox_batch(lua_State* L)
+{
+  const char * caption = "Script message";
+  const char * message;
+  int nb_args = lua_gettop (L);
 
-  free(Last_run_script);
-  if (script_subdirectory && script_subdirectory[0]!='\0')
-    Last_run_script = Filepath_append_to_dir(script_subdirectory, script_filename);
+  if (nb_args == 1)
+  {
+    LUA_ARG_STRING(1, "messagebox", message);
+  }
+  else if (nb_args == 2)
+  {
+    LUA_ARG_STRING(1, "messagebox", caption);
+    LUA_ARG_STRING(2, "messagebox", message);
+  }
   else
-    Last_run_script = strdup(script_filename);
-  
-  // This chdir is for the script's sake. Grafx2 itself will (try to)
-  // not rely on what is the system's current directory.
-  path = Extract_path(NULL, Last_run_script);
-  Change_directory(path);
-  free(path);
+  {
+    return luaL_error(L, "messagebox: Needs one or two arguments.");
+  }
+  printf("%s: %s\n", caption, message);
+  return 0;
+}
 
-  L = luaL_newstate(); // used to be lua_open() on Lua 5.1, deprecated on 5.2
+/// statusmessage() is only logged
+int L_StatusMessage_batch(lua_State* L)
+{
+  const char* msg;
+  int nb_args = lua_gettop(L);
 
-  /// @todo as the value doesn't vary, this should be
-  /// done once at the start of the program
-  path = GFX2_malloc(strlen(Data_directory) + strlen(SCRIPTS_SUBDIRECTORY) + strlen(LUALIB_SUBDIRECTORY) + 5 + 3 * strlen(PATH_SEPARATOR) + 9 + 1);
-  if (path == NULL)
-    return;
-  strcpy(path, Data_directory);
-  Append_path(path, SCRIPTS_SUBDIRECTORY, NULL);
-  Append_path(path, LUALIB_SUBDIRECTORY, NULL);
-  Append_path(path, "?.lua", NULL);
-  // SetEnvironmentVariableA() won't work because lua uses getenv()
-#if defined(_MSC_VER)
-  if (_putenv_s("LUA_PATH", path) < 0)
-    GFX2_Log(GFX2_ERROR, "_putenv_s(\"LUA_PATH\", \"%s\") failed\n", path);
-#elif defined(WIN32)
-  // Mingw has neither setenv() nor _putenv_s()
-  memmove(path + 9, path, strlen(path) + 1);
-  memcpy(path, "LUA_PATH=", 9);
-  if (putenv(path) < 0)
-    GFX2_Log(GFX2_ERROR, "putenv(\"%s\") failed\n", path);
-#else
-  /* From linux man :
-   * This function makes
-   * copies of the strings pointed to by name and value (by contrast with
-   * putenv(3)).
-   */
-  if (setenv("LUA_PATH", path, 1) < 0)
-    GFX2_Log(GFX2_ERROR, "setenv(\"LUA_PATH\", \"%s\", 1) failed\n", path);
-#endif
-  free(path);
-  
+  LUA_ARG_LIMIT(1,"statusmessage");
+  LUA_ARG_STRING(1, "statusmessage", msg);
+  GFX2_Log(GFX2_DEBUG, "%s\n", msg);
+  return 0;
+}
+
+/// inputbox() answers OK with the initial values, kept in range
+int L_InputBox_batch(lua_State* L)
+{
+  int setting;
+  int nb_settings;
+  int nb_args = lua_gettop (L);
+
+  if (nb_args < 6)
+  {
+    return luaL_error(L, "inputbox: Less than 6 arguments");
+  }
+  if ((nb_args - 1) % 5)
+  {
+    return luaL_error(L, "inputbox: Wrong number of arguments");
+  }
+  nb_settings = (nb_args-1)/5;
+
+  lua_pushboolean(L, 1);
+  for (setting=0; setting<nb_settings; setting++)
+  {
+    double current_value;
+    double min_value;
+    double max_value;
+
+    LUA_ARG_NUMBER(setting*5+3, "inputbox", current_value, -DBL_MAX, DBL_MAX);
+    LUA_ARG_NUMBER(setting*5+4, "inputbox", min_value, -DBL_MAX, DBL_MAX);
+    LUA_ARG_NUMBER(setting*5+5, "inputbox", max_value, -DBL_MAX, DBL_MAX);
+    if (current_value < min_value)
+      current_value = min_value;
+    else if (current_value > max_value)
+      current_value = max_value;
+    lua_pushnumber(L, current_value);
+  }
+  return 1 + nb_settings;
+}
+
+/// wait() and updatescreen() have nothing to do
+int L_Nothing_batch(lua_State* L)
+{
+  (void)L;
+  return 0;
+}
+
+/// waitbreak() is never interrupted
+int L_WaitBreak_batch(lua_State* L)
+{
+  lua_pushinteger(L, 0);
+  return 1;
+}
+
+/// The functions which need a user, their name is the upvalue
+int L_Unavailable_batch(lua_State* L)
+{
+  return luaL_error(L, "%s: Not available in batch mode.", lua_tostring(L, lua_upvalueindex(1)));
+}
+
+/// Replaces the user interface functions for a script run from the command line.
+static void Register_batch_functions(lua_State* L)
+{
+  static const char * const unavailable[] = {
+    "selectbox", "waitinput",
+    "windowopen", "windowclose", "windowdodialog", "windowbutton",
+    "windowrepeatbutton", "windowinput", "windowreadline", "windowprint",
+    "windowslider", "windowmoveslider",
+    NULL
+  };
+  int i;
+
+  lua_register(L,"messagebox",L_MessageBox_batch);
+  lua_register(L,"statusmessage",L_StatusMessage_batch);
+  lua_register(L,"inputbox",L_InputBox_batch);
+  lua_register(L,"wait",L_Nothing_batch);
+  lua_register(L,"updatescreen",L_Nothing_batch);
+  lua_register(L,"waitbreak",L_WaitBreak_batch);
+  for (i = 0; unavailable[i] != NULL; i++)
+  {
+    lua_pushstring(L, unavailable[i]);
+    lua_pushcclosure(L, L_Unavailable_batch, 1);
+    lua_setglobal(L, unavailable[i]);
+  }
+}
+
+/// Results of Execute_script()
+enum SCRIPT_RESULT
+{
+  SCRIPT_OK = 0,
+  SCRIPT_NO_MEMORY,       ///< Out of memory
+  SCRIPT_LOAD_ERROR,      ///< The script couldn't be loaded or compiled
+  SCRIPT_RUN_ERROR,       ///< The script raised an error
+};
+
+///
+/// Registers the Grafx2 functions in a Lua state. It is done again each time
+/// a kept state is reused, in case the last script replaced some of them.
+/// @param batch Non-zero to replace the user interface functions by their
+///              batch mode versions, see Register_batch_functions().
+static void Register_functions(lua_State* L, int batch)
+{
   // Drawing
   lua_register(L,"putbrushpixel",L_PutBrushPixel);
   lua_register(L,"putsparepicturepixel",L_PutSparePicturePixel);
@@ -2447,6 +3333,13 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   lua_register(L,"getsparelayerpixel",L_GetSpareLayerPixel);
   lua_register(L,"getsparepicturepixel",L_GetSparePicturePixel);
 
+  // Reading and writing areas through pixel buffers
+  Register_pixel_buffer(L);
+  lua_register(L,"newpixelbuffer",L_NewPixelBuffer);
+  lua_register(L,"getpicturepixels",L_GetPicturePixels);
+  lua_register(L,"getlayerpixels",L_GetLayerPixels);
+  lua_register(L,"getbackuppixels",L_GetBackupPixels);
+
   // Sizes
   lua_register(L,"setbrushsize",L_SetBrushSize);
   lua_register(L,"setpicturesize",L_SetPictureSize);
@@ -2472,6 +3365,8 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   
   lua_register(L,"matchcolor",L_MatchColor);
   lua_register(L,"matchcolor2",L_MatchColor2);
+  lua_register(L,"matchcolors",L_MatchColors);
+  lua_register(L,"matchcolors2",L_MatchColors2);
 
   // layers
   lua_register(L,"selectlayer",L_SelectLayer);
@@ -2505,7 +3400,55 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   lua_register(L,"windowprint",L_WindowPrint);
   lua_register(L,"windowslider",L_WindowSlider);
   lua_register(L,"windowmoveslider",L_WindowMoveSlider);
-  
+
+  if (batch)
+    Register_batch_functions(L);
+}
+
+///
+/// Creates a Lua state with the standard libraries and the Grafx2 functions.
+/// @return the new state, or NULL if there is not enough memory.
+static lua_State * New_lua_state(int batch)
+{
+  lua_State* L;
+  char * path;
+
+  /// @todo as the value doesn't vary, this should be
+  /// done once at the start of the program
+  path = GFX2_malloc(strlen(Data_directory) + strlen(SCRIPTS_SUBDIRECTORY) + strlen(LUALIB_SUBDIRECTORY) + 5 + 3 * strlen(PATH_SEPARATOR) + 9 + 1);
+  if (path == NULL)
+    return NULL;
+  strcpy(path, Data_directory);
+  Append_path(path, SCRIPTS_SUBDIRECTORY, NULL);
+  Append_path(path, LUALIB_SUBDIRECTORY, NULL);
+  Append_path(path, "?.lua", NULL);
+  // SetEnvironmentVariableA() won't work because lua uses getenv()
+#if defined(_MSC_VER)
+  if (_putenv_s("LUA_PATH", path) < 0)
+    GFX2_Log(GFX2_ERROR, "_putenv_s(\"LUA_PATH\", \"%s\") failed\n", path);
+#elif defined(WIN32)
+  // Mingw has neither setenv() nor _putenv_s()
+  memmove(path + 9, path, strlen(path) + 1);
+  memcpy(path, "LUA_PATH=", 9);
+  if (putenv(path) < 0)
+    GFX2_Log(GFX2_ERROR, "putenv(\"%s\") failed\n", path);
+#else
+  /* From linux man :
+   * This function makes
+   * copies of the strings pointed to by name and value (by contrast with
+   * putenv(3)).
+   */
+  if (setenv("LUA_PATH", path, 1) < 0)
+    GFX2_Log(GFX2_ERROR, "setenv(\"LUA_PATH\", \"%s\", 1) failed\n", path);
+#endif
+  free(path);
+
+  L = luaL_newstate(); // used to be lua_open() on Lua 5.1, deprecated on 5.2
+  if (L == NULL)
+    return NULL;
+
+  Register_functions(L, batch);
+
   // Load all standard libraries
   luaL_openlibs(L);
   
@@ -2520,6 +3463,45 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   //luaopen_debug(L);
   */
 
+  Register_lua_searcher(L);
+  return L;
+}
+
+///
+/// Runs ::Last_run_script in a Lua state with all the bindings: a new one,
+/// or the one kept from the last script of the same directory when
+/// T_Config::Lua_keep_state is set.
+/// This is the part common to Run_script() and Run_script_batch().
+/// @param batch   Non-zero to replace the user interface functions by their
+///                batch mode versions, see Register_batch_functions().
+/// @param message Receives the error message, which must be freed, or NULL.
+static enum SCRIPT_RESULT Execute_script(int batch, char ** message)
+{
+  lua_State* L = NULL;
+  char * path;
+  enum SCRIPT_RESULT result = SCRIPT_OK;
+
+  *message = NULL;
+
+  // This chdir is for the script's sake. Grafx2 itself will (try to)
+  // not rely on what is the system's current directory.
+  path = Extract_path(NULL, Last_run_script);
+  Change_directory(path);
+
+  if (Config.Lua_keep_state)
+    L = Take_kept_lua_state(path);
+  if (L != NULL)
+    Register_functions(L, batch);
+  else
+  {
+    L = New_lua_state(batch);
+    if (L == NULL)
+    {
+      free(path);
+      return SCRIPT_NO_MEMORY;
+    }
+  }
+
   // TODO The script may modify the picture, so we do a backup here.
   // If the script is only touching the brush, this isn't needed...
   // The backup also allows the script to read from it to make something
@@ -2531,6 +3513,7 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   Backup_the_spare(LAYER_ALL);
 
   Palette_has_changed=0;
+  Match_color_data.Is_valid=0;
   Brush_was_altered=0;
   Original_back_color=Back_color;
   Original_fore_color=Fore_color;
@@ -2542,32 +3525,24 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   
   if (Brush_backup == NULL)
   {
-    Verbose_message("Error!", "Out of memory!");
+    result = SCRIPT_NO_MEMORY;
   }
   else 
   {
     memcpy(Brush_backup, Brush, ((long)Brush_height)*Brush_width);
   
-    if (luaL_loadfile(L, Last_run_script) != 0)
-    {
-      int stack_size;
-      stack_size= lua_gettop(L);
-      if (stack_size>0 && (message = lua_tostring(L, stack_size))!=NULL)
-        Verbose_message("Error!", message);
-      else
-        Warning_message("Unknown error loading script!");
-    }
+    if (Load_lua_file(L, Last_run_script) != 0)
+      result = SCRIPT_LOAD_ERROR;
     else if (lua_pcall(L, 0, 0, 0) != 0)
+      result = SCRIPT_RUN_ERROR;
+    if (result != SCRIPT_OK)
     {
       int stack_size;
+      const char * lua_message;
+
       stack_size= lua_gettop(L);
-      
-      Update_colors_during_script();
-      
-      if (stack_size>0 && (message = lua_tostring(L, stack_size))!=NULL)
-        Verbose_message("Error running script", message);
-      else
-        Warning_message("Unknown error running script!");
+      if (stack_size>0 && (lua_message = lua_tostring(L, stack_size))!=NULL)
+        *message = strdup(lua_message);
     }
     // Clean up any remaining dialog windows
     while (Windows_open)
@@ -2582,9 +3557,14 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   Update_colors_during_script();
   if (Is_backed_up)
     End_of_modification();
-	Print_in_menu("                        ",0);
 
-  lua_close(L);
+  // A state is only kept after a successful run: after an error, the
+  // globals and the loaded modules may be in any condition.
+  if (result != SCRIPT_OK || !Config.Lua_keep_state || !Keep_lua_state(path, L))
+  {
+    lua_close(L);
+    free(path);
+  }
   
   if (Brush_was_altered)
   {
@@ -2592,6 +3572,51 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
     memcpy(Brush_original_pixels, Brush, (long)Brush_width*Brush_height);
     Change_paintbrush_shape(PAINTBRUSH_SHAPE_COLOR_BRUSH);
   }
+  return result;
+}
+
+void Run_script(const char *script_subdirectory, const char *script_filename)
+{
+  char * message;
+  byte  old_cursor_shape = Cursor_shape;
+  int original_image_width = Main.image_width;
+  int original_image_height = Main.image_height;
+  int original_current_layer = Main.current_layer;
+
+  // Some scripts are slow
+  Cursor_shape = CURSOR_SHAPE_HOURGLASS;
+  Display_cursor();
+  Flush_update();
+  Cursor_is_visible=1;
+
+  free(Last_run_script);
+  if (script_subdirectory && script_subdirectory[0]!='\0')
+    Last_run_script = Filepath_append_to_dir(script_subdirectory, script_filename);
+  else
+    Last_run_script = strdup(script_filename);
+
+  switch (Execute_script(0, &message))
+  {
+    case SCRIPT_OK:
+      break;
+    case SCRIPT_NO_MEMORY:
+      Verbose_message("Error!", "Out of memory!");
+      break;
+    case SCRIPT_LOAD_ERROR:
+      if (message != NULL)
+        Verbose_message("Error!", message);
+      else
+        Warning_message("Unknown error loading script!");
+      break;
+    case SCRIPT_RUN_ERROR:
+      if (message != NULL)
+        Verbose_message("Error running script", message);
+      else
+        Warning_message("Unknown error running script!");
+      break;
+  }
+  free(message);
+	Print_in_menu("                        ",0);
 
   Hide_cursor();
   Display_all_screen();
@@ -2628,6 +3653,33 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   Display_cursor();
 }
 
+int Run_script_batch(const char * script_filename)
+{
+  char * message;
+  enum SCRIPT_RESULT result;
+
+  free(Last_run_script);
+  Last_run_script = strdup(script_filename);
+
+  result = Execute_script(1, &message);
+  switch (result)
+  {
+    case SCRIPT_OK:
+      break;
+    case SCRIPT_NO_MEMORY:
+      GFX2_Log(GFX2_ERROR, "%s: Out of memory!\n", script_filename);
+      break;
+    case SCRIPT_LOAD_ERROR:
+      GFX2_Log(GFX2_ERROR, "Error loading script: %s\n", message != NULL ? message : script_filename);
+      break;
+    case SCRIPT_RUN_ERROR:
+      GFX2_Log(GFX2_ERROR, "Error running script: %s\n", message != NULL ? message : script_filename);
+      break;
+  }
+  free(message);
+  return result == SCRIPT_OK;
+}
+
 void Run_numbered_script(byte index)
 {
 
@@ -2952,4 +4004,14 @@ const char * Lua_version(void)
   return "Disabled";
 }
 
+int Run_script_batch(const char * script_filename)
+{
+  GFX2_Log(GFX2_ERROR, "%s: Lua scripts are not available in this build of GrafX2.\n", script_filename);
+  return 0;
+}
+
+void Free_script_cache(void)
+{
+}
+
 #endif
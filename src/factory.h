@@ -15,6 +15,17 @@ extern char * Bound_script[10];
 /// After: Cursor shown
 void Run_numbered_script(byte index);
 
+///
+/// Run a lua script without user interface, for the command line batch mode.
+/// The script can't open windows, and its messages go to the console.
+/// @return 1 on success, 0 if the script failed.
+int Run_script_batch(const char * script_filename);
+
+///
+/// Frees the compiled scripts and the Lua states kept between runs.
+/// Called on exit.
+void Free_script_cache(void);
+
 ///
 /// Returns a string stating the included Lua engine version,
 /// or "Disabled" if Grafx2 is compiled without Lua.
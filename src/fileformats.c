@@ -2281,8 +2281,9 @@ void Save_PCX(T_IO_Context * context)
     PCX_header.Plane=1;
     PCX_header.Bytes_per_plane_line=(context->Width&1)?context->Width+1:context->Width;
     PCX_header.Palette_info=1;
-    PCX_header.Screen_X=Screen_width;
-    PCX_header.Screen_Y=Screen_height;
+    // No video mode in the command line conversion: use the picture size
+    PCX_header.Screen_X=Screen_width ? Screen_width : context->Width;
+    PCX_header.Screen_Y=Screen_height ? Screen_height : context->Height;
     memset(PCX_header.Filler,0,54);
 
     if (Write_bytes(file,&(PCX_header.Manufacturer),1) &&
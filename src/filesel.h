@@ -60,6 +60,15 @@ word * Format_filename_unicode(const word * fname, word max_length, int type);
 
 void Free_fileselector_list(T_Fileselector *list);
 
+///
+/// Checks if a file has the requested file extension.
+/// The extension string can end with a ';' (remainder is ignored).
+/// This function allows wildcard '?', and '*' if it's the only character.
+/// @param filename_ext the extension of the file, without the dot
+/// @param filter the extension (or list of extensions) to check
+/// @return 1 if the extension matches
+int Check_extension(const char *filename_ext, const char * filter);
+
 void Sort_list_of_files(T_Fileselector *list);
 
 ///
@@ -0,0 +1,137 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file floodfill.c
+/// Scanline flood fill, used by the Fill tool.
+
+#include <stdlib.h>
+#include "struct.h"
+#include "gfx2mem.h"
+#include "floodfill.h"
+
+/// A span to check: pixels x1 to x2 of line y, next to a filled span of line y - dy.
+typedef struct
+{
+  short x1;
+  short x2;
+  short y;
+  short dy;
+} T_Fill_span;
+
+/// Stack of spans to check
+typedef struct
+{
+  T_Fill_span * spans;
+  long count;
+  long size;
+} T_Fill_stack;
+
+/// Pushes a span, if the line is inside the limits. @return 0 if out of memory.
+static int Push_span(T_Fill_stack * stack, short x1, short x2, short y, short dy, short limit_top, short limit_bottom)
+{
+  if (y < limit_top || y > limit_bottom)
+    return 1;
+  if (stack->count >= stack->size)
+  {
+    long new_size = stack->size ? stack->size * 2 : 256;
+    T_Fill_span * spans = realloc(stack->spans, new_size * sizeof(T_Fill_span));
+    if (spans == NULL)
+      return 0;
+    stack->spans = spans;
+    stack->size = new_size;
+  }
+  stack->spans[stack->count].x1 = x1;
+  stack->spans[stack->count].x2 = x2;
+  stack->spans[stack->count].y = y;
+  stack->spans[stack->count].dy = dy;
+  stack->count++;
+  return 1;
+}
+
+int Span_fill(byte * pixels, long stride,
+              short limit_left, short limit_top, short limit_right, short limit_bottom,
+              short x, short y,
+              short * top_reached, short * bottom_reached,
+              short * left_reached, short * right_reached)
+{
+  T_Fill_stack stack = { NULL, 0, 0 };
+  int ok;
+
+  *top_reached = *bottom_reached = y;
+  *left_reached = *right_reached = x;
+
+  // Start as if a span of 1 pixel was filled on line y+1, and on line y.
+  ok = Push_span(&stack, x, x, y + 1, 1, limit_top, limit_bottom)
+    && Push_span(&stack, x, x, y, -1, limit_top, limit_bottom);
+
+  while (ok && stack.count > 0)
+  {
+    T_Fill_span span = stack.spans[--stack.count];
+    byte * row = pixels + span.y * stride;
+    short x_pos = span.x1;
+
+    while (x_pos <= span.x2)
+    {
+      short start_x, end_x;
+
+      if (row[x_pos] != 1)
+      {
+        x_pos++;
+        continue;
+      }
+      // Look for the whole span of color 1
+      start_x = x_pos;
+      if (start_x == span.x1)
+        while (start_x > limit_left && row[start_x - 1] == 1)
+          start_x--;
+      end_x = x_pos;
+      while (end_x < limit_right && row[end_x + 1] == 1)
+        end_x++;
+
+      for (x_pos = start_x; x_pos <= end_x; x_pos++)
+        row[x_pos] = 2;
+
+      if (start_x < *left_reached)
+        *left_reached = start_x;
+      if (end_x > *right_reached)
+        *right_reached = end_x;
+      if (span.y < *top_reached)
+        *top_reached = span.y;
+      if (span.y > *bottom_reached)
+        *bottom_reached = span.y;
+
+      // Continue in the same direction
+      ok = Push_span(&stack, start_x, end_x, span.y + span.dy, span.dy, limit_top, limit_bottom);
+      // Parts of the span which go beyond the one of the previous line
+      // may lead back in the other direction
+      if (ok && start_x < span.x1)
+        ok = Push_span(&stack, start_x, span.x1 - 1, span.y - span.dy, -span.dy, limit_top, limit_bottom);
+      if (ok && end_x > span.x2)
+        ok = Push_span(&stack, span.x2 + 1, end_x, span.y - span.dy, -span.dy, limit_top, limit_bottom);
+      if (!ok)
+        break;
+      // end_x + 1 is not of color 1
+      x_pos = end_x + 2;
+    }
+  }
+  free(stack.spans);
+  return ok;
+}
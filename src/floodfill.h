@@ -0,0 +1,49 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file floodfill.h
+/// Scanline flood fill, used by the Fill tool.
+
+#ifndef FLOODFILL_H_INCLUDED
+#define FLOODFILL_H_INCLUDED
+
+#include "struct.h"
+
+///
+/// Fills with color 2 the area of color 1 which contains the pixel
+/// (@a x, @a y), with 4-connectivity, inside the limits (included).
+///
+/// The area is filled one horizontal span at a time: each span is
+/// visited once, and the spans to check on the lines above and below are
+/// kept in a stack.
+///
+/// @param pixels   the bitmap, which only contains colors 0, 1 and 2
+/// @param stride   number of bytes per line of the bitmap
+/// @param top_reached, bottom_reached, left_reached, right_reached receive
+///        the bounding box of the filled area
+/// @return 0 if there was not enough memory (then the fill is incomplete)
+int Span_fill(byte * pixels, long stride,
+              short limit_left, short limit_top, short limit_right, short limit_bottom,
+              short x, short y,
+              short * top_reached, short * bottom_reached,
+              short * left_reached, short * right_reached);
+
+#endif
@@ -0,0 +1,125 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2019 Thomas Bernard
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+#if defined(WIN32)
+#include <windows.h>
+#elif defined(USE_PTHREADS)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "gfx2thread.h"
+#include "gfx2log.h"
+
+/// Parameters of a job running in a thread
+typedef struct
+{
+  GFX2_Job_func job;
+  int index;
+  int count;
+  void * data;
+} T_Thread_job;
+
+int GFX2_Thread_count(void)
+{
+  static int count = 0;
+
+  if (count == 0)
+  {
+#if defined(WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    count = (int)info.dwNumberOfProcessors;
+#elif defined(USE_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+    count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (count < 1)
+      count = 1;
+    else if (count > GFX2_MAX_THREADS)
+      count = GFX2_MAX_THREADS;
+    GFX2_Log(GFX2_DEBUG, "GFX2_Thread_count() : %d\n", count);
+  }
+  return count;
+}
+
+#if defined(WIN32)
+static DWORD WINAPI Thread_main(LPVOID param)
+{
+  T_Thread_job * p = (T_Thread_job *)param;
+  p->job(p->index, p->count, p->data);
+  return 0;
+}
+#elif defined(USE_PTHREADS)
+static void * Thread_main(void * param)
+{
+  T_Thread_job * p = (T_Thread_job *)param;
+  p->job(p->index, p->count, p->data);
+  return NULL;
+}
+#endif
+
+void GFX2_Run_parallel(GFX2_Job_func job, int count, void * data)
+{
+  int i;
+#if defined(WIN32) || defined(USE_PTHREADS)
+  T_Thread_job params[GFX2_MAX_THREADS];
+  int started[GFX2_MAX_THREADS];
+#if defined(WIN32)
+  HANDLE threads[GFX2_MAX_THREADS];
+#else
+  pthread_t threads[GFX2_MAX_THREADS];
+#endif
+
+  if (count > GFX2_MAX_THREADS)
+    count = GFX2_MAX_THREADS;
+  for (i = 1; i < count; i++)
+  {
+    params[i].job = job;
+    params[i].index = i;
+    params[i].count = count;
+    params[i].data = data;
+#if defined(WIN32)
+    threads[i] = CreateThread(NULL, 0, Thread_main, &params[i], 0, NULL);
+    started[i] = (threads[i] != NULL);
+#else
+    started[i] = (pthread_create(&threads[i], NULL, Thread_main, &params[i]) == 0);
+#endif
+    if (!started[i])
+      GFX2_Log(GFX2_WARNING, "GFX2_Run_parallel() : failed to start thread %d\n", i);
+  }
+  job(0, count, data);
+  for (i = 1; i < count; i++)
+  {
+    if (started[i])
+    {
+#if defined(WIN32)
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+#else
+      pthread_join(threads[i], NULL);
+#endif
+    }
+    else
+      job(i, count, data);
+  }
+#else
+  for (i = 0; i < count; i++)
+    job(i, count, data);
+#endif
+}
@@ -0,0 +1,44 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2019 Thomas Bernard
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file gfx2thread.h
+/// Minimal support to split a long computation between threads.
+///
+/// Threads are available on Windows, and with pthreads when USE_PTHREADS
+/// is defined. On other platforms, the jobs are run one after the other.
+#ifndef GFX2THREAD_H_DEFINED
+#define GFX2THREAD_H_DEFINED
+
+/// Maximum number of jobs run by GFX2_Run_parallel()
+#define GFX2_MAX_THREADS 16
+
+/// A job : it does the part @a index (0 to @a count-1) of the work.
+typedef void (*GFX2_Job_func)(int index, int count, void * data);
+
+/// Number of threads worth running at the same time (number of processors)
+int GFX2_Thread_count(void);
+
+///
+/// Calls @a job with index 0 to @a count-1, each one in its own thread,
+/// and returns when all are finished. Index 0 runs in the calling thread.
+/// If a thread cannot be started, its job runs in the calling thread.
+void GFX2_Run_parallel(GFX2_Job_func job, int count, void * data);
+
+#endif
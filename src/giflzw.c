@@ -0,0 +1,482 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2018 Thomas Bernard
+    Copyright 2007 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file giflzw.c
+/// LZW decoding and encoding of the image data of GIF files.
+
+#include <stdlib.h>
+#include <string.h>
+#include "struct.h"
+#include "gfx2mem.h"
+#include "gfx2log.h"
+#include "giflzw.h"
+
+/// Codes have at most 12 bits
+#define GIF_LZW_MAX_CODES 4096
+
+/// Reads the codes from the data sub-blocks
+typedef struct
+{
+  FILE * file;
+  byte block[255];    ///< current data sub-block
+  int block_size;     ///< number of bytes in @ref block
+  int block_pos;      ///< next byte to read in @ref block
+  int end_of_data;    ///< the block terminator (or the end of file) was reached
+  dword bit_buffer;   ///< bits not yet used, the next one is bit 0
+  int nb_bits;        ///< number of bits in @ref bit_buffer
+} T_GIF_bit_reader;
+
+/// Writes the decoded pixels one row at a time
+typedef struct
+{
+  byte * row;
+  word width;
+  word height;
+  word x;             ///< number of pixels in @ref row
+  word y;             ///< current row
+  int interlaced;
+  int pass;           ///< current pass in interlaced decoding
+  int stop;           ///< all the rows were given
+  Func_GIF_row row_func;
+  void * data;
+} T_GIF_row_writer;
+
+/// Reads the next data sub-block.
+/// @return 0 when there is no more data
+static int GIF_read_block(T_GIF_bit_reader * reader)
+{
+  int size;
+
+  if (reader->end_of_data)
+    return 0;
+  size = fgetc(reader->file);
+  if (size == EOF)
+  {
+    reader->end_of_data = 1;
+    return 0;
+  }
+  if (size == 0)
+  {
+    GFX2_Log(GFX2_WARNING, "GIF 0 sized data block\n");
+    reader->end_of_data = 1;
+    return 0;
+  }
+  reader->block_size = (int)fread(reader->block, 1, size, reader->file);
+  reader->block_pos = 0;
+  if (reader->block_size < size)
+  {
+    GFX2_Log(GFX2_ERROR, "GIF failed to load data byte\n");
+    reader->end_of_data = 1;
+  }
+  return reader->block_size > 0;
+}
+
+/// Reads the next code.
+/// @return the code, or -1 when there is no more data
+static int GIF_read_code(T_GIF_bit_reader * reader, int nb_bits)
+{
+  int code;
+
+  while (reader->nb_bits < nb_bits)
+  {
+    if (reader->block_pos >= reader->block_size && !GIF_read_block(reader))
+      return -1;
+    reader->bit_buffer |= (dword)reader->block[reader->block_pos++] << reader->nb_bits;
+    reader->nb_bits += 8;
+  }
+  code = (int)(reader->bit_buffer & ((1 << nb_bits) - 1));
+  reader->bit_buffer >>= nb_bits;
+  reader->nb_bits -= nb_bits;
+  return code;
+}
+
+/// Gives the current row and goes to the next one
+static void GIF_next_row(T_GIF_row_writer * writer)
+{
+  writer->row_func(writer->data, writer->y, writer->row, writer->x);
+  writer->x = 0;
+
+  if (!writer->interlaced)
+    writer->y++;
+  else
+  {
+    static const word step[4] = {8, 8, 4, 2};
+    static const word start[4] = {0, 4, 2, 1};
+
+    writer->y += step[writer->pass];
+    while (writer->y >= writer->height && ++writer->pass < 4)
+      writer->y = start[writer->pass];
+  }
+  if (writer->y >= writer->height || writer->pass >= 4)
+    writer->stop = 1;
+}
+
+/// Adds a string to the rows. The string is stored backwards, like it is
+/// built when following the prefixes of a code.
+static void GIF_write_string(T_GIF_row_writer * writer, const byte * stack, int length)
+{
+  while (length > 0 && !writer->stop)
+  {
+    int count = writer->width - writer->x;
+    byte * p = writer->row + writer->x;
+
+    if (count > length)
+      count = length;
+    writer->x += count;
+    while (count-- > 0)
+      *p++ = stack[--length];
+    if (writer->x == writer->width)
+      GIF_next_row(writer);
+  }
+}
+
+int GIF_LZW_decode(FILE * file, byte initial_nb_bits, word width, word height,
+                   int interlaced, Func_GIF_row row_func, void * data)
+{
+  T_GIF_bit_reader reader;
+  T_GIF_row_writer writer;
+  word * prefix;            // Table des préfixes des codes
+  byte * suffix;            // Table des suffixes des codes
+  byte * stack;             // Pile de décodage d'une chaîne
+  int value_clr;            // Valeur <=> Clear tables
+  int value_eof;            // Valeur <=> End d'image
+  int alphabet_free;        // Position libre dans l'alphabet
+  int alphabet_max;         // Nombre d'entrées possibles dans l'alphabet
+  int nb_bits;
+  int old_code = -1;        // Code précédent, -1 after a clear code
+  byte first = 0;           // First pixel of the previous string
+  int code;
+  int result = 2;
+
+  if (initial_nb_bits < 1 || initial_nb_bits > 11)
+  {
+    GFX2_Log(GFX2_INFO, "GIF_LZW_decode() invalid LZW minimum code size %u\n", initial_nb_bits);
+    return 2;
+  }
+  prefix = (word *)GFX2_malloc(GIF_LZW_MAX_CODES * sizeof(word));
+  suffix = (byte *)GFX2_malloc(GIF_LZW_MAX_CODES);
+  stack = (byte *)GFX2_malloc(GIF_LZW_MAX_CODES + 1);
+  writer.row = (byte *)GFX2_malloc(width > 0 ? width : 1);
+  if (prefix == NULL || suffix == NULL || stack == NULL || writer.row == NULL)
+  {
+    free(prefix);
+    free(suffix);
+    free(stack);
+    free(writer.row);
+    return 2;
+  }
+
+  memset(&reader, 0, sizeof(reader));
+  reader.file = file;
+  writer.width = width;
+  writer.height = height;
+  writer.x = 0;
+  writer.y = 0;
+  writer.interlaced = interlaced;
+  writer.pass = 0;
+  writer.stop = (width == 0 || height == 0);
+  writer.row_func = row_func;
+  writer.data = data;
+
+  value_clr = 1 << initial_nb_bits;
+  value_eof = value_clr + 1;
+  alphabet_free = value_clr + 2;
+  nb_bits = initial_nb_bits + 1;
+  alphabet_max = (1 << nb_bits) - 1;
+
+  while ((code = GIF_read_code(&reader, nb_bits)) >= 0)
+  {
+    int current_code;
+    int length = 0;
+
+    if (code == value_eof)
+    {
+      result = 0;
+      break;
+    }
+    if (code == value_clr)
+    {
+      nb_bits = initial_nb_bits + 1;
+      alphabet_max = (1 << nb_bits) - 1;
+      alphabet_free = value_clr + 2;
+      old_code = -1;
+      continue;
+    }
+    if (old_code < 0)
+    {
+      // First code after a clear code : it must be a pixel
+      if (code > value_clr)
+      {
+        GFX2_Log(GFX2_INFO, "GIF_LZW_decode() Invalid code %d just after clear (=%d)!\n", code, value_clr);
+        break;
+      }
+      first = (byte)code;
+      GIF_write_string(&writer, &first, 1);
+      old_code = code;
+      continue;
+    }
+    if (code > alphabet_free)
+    {
+      GFX2_Log(GFX2_INFO, "GIF_LZW_decode() Invalid code %d (should be <=%d)\n", code, alphabet_free);
+      break;
+    }
+
+    current_code = code;
+    if (code == alphabet_free)
+    {
+      // The code being defined : previous string + its first pixel
+      stack[length++] = first;
+      current_code = old_code;
+    }
+    // Each prefix is smaller than its code, so this ends
+    while (current_code > value_clr)
+    {
+      stack[length++] = suffix[current_code];
+      current_code = prefix[current_code];
+    }
+    first = (byte)current_code;
+    stack[length++] = first;
+    GIF_write_string(&writer, stack, length);
+
+    if (alphabet_free < GIF_LZW_MAX_CODES)
+    {
+      prefix[alphabet_free] = (word)old_code;
+      suffix[alphabet_free] = first;
+      alphabet_free++;
+      if (alphabet_free > alphabet_max && nb_bits < 12)
+        alphabet_max = (1 << (++nb_bits)) - 1;
+    }
+    old_code = code;
+  }
+
+  if (result == 0)
+  {
+    // Skip what remains after the End code, up to the block terminator
+    while (!reader.end_of_data)
+    {
+      int size = fgetc(file);
+      if (size == EOF || size == 0 || fseek(file, size, SEEK_CUR) != 0)
+        break;
+    }
+  }
+
+  if (writer.stop)
+    result = 0;
+  else
+  {
+    // A truncated image keeps the pixels which could be decoded
+    if (writer.x > 0)
+      row_func(data, writer.y, writer.row, writer.x);
+    if (result == 0)
+      GFX2_Log(GFX2_INFO, "GIF_LZW_decode() End code before the last pixel\n");
+    result = 2;
+  }
+
+  free(prefix);
+  free(suffix);
+  free(stack);
+  free(writer.row);
+  return result;
+}
+
+/// Size of the hash table of the encoder. It is a power of 2, a bit more
+/// than twice the number of codes, so the strings are found in one or two
+/// probes.
+#define GIF_LZW_HASH_SIZE 8192
+/// Marks an empty slot of the hash table. As a prefix is always lower than
+/// the code of the string, it can't be a real entry.
+#define GIF_LZW_HASH_EMPTY 0xFFFFFFFFu
+
+/// Writes the codes in data sub-blocks
+typedef struct
+{
+  FILE * file;
+  byte block[256];    ///< block[0] is the size of the sub-block
+  dword bit_buffer;   ///< bits not yet written, the first one is bit 0
+  int nb_bits;        ///< number of bits in @ref bit_buffer
+  int error;
+} T_GIF_bit_writer;
+
+/// Writes the current data sub-block
+static void GIF_write_block(T_GIF_bit_writer * writer)
+{
+  if (writer->block[0] == 0)
+    return;
+  if (fwrite(writer->block, 1, (size_t)writer->block[0] + 1, writer->file) != (size_t)writer->block[0] + 1)
+    writer->error = 1;
+  writer->block[0] = 0;
+}
+
+/// Adds a code to the data
+static void GIF_write_code(T_GIF_bit_writer * writer, int code, int nb_bits)
+{
+  writer->bit_buffer |= (dword)code << writer->nb_bits;
+  writer->nb_bits += nb_bits;
+  while (writer->nb_bits >= 8)
+  {
+    writer->block[++writer->block[0]] = (byte)writer->bit_buffer;
+    writer->bit_buffer >>= 8;
+    writer->nb_bits -= 8;
+    if (writer->block[0] == 255)
+      GIF_write_block(writer);
+  }
+}
+
+/// Slot of the string (prefix code, pixel) in the hash table : either the
+/// slot holding it, or the empty slot where it can be added.
+/// Each slot holds the 20 bits of (prefix code, pixel) followed by the 12
+/// bits of the code of the string.
+static unsigned int GIF_hash_slot(const dword * table, dword key)
+{
+  unsigned int slot = (unsigned int)((key * 2654435761u) >> 19) & (GIF_LZW_HASH_SIZE - 1);
+
+  while ((table[slot] >> 12) != key && table[slot] != GIF_LZW_HASH_EMPTY)
+    slot = (slot + 1) & (GIF_LZW_HASH_SIZE - 1);
+  return slot;
+}
+
+int GIF_LZW_encode(FILE * file, byte initial_nb_bits, word width, word height,
+                   Func_GIF_get_row row_func, void * data)
+{
+  T_GIF_bit_writer writer;
+  dword * table;            // hash table of the strings
+  dword * last_found;       // for each code, (pixel << 12) | code of the last string found after it
+  byte * row;
+  int clear = 1 << initial_nb_bits;   // 256 for 8bpp
+  int eof = clear + 1;                // 257 for 8bpp
+  int alphabet_free = clear + 2;      // 258 for 8bpp
+  int nb_bits = initial_nb_bits + 1;  // 9 for 8bpp
+  int alphabet_max = clear + clear - 1; // 511 for 8bpp
+  int current_string = -1;  // Code de la chaîne en cours de traitement
+  word x, y;
+
+  table = (dword *)GFX2_malloc(GIF_LZW_HASH_SIZE * sizeof(dword));
+  last_found = (dword *)GFX2_malloc(4096 * sizeof(dword));
+  row = (byte *)GFX2_malloc(width > 0 ? width : 1);
+  if (table == NULL || last_found == NULL || row == NULL)
+  {
+    free(table);
+    free(last_found);
+    free(row);
+    return 1;
+  }
+  memset(&writer, 0, sizeof(writer));
+  writer.file = file;
+  memset(table, 0xFF, GIF_LZW_HASH_SIZE * sizeof(dword));
+  memset(last_found, 0, 4096 * sizeof(dword));
+
+  GIF_write_code(&writer, clear, nb_bits);
+  for (y = 0; y < height && !writer.error; y++)
+  {
+    row_func(data, y, row, width);
+    for (x = 0; x < width; x++)
+    {
+      byte current_char = row[x];   // Caractère à coder
+      dword key;
+      dword hint;
+      unsigned int slot;
+
+      if (current_string < 0)
+      {
+        current_string = current_char;
+        continue;
+      }
+      // Repeated patterns often give the same string as the last time
+      hint = last_found[current_string];
+      if (hint != 0 && (hint >> 12) == current_char)
+      {
+        current_string = hint & 0xFFF;
+        continue;
+      }
+      // look for (current_string,current_char) in the alphabet
+      key = ((dword)current_string << 8) | current_char;
+      slot = GIF_hash_slot(table, key);
+      if (table[slot] != GIF_LZW_HASH_EMPTY)
+      {
+        last_found[current_string] = ((dword)current_char << 12) | (table[slot] & 0xFFF);
+        current_string = table[slot] & 0xFFF;
+        continue;
+      }
+
+      // (current_string,current_char) was not found in the alphabet
+      // so write current_string to the Gif stream
+      GIF_write_code(&writer, current_string, nb_bits);
+      if (alphabet_free < 4096)
+      {
+        // add (current_string,current_char) to the alphabet
+        table[slot] = (key << 12) | alphabet_free;
+        last_found[current_string] = ((dword)current_char << 12) | alphabet_free;
+        alphabet_free++;
+      }
+      if (alphabet_free >= 4096)
+      {
+        // clear alphabet
+        GIF_write_code(&writer, clear, nb_bits);
+        alphabet_free = clear + 2;
+        nb_bits = initial_nb_bits + 1;
+        alphabet_max = clear + clear - 1;
+        memset(table, 0xFF, GIF_LZW_HASH_SIZE * sizeof(dword));
+        memset(last_found, 0, 4096 * sizeof(dword));
+      }
+      else if (alphabet_free > alphabet_max + 1)
+      {
+        nb_bits++;
+        alphabet_max = (1 << nb_bits) - 1;
+      }
+      // initialize current_string as the string "current_char"
+      current_string = current_char;
+    }
+  }
+
+  if (current_string >= 0)
+  {
+    // Write the last code (before EOF)
+    GIF_write_code(&writer, current_string, nb_bits);
+
+    // we need to update alphabet_free / nb_bits here because
+    // the decoder will update them after each code,
+    // so in very rare cases there might be a problem if we
+    // don't do it.
+    // see http://pulkomandy.tk/projects/GrafX2/ticket/125
+    if (alphabet_free < 4096)
+    {
+      alphabet_free++;
+      if ((alphabet_free > alphabet_max + 1) && (nb_bits < 12))
+      {
+        nb_bits++;
+        alphabet_max = (1 << nb_bits) - 1;
+      }
+    }
+  }
+  GIF_write_code(&writer, eof, nb_bits);
+  // Write last byte (this is an incomplete byte)
+  if (writer.nb_bits > 0)
+    GIF_write_code(&writer, 0, 8 - writer.nb_bits);
+  GIF_write_block(&writer);
+  if (fputc(0, file) == EOF)
+    writer.error = 1;
+
+  free(table);
+  free(last_found);
+  free(row);
+  return writer.error;
+}
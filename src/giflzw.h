@@ -0,0 +1,84 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2018 Thomas Bernard
+    Copyright 2007 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file giflzw.h
+/// LZW decoding and encoding of the image data of GIF files.
+
+#ifndef GIFLZW_H_INCLUDED
+#define GIFLZW_H_INCLUDED
+
+#include <stdio.h>
+#include "struct.h"
+
+///
+/// Receives the pixels of a decoded row.
+/// @param data the pointer given to GIF_LZW_decode()
+/// @param y the row number in the image
+/// @param pixels the decoded pixels
+/// @param width the number of pixels. It is the image width, except for the
+///        last row of a truncated image.
+typedef void (* Func_GIF_row)(void * data, word y, const byte * pixels, word width);
+
+///
+/// Decodes the LZW compressed pixels of a GIF image.
+///
+/// The data sub-blocks are read in a buffer, one whole sub-block at a time,
+/// and the pixels are given one row at a time to @a row_func, in the order
+/// of the file : interlaced images are given pass by pass.
+/// @param file the GIF file, positioned after the LZW minimum code size
+/// @param initial_nb_bits the LZW minimum code size
+/// @param width the image width
+/// @param height the image height
+/// @param interlaced non-zero for an interlaced image
+/// @param row_func the function receiving the decoded rows
+/// @param data passed to @a row_func
+/// @return 0 when all the pixels were decoded, 2 when the data is truncated
+///         or invalid
+int GIF_LZW_decode(FILE * file, byte initial_nb_bits, word width, word height,
+                   int interlaced, Func_GIF_row row_func, void * data);
+
+///
+/// Gives the pixels of a row to encode.
+/// @param data the pointer given to GIF_LZW_encode()
+/// @param y the row number in the image
+/// @param pixels receives the @a width pixels of the row
+/// @param width the image width
+typedef void (* Func_GIF_get_row)(void * data, word y, byte * pixels, word width);
+
+///
+/// Compresses the pixels of a GIF image.
+///
+/// The strings are found in a hash table indexed by (prefix code, pixel),
+/// and the codes are written in data sub-blocks, followed by the block
+/// terminator. The rows are requested from top to bottom.
+/// @param file the GIF file, positioned after the LZW minimum code size
+/// @param initial_nb_bits the LZW minimum code size : the pixels must be
+///        lower than 2^initial_nb_bits
+/// @param width the image width
+/// @param height the image height
+/// @param row_func the function giving the rows
+/// @param data passed to @a row_func
+/// @return 0 on success, 1 on write error
+int GIF_LZW_encode(FILE * file, byte initial_nb_bits, word width, word height,
+                   Func_GIF_get_row row_func, void * data);
+
+#endif
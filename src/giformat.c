@@ -37,6 +37,7 @@
 #include "loadsavefuncs.h"
 #include "gfx2mem.h"
 #include "gfx2log.h"
+#include "giflzw.h"
 
 #ifndef MIN
 #define MIN(a,b) ((a)<(b)?(a):(b))
@@ -126,117 +127,34 @@ void Test_GIF(T_IO_Context * context, FILE * file)
 // -- Lire un fichier au format GIF -----------------------------------------
 
 typedef struct {
-  word nb_bits;        ///< bits for a code
-  word remainder_bits; ///< available bits in @ref last_byte field
-  byte remainder_byte; ///< Remaining bytes in current block
-  word current_code;   ///< current code (generally the one just read)
-  byte last_byte;      ///< buffer byte for reading bits for codes
   word pos_X;          ///< Current coordinates
   word pos_Y;
-  word interlaced;     ///< interlaced flag
-  word pass;           ///< current pass in interlaced decoding
-  word stop;           ///< Stop flag (end of picture)
 } T_GIF_context;
 
 
-/// Reads the next code (GIF.nb_bits bits)
-static word GIF_get_next_code(FILE * GIF_file, T_GIF_context * gif)
-{
-  word nb_bits_to_process = gif->nb_bits;
-  word nb_bits_processed = 0;
-  word current_nb_bits;
-
-  gif->current_code = 0;
-
-  while (nb_bits_to_process)
-  {
-    if (gif->remainder_bits == 0) // Il ne reste plus de bits...
-    {
-      // Lire l'octet suivant:
-
-      // Si on a atteint la fin du bloc de Raster Data
-      if (gif->remainder_byte == 0)
-      {
-        // Lire l'octet nous donnant la taille du bloc de Raster Data suivant
-        if(Read_byte(GIF_file, &gif->remainder_byte)!=1)
-        {
-          File_error=2;
-          return 0;
-        }
-        if (gif->remainder_byte == 0) // still nothing ? That is the end data block
-        {
-          File_error = 2;
-          GFX2_Log(GFX2_WARNING, "GIF 0 sized data block\n");
-          return gif->current_code;
-        }
-      }
-      if(Read_byte(GIF_file,&gif->last_byte)!=1)
-      {
-        File_error = 2;
-        GFX2_Log(GFX2_ERROR, "GIF failed to load data byte\n");
-        return 0;
-      }
-      gif->remainder_byte--;
-      gif->remainder_bits=8;
-    }
-
-    current_nb_bits=(nb_bits_to_process<=gif->remainder_bits)?nb_bits_to_process:gif->remainder_bits;
-
-    gif->current_code |= (gif->last_byte & ((1<<current_nb_bits)-1))<<nb_bits_processed;
-    gif->last_byte >>= current_nb_bits;
-    nb_bits_processed += current_nb_bits;
-    nb_bits_to_process -= current_nb_bits;
-    gif->remainder_bits -= current_nb_bits;
-  }
-
-  return gif->current_code;
-}
+/// Data given to GIF_put_row() and GIF_get_row()
+typedef struct {
+  T_IO_Context * context;
+  T_GIF_IDB * idb;
+  int is_transparent;
+} T_GIF_rows;
 
-/// Put a new pixel
-static void GIF_new_pixel(T_IO_Context * context, T_GIF_context * gif, T_GIF_IDB *idb, int is_transparent, byte color)
+/// Puts a decoded row of pixels
+static void GIF_put_row(void * data, word y, const byte * pixels, word width)
 {
-  if (!is_transparent || color!=context->Transparent_color)
-    Set_pixel(context, idb->Pos_X+gif->pos_X, idb->Pos_Y+gif->pos_Y,color);
-
-  gif->pos_X++;
+  T_GIF_rows * rows = (T_GIF_rows *)data;
+  T_IO_Context * context = rows->context;
+  word x;
 
-  if (gif->pos_X >= idb->Image_width)
+  if (rows->is_transparent && memchr(pixels, context->Transparent_color, width) != NULL)
   {
-    gif->pos_X=0;
-
-    if (!gif->interlaced)
-    {
-      gif->pos_Y++;
-      if (gif->pos_Y >= idb->Image_height)
-        gif->stop = 1;
-    }
-    else
-    {
-      switch (gif->pass)
-      {
-        case 0 :
-        case 1 : gif->pos_Y+=8;
-                 break;
-        case 2 : gif->pos_Y+=4;
-                 break;
-        default: gif->pos_Y+=2;
-      }
-
-      if (gif->pos_Y >= idb->Image_height)
-      {
-        switch(++(gif->pass))
-        {
-        case 1 : gif->pos_Y=4;
-                 break;
-        case 2 : gif->pos_Y=2;
-                 break;
-        case 3 : gif->pos_Y=1;
-                 break;
-        case 4 : gif->stop = 1;
-        }
-      }
-    }
+    // Transparent pixels let the previous frame show through
+    for (x = 0; x < width; x++)
+      if (pixels[x] != context->Transparent_color)
+        Set_pixel(context, rows->idb->Pos_X + x, rows->idb->Pos_Y + y, pixels[x]);
   }
+  else
+    Set_pixel_line(context, rows->idb->Pos_X, rows->idb->Pos_Y + y, width, pixels);
 }
 
 
@@ -247,14 +165,7 @@ void Load_GIF(T_IO_Context * context)
   int image_mode = -1;
   char signature[6];
 
-  word * alphabet_stack;     // Pile de décodage d'une chaîne
-  word * alphabet_prefix;  // Table des préfixes des codes
-  word * alphabet_suffix;  // Table des suffixes des codes
-  word   alphabet_free;     // Position libre dans l'alphabet
-  word   alphabet_max;      // Nombre d'entrées possibles dans l'alphabet
-  word   alphabet_stack_pos; // Position dans la pile de décodage d'un chaîne
-
-  T_GIF_context GIF;
+  T_GIF_rows rows;
   T_GIF_LSDB LSDB;
   T_GIF_IDB IDB;
   T_GIF_GCE GCE;
@@ -264,11 +175,6 @@ void Load_GIF(T_IO_Context * context)
   byte size_to_read; // Nombre de données à lire      (divers)
   byte block_identifier;  // Code indicateur du type de bloc en cours
   byte initial_nb_bits;   // Nb de bits au début du traitement LZW
-  word special_case=0;       // Mémoire pour le cas spécial
-  word old_code=0;       // Code précédent
-  word byte_read;         // Sauvegarde du code en cours de lecture
-  word value_clr;        // Valeur <=> Clear tables
-  word value_eof;        // Valeur <=> End d'image
   long file_size;
   int number_LID; // Nombre d'images trouvées dans le fichier
   int current_layer = 0;
@@ -296,12 +202,6 @@ void Load_GIF(T_IO_Context * context)
          ( (memcmp(signature,"GIF87a",6)==0) ||
            (memcmp(signature,"GIF89a",6)==0) ) )
     {
-
-      // Allocation de mémoire pour les tables & piles de traitement:
-      alphabet_stack  = (word *)GFX2_malloc(4096*sizeof(word));
-      alphabet_prefix = (word *)GFX2_malloc(4096*sizeof(word));
-      alphabet_suffix = (word *)GFX2_malloc(4096*sizeof(word));
-
       if (Read_word_le(GIF_file,&(LSDB.Width))
       && Read_word_le(GIF_file,&(LSDB.Height))
       && Read_byte(GIF_file,&(LSDB.Resol))
@@ -626,100 +526,18 @@ void Load_GIF(T_IO_Context * context)
 
                 File_error=0;
                 if (!Read_byte(GIF_file,&(initial_nb_bits)))
-                  File_error=1;
-
-                value_clr    =(1<<initial_nb_bits)+0;
-                value_eof    =(1<<initial_nb_bits)+1;
-                alphabet_free=(1<<initial_nb_bits)+2;
-
-                GIF.nb_bits  =initial_nb_bits + 1;
-                alphabet_max      =((1 <<  GIF.nb_bits)-1);
-                GIF.interlaced    =(IDB.Indicator & 0x40);
-                GIF.pass         =0;
-
-                /*Init_lecture();*/
-
-
-                GIF.stop = 0;
-
-                //////////////////////////////////////////// DECOMPRESSION LZW //
-
-                GIF.pos_X=0;
-                GIF.pos_Y=0;
-                alphabet_stack_pos=0;
-                GIF.last_byte    =0;
-                GIF.remainder_bits    =0;
-                GIF.remainder_byte    =0;
-
-                while ( (GIF_get_next_code(GIF_file, &GIF)!=value_eof) && (!File_error) )
+                  File_error=2;
+                else
                 {
-                  if (GIF.current_code > alphabet_free)
-                  {
-                    GFX2_Log(GFX2_INFO, "Load_GIF() Invalid code %u (should be <=%u)\n", GIF.current_code, alphabet_free);
-                    File_error=2;
-                    break;
-                  }
-                  else if (GIF.current_code != value_clr)
-                  {
-                    byte_read = GIF.current_code;
-                    if (alphabet_free == GIF.current_code)
-                    {
-                      GIF.current_code=old_code;
-                      alphabet_stack[alphabet_stack_pos++]=special_case;
-                    }
-
-                    while (GIF.current_code > value_clr)
-                    {
-                      if (GIF.current_code >= 4096)
-                      {
-                        GFX2_Log(GFX2_ERROR, "Load_GIF() GIF.current_code = %u >= 4096\n", GIF.current_code);
-                        File_error = 2;
-                        break;
-                      }
-                      alphabet_stack[alphabet_stack_pos++] = alphabet_suffix[GIF.current_code];
-                      GIF.current_code = alphabet_prefix[GIF.current_code];
-                    }
-
-                    special_case = alphabet_stack[alphabet_stack_pos++] = GIF.current_code;
-
-                    do
-                      GIF_new_pixel(context, &GIF, &IDB, is_transparent, alphabet_stack[--alphabet_stack_pos]);
-                    while (alphabet_stack_pos!=0);
-
-                    alphabet_prefix[alphabet_free  ]=old_code;
-                    alphabet_suffix[alphabet_free++]=GIF.current_code;
-                    old_code=byte_read;
-
-                    if (alphabet_free>alphabet_max)
-                    {
-                      if (GIF.nb_bits<12)
-                        alphabet_max      =((1 << (++GIF.nb_bits))-1);
-                    }
-                  }
-                  else // Clear code
-                  {
-                    GIF.nb_bits   = initial_nb_bits + 1;
-                    alphabet_max  = ((1 <<  GIF.nb_bits)-1);
-                    alphabet_free = (1<<initial_nb_bits)+2;
-                    special_case  = GIF_get_next_code(GIF_file, &GIF);
-                    if (GIF.current_code >= value_clr)
-                    {
-                      GFX2_Log(GFX2_INFO, "Load_GIF() Invalid code %u just after clear (=%u)!\n",
-                               GIF.current_code, value_clr);
-                      File_error = 2;
-                      break;
-                    }
-                    old_code      = GIF.current_code;
-                    GIF_new_pixel(context, &GIF, &IDB, is_transparent, GIF.current_code);
-                  }
+                  //////////////////////////////////////////// DECOMPRESSION LZW //
+                  rows.context = context;
+                  rows.idb = &IDB;
+                  rows.is_transparent = is_transparent;
+                  File_error = GIF_LZW_decode(GIF_file, initial_nb_bits,
+                                              IDB.Image_width, IDB.Image_height,
+                                              IDB.Indicator & 0x40, GIF_put_row, &rows);
                 }
 
-                if (File_error == 2 && GIF.pos_X == 0 && GIF.pos_Y == IDB.Image_height)
-                  File_error=0;
-
-                if (File_error >= 0 && !GIF.stop)
-                  File_error=2;
-
                 // No need to read more than one frame in animation preview mode
                 if (context->Type == CONTEXT_PREVIEW && is_looping)
                 {
@@ -751,12 +569,7 @@ void Load_GIF(T_IO_Context * context)
         File_error=1;
 
       early_exit:
-
-      // Libération de la mémoire utilisée par les tables & piles de traitement:
-      free(alphabet_suffix);
-      free(alphabet_prefix);
-      free(alphabet_stack);
-      alphabet_suffix = alphabet_prefix = alphabet_stack = NULL;
+      ;
     } // Le fichier contenait au moins la signature GIF87a ou GIF89a
     else
       File_error=1;
@@ -771,70 +584,12 @@ void Load_GIF(T_IO_Context * context)
 
 // -- Sauver un fichier au format GIF ---------------------------------------
 
-/// Flush the buffer
-static void GIF_empty_buffer(FILE * file, T_GIF_context *gif, byte * GIF_buffer)
-{
-  if (gif->remainder_byte)
-  {
-    GIF_buffer[0] = gif->remainder_byte;
-
-    if (!Write_bytes(file, GIF_buffer, (size_t)gif->remainder_byte + 1))
-      File_error = 1;
-
-    gif->remainder_byte = 0;
-  }
-}
-
-/// Write a code (GIF_nb_bits bits)
-static void GIF_set_code(FILE * GIF_file, T_GIF_context * gif, byte * GIF_buffer, word Code)
-{
-  word nb_bits_to_process = gif->nb_bits;
-  word nb_bits_processed  =0;
-  word current_nb_bits;
-
-  while (nb_bits_to_process)
-  {
-    current_nb_bits = (nb_bits_to_process <= (8-gif->remainder_bits)) ?
-                          nb_bits_to_process: (8-gif->remainder_bits);
-
-    gif->last_byte |= (Code & ((1<<current_nb_bits)-1))<<gif->remainder_bits;
-    Code>>=current_nb_bits;
-    gif->remainder_bits    +=current_nb_bits;
-    nb_bits_processed  +=current_nb_bits;
-    nb_bits_to_process-=current_nb_bits;
-
-    if (gif->remainder_bits==8) // Il ne reste plus de bits à coder sur l'octet courant
-    {
-      // Ecrire l'octet à balancer:
-      GIF_buffer[++(gif->remainder_byte)] = gif->last_byte;
-
-      // Si on a atteint la fin du bloc de Raster Data
-      if (gif->remainder_byte==255)
-        // On doit vider le buffer qui est maintenant plein
-        GIF_empty_buffer(GIF_file, gif, GIF_buffer);
-
-      gif->last_byte=0;
-      gif->remainder_bits=0;
-    }
-  }
-}
-
-
-/// Read the next pixel
-static byte GIF_next_pixel(T_IO_Context *context, T_GIF_context *gif, T_GIF_IDB *idb)
+/// Gives a row of pixels to compress
+static void GIF_get_row(void * data, word y, byte * pixels, word width)
 {
-  byte temp;
+  T_GIF_rows * rows = (T_GIF_rows *)data;
 
-  temp = Get_pixel(context, gif->pos_X, gif->pos_Y);
-
-  if (++gif->pos_X >= (idb->Image_width + idb->Pos_X))
-  {
-    gif->pos_X = idb->Pos_X;
-    if (++gif->pos_Y >= (idb->Image_height + idb->Pos_Y))
-      gif->stop = 1;
-  }
-
-  return temp;
+  Get_pixel_line(rows->context, rows->idb->Pos_X, rows->idb->Pos_Y + y, width, pixels);
 }
 
 
@@ -842,31 +597,16 @@ static byte GIF_next_pixel(T_IO_Context *context, T_GIF_context *gif, T_GIF_IDB
 void Save_GIF(T_IO_Context * context)
 {
   FILE * GIF_file;
-  byte GIF_buffer[256];   // buffer d'écriture de bloc de données compilées
-
-  word * alphabet_prefix;  // Table des préfixes des codes
-  word * alphabet_suffix;  // Table des suffixes des codes
-  word * alphabet_daughter;    // Table des chaînes filles (plus longues)
-  word * alphabet_sister;    // Table des chaînes soeurs (même longueur)
-  word   alphabet_free;     // Position libre dans l'alphabet
-  word   alphabet_max;      // Nombre d'entrées possibles dans l'alphabet
-  word   start;            // Code précédent (sert au linkage des chaînes)
-  int    descend;          // Booléen "On vient de descendre"
 
   T_GIF_context GIF;
+  T_GIF_rows rows;
   T_GIF_LSDB LSDB;
   T_GIF_IDB IDB;
 
 
   byte block_identifier;  // Code indicateur du type de bloc en cours
-  word current_string;   // Code de la chaîne en cours de traitement
-  byte current_char;         // Caractère à coder
-  word index;            // index de recherche de chaîne
   int current_layer;
 
-  word clear;   // LZW clear code
-  word eof;     // End of image code
-
   /////////////////////////////////////////////////// FIN DES DECLARATIONS //
 
   File_error=0;
@@ -878,14 +618,9 @@ void Save_GIF(T_IO_Context * context)
     {
       // La signature du fichier a été correctement écrite.
 
-      // Allocation de mémoire pour les tables
-      alphabet_prefix = (word *)GFX2_malloc(4096*sizeof(word));
-      alphabet_suffix = (word *)GFX2_malloc(4096*sizeof(word));
-      alphabet_daughter = (word *)GFX2_malloc(4096*sizeof(word));
-      alphabet_sister = (word *)GFX2_malloc(4096*sizeof(word));
-
       // On initialise le LSDB du fichier
-      if (Config.Screen_size_in_GIF)
+      // No video mode in the command line conversion: Screen_width is 0
+      if (Config.Screen_size_in_GIF && Screen_width != 0 && Screen_height != 0)
       {
         LSDB.Width=Screen_width;
         LSDB.Height=Screen_height;
@@ -1152,8 +887,6 @@ void Save_GIF(T_IO_Context * context)
               // On va écrire un block indicateur d'IDB et l'IDB du fichier
               block_identifier=0x2C;
               IDB.Indicator=0x07;    // Image non entrelacée, pas de palette locale.
-              clear = 1 << IDB.Nb_bits_pixel; // Clear Code
-              eof = clear + 1;                // End of Picture Code
 
               if ( Write_byte(GIF_file,block_identifier) &&
                    Write_word_le(GIF_file,IDB.Pos_X) &&
@@ -1166,138 +899,13 @@ void Save_GIF(T_IO_Context * context)
                 //   Le block indicateur d'IDB et l'IDB ont étés correctements
                 // écrits.
 
-                GIF.pos_X=IDB.Pos_X;
-                GIF.pos_Y=IDB.Pos_Y;
-                GIF.last_byte=0;
-                GIF.remainder_bits=0;
-                GIF.remainder_byte=0;
-
-#define GIF_INVALID_CODE (65535)
-                index=GIF_INVALID_CODE;
-                File_error=0;
-                GIF.stop=0;
-
-                // Réintialisation de la table:
-                alphabet_free=clear + 2;  // 258 for 8bpp
-                GIF.nb_bits  =IDB.Nb_bits_pixel + 1; // 9 for 8 bpp
-                alphabet_max =clear+clear-1;  // 511 for 8bpp
-                GIF_set_code(GIF_file, &GIF, GIF_buffer, clear);  //256 for 8bpp
-                for (start=0;start<4096;start++)
-                {
-                  alphabet_daughter[start] = GIF_INVALID_CODE;
-                  alphabet_sister[start] = GIF_INVALID_CODE;
-                }
-
                 ////////////////////////////////////////////// COMPRESSION LZW //
-
-                start=current_string=GIF_next_pixel(context, &GIF, &IDB);
-                descend=1;
-
-                while ((!GIF.stop) && (!File_error))
-                {
-                  current_char=GIF_next_pixel(context, &GIF, &IDB);
-
-                  // look for (current_string,current_char) in the alphabet
-                  while ( (index != GIF_INVALID_CODE) &&
-                          ( (current_string!=alphabet_prefix[index]) ||
-                            (current_char      !=alphabet_suffix[index]) ) )
-                  {
-                    descend=0;
-                    start=index;
-                    index=alphabet_sister[index];
-                  }
-
-                  if (index != GIF_INVALID_CODE)
-                  {
-                    // (current_string,current_char) == (alphabet_prefix,alphabet_suffix)[index]
-                    // We have found (current_string,current_char) in the alphabet
-                    // at the index position. So go on and prepare for then next character
-
-                    descend=1;
-                    start=current_string=index;
-                    index=alphabet_daughter[index];
-                  }
-                  else
-                  {
-                    // (current_string,current_char) was not found in the alphabet
-                    // so write current_string to the Gif stream
-                    GIF_set_code(GIF_file, &GIF, GIF_buffer, current_string);
-
-                    if(alphabet_free < 4096) {
-                      // link current_string and the new one
-                      if (descend)
-                        alphabet_daughter[start]=alphabet_free;
-                      else
-                        alphabet_sister[start]=alphabet_free;
-
-                      // add (current_string,current_char) to the alphabet
-                      alphabet_prefix[alphabet_free]=current_string;
-                      alphabet_suffix[alphabet_free]=current_char;
-                      alphabet_free++;
-                    }
-
-                    if (alphabet_free >= 4096)
-                    {
-                      // clear alphabet
-                      GIF_set_code(GIF_file, &GIF, GIF_buffer, clear);    // 256 for 8bpp
-                      alphabet_free=clear+2;  // 258 for 8bpp
-                      GIF.nb_bits  =IDB.Nb_bits_pixel + 1;  // 9 for 8bpp
-                      alphabet_max =clear+clear-1;    // 511 for 8bpp
-                      for (start=0;start<4096;start++)
-                      {
-                        alphabet_daughter[start] = GIF_INVALID_CODE;
-                        alphabet_sister[start] = GIF_INVALID_CODE;
-                      }
-                    }
-                    else if (alphabet_free>alphabet_max+1)
-                    {
-                      // On augmente le nb de bits
-
-                      GIF.nb_bits++;
-                      alphabet_max = (1<<GIF.nb_bits)-1;
-                    }
-
-                    // initialize current_string as the string "current_char"
-                    index=alphabet_daughter[current_char];
-                    start=current_string=current_char;
-                    descend=1;
-                  }
-                }
-
-                if (!File_error)
-                {
-                  // Write the last code (before EOF)
-                  GIF_set_code(GIF_file, &GIF, GIF_buffer, current_string);
-
-                  // we need to update alphabet_free / GIF.nb_bits here because
-                  // the decoder will update them after each code,
-                  // so in very rare cases there might be a problem if we
-                  // don't do it.
-                  // see http://pulkomandy.tk/projects/GrafX2/ticket/125
-                  if(alphabet_free < 4096)
-                  {
-                    alphabet_free++;
-                    if ((alphabet_free > alphabet_max+1) && (GIF.nb_bits < 12))
-                    {
-                      GIF.nb_bits++;
-                      alphabet_max = (1 << GIF.nb_bits) - 1;
-                    }
-                  }
-
-                  GIF_set_code(GIF_file, &GIF, GIF_buffer, eof);  // 257 for 8bpp    // Code de End d'image
-                  if (GIF.remainder_bits!=0)
-                  {
-                    // Write last byte (this is an incomplete byte)
-                    GIF_buffer[++GIF.remainder_byte]=GIF.last_byte;
-                    GIF.last_byte=0;
-                    GIF.remainder_bits=0;
-                  }
-                  GIF_empty_buffer(GIF_file, &GIF, GIF_buffer); // On envoie les dernières données du buffer GIF dans le buffer KM
-
-                  // On écrit un \0
-                  if (! Write_byte(GIF_file,'\x00'))
-                    File_error=1;
-                }
+                rows.context = context;
+                rows.idb = &IDB;
+                if (GIF_LZW_encode(GIF_file, IDB.Nb_bits_pixel,
+                                   IDB.Image_width, IDB.Image_height,
+                                   GIF_get_row, &rows) != 0)
+                  File_error=1;
 
               } // On a pu écrire l'IDB
               else
@@ -1355,12 +963,6 @@ void Save_GIF(T_IO_Context * context)
       else
         File_error=1;
 
-      // Libération de la mémoire utilisée par les tables
-      free(alphabet_sister);
-      free(alphabet_daughter);
-      free(alphabet_suffix);
-      free(alphabet_prefix);
-
     } // On a pu écrire la signature du fichier
     else
       File_error=1;
@@ -440,6 +440,12 @@ GFX2_GLOBAL Func_effect Effect_function;
 /// ::Best_color()
 GFX2_GLOBAL byte Exclude_color[256];
 
+///
+/// Incremented every time ::Main palette or ::Exclude_color may have
+/// changed. The caches of colors searched in the palette are emptied when
+/// it differs from the value they were filled with.
+GFX2_GLOBAL dword Palette_generation;
+
 // -- Smear mode
 
 /// Smear mode is activated
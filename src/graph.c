@@ -52,6 +52,7 @@
 #include "input.h"
 #include "brush.h"
 #include "tiles.h"
+#include "floodfill.h"
 #if defined(USE_SDL) || defined(USE_SDL2)
 #include "sdlscreen.h"
 #endif
@@ -417,7 +418,6 @@ try_again:
     {
         default:
         case PIXEL_SIMPLE:
-#define Display_line_on_screen_fast_simple Display_line_on_screen_simple
 #define SETPIXEL(x) \
             Pixel = Pixel_##x ; \
             Read_pixel= Read_pixel_##x ; \
@@ -442,7 +442,6 @@ try_again:
 			SETPIXEL(simple)
         break;
         case PIXEL_TALL:
-#define Display_line_on_screen_fast_tall Display_line_on_screen_tall
 			SETPIXEL(tall)
         break;
         case PIXEL_WIDE:
@@ -772,182 +771,12 @@ void Fill(short * top_reached  , short * bottom_reached,
 //   Cette fonction ne doit pas être directement appelée.
 //
 {
-  short x_pos;   // Abscisse de balayage du segment, utilisée lors de l'"affichage"
-  short line;   // Ordonnée de la ligne en cours de traitement
-  short start_x; // Abscisse de départ du segment traité
-  short end_x;   // Abscisse de fin du segment traité
-  int   changes_made;    // Booléen "On a fait une modif dans le dernier passage"
-  int   can_propagate; // Booléen "On peut propager la couleur dans le segment"
-  short current_limit_bottom;  // Intervalle vertical restreint
-  short current_limit_top;
-  int   line_is_modified;       // Booléen "On a fait une modif dans la ligne"
-
-  changes_made=1;
-  current_limit_top=Paintbrush_Y;
-  current_limit_bottom =Min(Paintbrush_Y+1,Limit_bottom);
-  *left_reached=Paintbrush_X;
-  *right_reached=Paintbrush_X+1;
-  Pixel_in_current_layer(Paintbrush_X,Paintbrush_Y,2);
-
-  while (changes_made)
-  {
-    changes_made=0;
-
-    for (line=current_limit_top;line<=current_limit_bottom;line++)
-    {
-      line_is_modified=0;
-      // On va traiter le cas de la ligne n° line.
-
-      // On commence le traitement à la gauche de l'écran
-      start_x=Limit_left;
-
-      // Pour chaque segment de couleur 1 que peut contenir la ligne
-      while (start_x<=Limit_right)
-      {
-        // On cherche son début
-        while((start_x<=Limit_right) &&
-                (Read_pixel_from_current_layer(start_x,line)!=1))
-             start_x++;
-
-        if (start_x<=Limit_right)
-        {
-          // Un segment de couleur 1 existe et commence à la position start_x.
-          // On va donc en chercher la fin.
-          for (end_x=start_x+1;(end_x<=Limit_right) &&
-               (Read_pixel_from_current_layer(end_x,line)==1);end_x++);
-
-          //   On sait qu'il existe un segment de couleur 1 qui commence en
-          // start_x et qui se termine en end_x-1.
-
-          //   On va maintenant regarder si une couleur sur la périphérie
-          // permet de colorier ce segment avec la couleur 2.
-
-          can_propagate=(
-            // Test de la présence d'un point à gauche du segment
-            ((start_x>Limit_left) &&
-             (Read_pixel_from_current_layer(start_x-1,line)==2)) ||
-            // Test de la présence d'un point à droite du segment
-            ((end_x-1<Limit_right) &&
-             (Read_pixel_from_current_layer(end_x    ,line)==2))
-                               );
-
-          // Test de la présence d'un point en haut du segment
-          if (!can_propagate && (line>Limit_top))
-            for (x_pos=start_x;x_pos<end_x;x_pos++)
-              if (Read_pixel_from_current_layer(x_pos,line-1)==2)
-              {
-                can_propagate=1;
-                break;
-              }
-
-          if (can_propagate)
-          {
-            if (start_x<*left_reached)
-              *left_reached=start_x;
-            if (end_x>*right_reached)
-              *right_reached=end_x;
-            // On remplit le segment de start_x à end_x-1.
-            for (x_pos=start_x;x_pos<end_x;x_pos++)
-              Pixel_in_current_layer(x_pos,line,2);
-            // On vient d'effectuer des modifications.
-            changes_made=1;
-            line_is_modified=1;
-          }
-
-          start_x=end_x+1;
-        }
-      }
-
-      // Si on est en bas, et qu'on peut se propager vers le bas...
-      if ( (line==current_limit_bottom) &&
-           (line_is_modified) &&
-           (current_limit_bottom<Limit_bottom) )
-        current_limit_bottom++; // On descend cette limite vers le bas
-    }
-
-    // Pour le prochain balayage vers le haut, on va se permettre d'aller
-    // voir une ligne plus haut.
-    // Si on ne le fait pas, et que la première ligne (current_limit_top)
-    // n'était pas modifiée, alors cette limite ne serait pas remontée, donc
-    // le filler ne progresserait pas vers le haut.
-    if (current_limit_top>Limit_top)
-      current_limit_top--;
-
-    for (line=current_limit_bottom;line>=current_limit_top;line--)
-    {
-      line_is_modified=0;
-      // On va traiter le cas de la ligne n° line.
-
-      // On commence le traitement à la gauche de l'écran
-      start_x=Limit_left;
-
-      // Pour chaque segment de couleur 1 que peut contenir la ligne
-      while (start_x<=Limit_right)
-      {
-        // On cherche son début
-        for (;(start_x<=Limit_right) &&
-             (Read_pixel_from_current_layer(start_x,line)!=1);start_x++);
-
-        if (start_x<=Limit_right)
-        {
-          // Un segment de couleur 1 existe et commence à la position start_x.
-          // On va donc en chercher la fin.
-          for (end_x=start_x+1;(end_x<=Limit_right) &&
-               (Read_pixel_from_current_layer(end_x,line)==1);end_x++);
-
-          //   On sait qu'il existe un segment de couleur 1 qui commence en
-          // start_x et qui se termine en end_x-1.
-
-          //   On va maintenant regarder si une couleur sur la périphérie
-          // permet de colorier ce segment avec la couleur 2.
-
-          can_propagate=(
-            // Test de la présence d'un point à gauche du segment
-            ((start_x>Limit_left) &&
-             (Read_pixel_from_current_layer(start_x-1,line)==2)) ||
-            // Test de la présence d'un point à droite du segment
-            ((end_x-1<Limit_right) &&
-             (Read_pixel_from_current_layer(end_x    ,line)==2))
-                               );
-
-          // Test de la présence d'un point en bas du segment
-          if (!can_propagate && (line<Limit_bottom))
-            for (x_pos=start_x;x_pos<end_x;x_pos++)
-              if (Read_pixel_from_current_layer(x_pos,line+1)==2)
-              {
-                can_propagate=1;
-                break;
-              }
-
-          if (can_propagate)
-          {
-            if (start_x<*left_reached)
-              *left_reached=start_x;
-            if (end_x>*right_reached)
-              *right_reached=end_x;
-            // On remplit le segment de start_x à end_x-1.
-            for (x_pos=start_x;x_pos<end_x;x_pos++)
-              Pixel_in_current_layer(x_pos,line,2);
-            // On vient d'effectuer des modifications.
-            changes_made=1;
-            line_is_modified=1;
-          }
-
-          start_x=end_x+1;
-        }
-      }
-
-      // Si on est en haut, et qu'on peut se propager vers le haut...
-      if ( (line==current_limit_top) &&
-           (line_is_modified) &&
-           (current_limit_top>Limit_top) )
-        current_limit_top--; // On monte cette limite vers le haut
-    }
-  }
-
-  *top_reached=current_limit_top;
-  *bottom_reached =current_limit_bottom;
-  (*right_reached)--;
+  // The fill is done span by span, directly in the pixels of the layer.
+  if (!Span_fill(Main.backups->Pages->Image[Main.current_layer].Pixels, Main.image_width,
+                 Limit_left, Limit_top, Limit_right, Limit_bottom,
+                 Paintbrush_X, Paintbrush_Y,
+                 top_reached, bottom_reached, left_reached, right_reached))
+    Error(0); // Not enough memory : the fill is incomplete
 } // end de la routine de remplissage "Fill"
 
 byte Read_pixel_from_backup_layer(word x,word y)
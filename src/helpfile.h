@@ -1934,6 +1934,10 @@ static const T_Help_table helptable_effects[] =
   HELP_TEXT ("* Show count : Briefly displays the number")
   HELP_TEXT ("of unique tiles after each analysis.")
   HELP_TEXT ("")
+  HELP_TEXT ("* Live stats : Shows the number of unique")
+  HELP_TEXT ("tiles in the status bar (T:), updated after")
+  HELP_TEXT ("each stroke.")
+  HELP_TEXT ("")
   HELP_TEXT ("")
 //HELP_TEXT ("0----5----0----5----0X---5----0----5----0--X")
   HELP_TITLE("8 BIT")
@@ -2718,6 +2722,12 @@ static const T_Help_table helptable_settings_details[] =
   HELP_TEXT ("design shortcuts that trigger several")
   HELP_TEXT ("actions at once.")
   HELP_TEXT ("")
+  HELP_BOLD ("  Undo memory (MB)")
+  HELP_TEXT ("Memory used by the Undo pages before the")
+  HELP_TEXT ("oldest ones are moved to a swap file in")
+  HELP_TEXT ("the configuration directory. 0 means no")
+  HELP_TEXT ("limit.")
+  HELP_TEXT ("")
 };
 
 static const T_Help_table helptable_clear[] =
@@ -1846,6 +1846,7 @@ int Load_CFG(int reload_all)
         {
           if (!Read_bytes(Handle, Exclude_color, 256))
             goto Erreur_lecture_config;
+          Palette_generation++;
         }
         else
         {
@@ -1604,6 +1604,11 @@ int Get_input(int sleep_time)
                   GFX2_Log(GFX2_DEBUG, "SDL_WINDOWEVENT_RESTORED %d\n", event.window.windowID);
                   Window_state = GFX2_WINDOW_STANDARD;
                   break;
+                case SDL_WINDOWEVENT_EXPOSED:
+                  // The screen is only presented when something changed :
+                  // force it.
+                  Update_rect(0, 0, 0, 0);
+                  break;
                 default:
                   GFX2_Log(GFX2_DEBUG, "Unhandled SDL_WINDOWEVENT : %d\n", event.window.event);
               }
@@ -1883,10 +1888,10 @@ int Get_input(int sleep_time)
     {
       Compute_paintbrush_coordinates();
       Display_cursor();
-#if defined(USE_SDL2) && defined(USE_JOYSTICK)
-      // To achieve mouse smooth movement using a joystick, we update the screen now and return
-      // this is because for mouse coordinate the joystick use floats internally and Mouse_moved become always
-      // true and stop updating the screen until the axis are released.
+#if defined(USE_SDL2)
+      // Show the screen now if a refresh of the display has passed.
+      // Otherwise a continuous drag (or joystick move, for which
+      // Mouse_moved is always true) would never reach the idle case below.
       GFX2_UpdateScreen();
 #endif
       return 1;
@@ -1896,6 +1901,12 @@ int Get_input(int sleep_time)
 
 #if defined(USE_SDL2)
     GFX2_UpdateScreen();
+    {
+      // Don't sleep past the next refresh when updates are waiting for it
+      int frame_delay = GFX2_Frame_delay();
+      if (frame_delay >= 0 && frame_delay < sleep_time)
+        sleep_time = frame_delay;
+    }
 #endif
     // Nothing significant happened
     if (sleep_time)
@@ -581,6 +581,27 @@ unsigned long File_length(const char * fname)
 #endif
 }
 
+// Last modification time
+time_t File_modification_time(const char * fname)
+{
+#if defined(WIN32)
+  WIN32_FILE_ATTRIBUTE_DATA infos;
+  if (GetFileAttributesExA(fname, GetFileExInfoStandard, &infos))
+  {
+    // FILETIME counts 100ns intervals since 1601-01-01
+    DWORD64 t = ((DWORD64)infos.ftLastWriteTime.dwHighDateTime << 32) + (DWORD64)infos.ftLastWriteTime.dwLowDateTime;
+    return (time_t)(t / 10000000 - 11644473600LL);
+  }
+  else
+    return 0;
+#else
+  struct stat infos_fichier;
+  if (stat(fname,&infos_fichier))
+    return 0;
+  return infos_fichier.st_mtime;
+#endif
+}
+
 unsigned long File_length_file(FILE * file)
 {
 #if defined(WIN32)
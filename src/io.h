@@ -40,6 +40,7 @@
 #define IO_H__
 
 #include <stdio.h>
+#include <time.h>
 
 
 /** @defgroup io File input/output
@@ -130,6 +131,9 @@ int Position_last_dot_unicode(const word * fname);
 /// Size of a file, in bytes. Returns 0 in case of error.
 unsigned long File_length(const char *fname);
 
+/// Time of the last modification of a file. Returns 0 in case of error.
+time_t File_modification_time(const char *fname);
+
 /// Returns true if a file passed as a parameter exists in the current directory.
 int File_exists(const char * fname);
 
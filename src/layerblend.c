@@ -0,0 +1,247 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file layerblend.c
+/// Line kernels used to flatten layers with a transparent color.
+
+#include <stddef.h>
+#include "struct.h"
+#include "gfx2log.h"
+#include "layerblend.h"
+
+// SSE2 is part of the x86-64 instruction set, and can be enabled with
+// -msse2 on 32bits x86. It is checked at compile time.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LAYERBLEND_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled with a function attribute, and checked at run time.
+#if defined(LAYERBLEND_SSE2) && (defined(__x86_64__) || defined(__i386__)) \
+ && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define LAYERBLEND_AVX2
+#include <immintrin.h>
+#endif
+
+static void Blend_layer_line_select(byte * visible, byte * depth, const byte * pixels, int width, byte transparent_color, byte layer);
+static void Depth_layer_line_select(byte * depth, const byte * pixels, int width, byte transparent_color, byte layer);
+
+void (*Blend_layer_line)(byte * visible, byte * depth, const byte * pixels, int width, byte transparent_color, byte layer) = Blend_layer_line_select;
+void (*Depth_layer_line)(byte * depth, const byte * pixels, int width, byte transparent_color, byte layer) = Depth_layer_line_select;
+
+// -- Plain C --
+
+static void Blend_layer_line_scalar(byte * visible, byte * depth, const byte * pixels, int width, byte transparent_color, byte layer)
+{
+  int i;
+
+  if (depth == NULL)
+  {
+    for (i = 0; i < width; i++)
+    {
+      if (pixels[i] != transparent_color)
+        visible[i] = pixels[i];
+    }
+  }
+  else
+  {
+    for (i = 0; i < width; i++)
+    {
+      if (pixels[i] != transparent_color)
+      {
+        visible[i] = pixels[i];
+        depth[i] = layer;
+      }
+    }
+  }
+}
+
+static void Depth_layer_line_scalar(byte * depth, const byte * pixels, int width, byte transparent_color, byte layer)
+{
+  int i;
+
+  for (i = 0; i < width; i++)
+  {
+    if (pixels[i] != transparent_color)
+      depth[i] = layer;
+  }
+}
+
+// -- SSE2 : 16 pixels at a time --
+
+#ifdef LAYERBLEND_SSE2
+static void Blend_layer_line_sse2(byte * visible, byte * depth, const byte * pixels, int width, byte transparent_color, byte layer)
+{
+  const __m128i transparent = _mm_set1_epi8((char)transparent_color);
+  const __m128i layer_value = _mm_set1_epi8((char)layer);
+  int i = 0;
+
+  for (; i + 16 <= width; i += 16)
+  {
+    __m128i color = _mm_loadu_si128((const __m128i *)(pixels + i));
+    // 0xFF where the pixel of the layer is transparent
+    __m128i mask = _mm_cmpeq_epi8(color, transparent);
+    __m128i old = _mm_loadu_si128((const __m128i *)(visible + i));
+
+    _mm_storeu_si128((__m128i *)(visible + i),
+      _mm_or_si128(_mm_and_si128(mask, old), _mm_andnot_si128(mask, color)));
+    if (depth != NULL)
+    {
+      old = _mm_loadu_si128((const __m128i *)(depth + i));
+      _mm_storeu_si128((__m128i *)(depth + i),
+        _mm_or_si128(_mm_and_si128(mask, old), _mm_andnot_si128(mask, layer_value)));
+    }
+  }
+  Blend_layer_line_scalar(visible + i, depth != NULL ? depth + i : NULL, pixels + i, width - i, transparent_color, layer);
+}
+
+static void Depth_layer_line_sse2(byte * depth, const byte * pixels, int width, byte transparent_color, byte layer)
+{
+  const __m128i transparent = _mm_set1_epi8((char)transparent_color);
+  const __m128i layer_value = _mm_set1_epi8((char)layer);
+  int i = 0;
+
+  for (; i + 16 <= width; i += 16)
+  {
+    __m128i mask = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(pixels + i)), transparent);
+    __m128i old = _mm_loadu_si128((const __m128i *)(depth + i));
+
+    _mm_storeu_si128((__m128i *)(depth + i),
+      _mm_or_si128(_mm_and_si128(mask, old), _mm_andnot_si128(mask, layer_value)));
+  }
+  Depth_layer_line_scalar(depth + i, pixels + i, width - i, transparent_color, layer);
+}
+#endif
+
+// -- AVX2 : 32 pixels at a time --
+
+#ifdef LAYERBLEND_AVX2
+__attribute__((target("avx2")))
+static void Blend_layer_line_avx2(byte * visible, byte * depth, const byte * pixels, int width, byte transparent_color, byte layer)
+{
+  const __m256i transparent = _mm256_set1_epi8((char)transparent_color);
+  const __m256i layer_value = _mm256_set1_epi8((char)layer);
+  int i = 0;
+
+  for (; i + 32 <= width; i += 32)
+  {
+    __m256i color = _mm256_loadu_si256((const __m256i *)(pixels + i));
+    __m256i mask = _mm256_cmpeq_epi8(color, transparent);
+
+    _mm256_storeu_si256((__m256i *)(visible + i),
+      _mm256_blendv_epi8(color, _mm256_loadu_si256((const __m256i *)(visible + i)), mask));
+    if (depth != NULL)
+      _mm256_storeu_si256((__m256i *)(depth + i),
+        _mm256_blendv_epi8(layer_value, _mm256_loadu_si256((const __m256i *)(depth + i)), mask));
+  }
+  Blend_layer_line_sse2(visible + i, depth != NULL ? depth + i : NULL, pixels + i, width - i, transparent_color, layer);
+}
+
+__attribute__((target("avx2")))
+static void Depth_layer_line_avx2(byte * depth, const byte * pixels, int width, byte transparent_color, byte layer)
+{
+  const __m256i transparent = _mm256_set1_epi8((char)transparent_color);
+  const __m256i layer_value = _mm256_set1_epi8((char)layer);
+  int i = 0;
+
+  for (; i + 32 <= width; i += 32)
+  {
+    __m256i mask = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(pixels + i)), transparent);
+
+    _mm256_storeu_si256((__m256i *)(depth + i),
+      _mm256_blendv_epi8(layer_value, _mm256_loadu_si256((const __m256i *)(depth + i)), mask));
+  }
+  Depth_layer_line_sse2(depth + i, pixels + i, width - i, transparent_color, layer);
+}
+#endif
+
+// -- Selection --
+
+int Select_layer_blend_kernel(enum LAYER_BLEND_KERNEL kernel)
+{
+  switch (kernel)
+  {
+    case LAYER_BLEND_SCALAR:
+      Blend_layer_line = Blend_layer_line_scalar;
+      Depth_layer_line = Depth_layer_line_scalar;
+      return 1;
+#ifdef LAYERBLEND_SSE2
+    case LAYER_BLEND_SSE2:
+      Blend_layer_line = Blend_layer_line_sse2;
+      Depth_layer_line = Depth_layer_line_sse2;
+      return 1;
+#endif
+#ifdef LAYERBLEND_AVX2
+    case LAYER_BLEND_AVX2:
+      __builtin_cpu_init();
+      if (!__builtin_cpu_supports("avx2"))
+        return 0;
+      Blend_layer_line = Blend_layer_line_avx2;
+      Depth_layer_line = Depth_layer_line_avx2;
+      return 1;
+#endif
+    default:
+      return 0;
+  }
+}
+
+void Select_best_layer_blend_kernel(void)
+{
+  int kernel;
+
+  for (kernel = LAYER_BLEND_KERNEL_COUNT - 1; kernel > LAYER_BLEND_SCALAR; kernel--)
+  {
+    if (Select_layer_blend_kernel((enum LAYER_BLEND_KERNEL)kernel))
+      break;
+  }
+  if (kernel == LAYER_BLEND_SCALAR)
+    Select_layer_blend_kernel(LAYER_BLEND_SCALAR);
+  GFX2_Log(GFX2_DEBUG, "Layer blending kernel : %s\n", Layer_blend_kernel_name((enum LAYER_BLEND_KERNEL)kernel));
+}
+
+const char * Layer_blend_kernel_name(enum LAYER_BLEND_KERNEL kernel)
+{
+  switch (kernel)
+  {
+    case LAYER_BLEND_SCALAR:
+      return "scalar";
+    case LAYER_BLEND_SSE2:
+      return "SSE2";
+    case LAYER_BLEND_AVX2:
+      return "AVX2";
+    default:
+      return "?";
+  }
+}
+
+/// Initial value of ::Blend_layer_line : selects the kernel on first use.
+static void Blend_layer_line_select(byte * visible, byte * depth, const byte * pixels, int width, byte transparent_color, byte layer)
+{
+  Select_best_layer_blend_kernel();
+  Blend_layer_line(visible, depth, pixels, width, transparent_color, layer);
+}
+
+/// Initial value of ::Depth_layer_line : selects the kernel on first use.
+static void Depth_layer_line_select(byte * depth, const byte * pixels, int width, byte transparent_color, byte layer)
+{
+  Select_best_layer_blend_kernel();
+  Depth_layer_line(depth, pixels, width, transparent_color, layer);
+}
@@ -0,0 +1,66 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file layerblend.h
+/// Line kernels used to flatten layers with a transparent color.
+///
+/// Each kernel exists in a plain C version, and in SSE2 / AVX2 versions
+/// on x86 CPUs. The fastest version supported by the CPU is selected
+/// the first time a kernel is called.
+
+#ifndef LAYERBLEND_H_INCLUDED
+#define LAYERBLEND_H_INCLUDED
+
+#include "struct.h"
+
+/// Implementations of the layer blending kernels
+enum LAYER_BLEND_KERNEL
+{
+  LAYER_BLEND_SCALAR = 0, ///< Plain C, one pixel at a time
+  LAYER_BLEND_SSE2,       ///< 16 pixels at a time
+  LAYER_BLEND_AVX2,       ///< 32 pixels at a time
+  LAYER_BLEND_KERNEL_COUNT
+};
+
+///
+/// Copies the pixels of a layer line which are not @a transparent_color
+/// over the visible image line.
+/// If @a depth is not NULL, @a layer is written in the depth buffer for
+/// these pixels.
+extern void (*Blend_layer_line)(byte * visible, byte * depth, const byte * pixels, int width, byte transparent_color, byte layer);
+
+///
+/// Writes @a layer in the depth buffer line for each pixel of the layer
+/// line which is not @a transparent_color.
+extern void (*Depth_layer_line)(byte * depth, const byte * pixels, int width, byte transparent_color, byte layer);
+
+///
+/// Selects an implementation for ::Blend_layer_line and ::Depth_layer_line.
+/// @return 1 on success, 0 if it is not supported by the CPU or the build.
+int Select_layer_blend_kernel(enum LAYER_BLEND_KERNEL kernel);
+
+/// Selects the fastest supported implementation.
+void Select_best_layer_blend_kernel(void);
+
+/// Name of an implementation, for logs and benchmarks.
+const char * Layer_blend_kernel_name(enum LAYER_BLEND_KERNEL kernel);
+
+#endif
@@ -230,6 +230,9 @@ void Set_pixel(T_IO_Context *context, short x_pos, short y_pos, byte color)
 
     // Load pixels into a Surface
     case CONTEXT_SURFACE:
+      if (context->Flatten_layers && context->Current_layer > 0
+        && (context->Image_mode == IMAGE_MODE_ANIMATION || color == context->Transparent_color))
+        break;
       if (x_pos>=0 && y_pos>=0 && x_pos<context->Surface->w && y_pos<context->Surface->h)
         Set_GFX2_Surface_pixel(context->Surface, x_pos, y_pos, color);
       break;
@@ -241,6 +244,39 @@ void Set_pixel(T_IO_Context *context, short x_pos, short y_pos, byte color)
 
 }
 
+/// Set the color of consecutive pixels of a row (on load).
+/// Same as Set_pixel() for each pixel, but the brush and the surfaces
+/// receive the whole row at once.
+void Set_pixel_line(T_IO_Context *context, short x_pos, short y_pos, short width, const byte * pixels)
+{
+  short x;
+
+  // Clipping
+  if (x_pos < 0 || y_pos < 0 || (x_pos>=context->Width) || (y_pos>=context->Height))
+    return;
+  if (width > context->Width - x_pos)
+    width = context->Width - x_pos;
+
+  switch (context->Type)
+  {
+    case CONTEXT_BRUSH:
+      memcpy(context->Buffer_image + y_pos * context->Pitch + x_pos, pixels, width);
+      break;
+
+    case CONTEXT_SURFACE:
+      if ((context->Current_layer == 0 || !context->Flatten_layers)
+        && y_pos < context->Surface->h && x_pos + width <= context->Surface->w)
+      {
+        memcpy(context->Surface->pixels + y_pos * context->Surface->w + x_pos, pixels, width);
+        break;
+      }
+      // fall through
+    default:
+      for (x = 0; x < width; x++)
+        Set_pixel(context, x_pos + x, y_pos, pixels[x]);
+  }
+}
+
 void Fill_canvas(T_IO_Context *context, byte color)
 {
   switch (context->Type)
@@ -352,6 +388,7 @@ int Get_frame_duration(T_IO_Context *context)
 
 void Set_image_mode(T_IO_Context *context, enum IMAGE_MODES mode)
 {
+  context->Image_mode = mode;
   if (context->Type == CONTEXT_MAIN_IMAGE)
   {
     Main.backups->Pages->Image_mode = mode;
@@ -577,10 +614,124 @@ void Pre_load(T_IO_Context *context, short width, short height, long file_size,
 
 /////////////////////////////////////////////////////////////////////////////
 
+/// Magic bytes found at a fixed position in the files of a format.
+typedef struct
+{
+  enum FILE_FORMATS Identifier; ///< Format which Test function is tried
+  byte Offset;                  ///< Position of the magic bytes in the file
+  byte Length;                  ///< Number of magic bytes
+  const char * Magic;
+} T_Format_signature;
+
+/// Number of bytes read at the start of the file to look for signatures
+#define SIGNATURE_HEADER_SIZE 16
+
+/// Signatures of the formats which have one.
+///
+/// They only select which Test function is called first. The Test function
+/// always has the final word, so a format can be listed even if its
+/// signature is short.
+static const T_Format_signature Format_signatures[] = {
+  {FORMAT_GIF,  0, 4, "GIF8"},
+#ifndef __no_pnglib__
+  {FORMAT_PNG,  0, 8, "\x89PNG\r\n\x1a\n"},
+#endif
+  {FORMAT_BMP,  0, 2, "BM"},
+  {FORMAT_LBM,  0, 4, "FORM"},
+  {FORMAT_PBM,  0, 4, "FORM"},
+  {FORMAT_ACBM, 0, 4, "FORM"},
+  {FORMAT_PKM,  0, 4, "PKM\0"},
+  {FORMAT_PAL,  0, 8, "JASC-PAL"},
+  {FORMAT_PAL,  0, 4, "RIFF"},
+  {FORMAT_GPL,  0,12, "GIMP Palette"},
+  {FORMAT_ICO,  0, 4, "\0\0\1\0"},
+  {FORMAT_ICO,  0, 4, "\0\0\2\0"},
+  {FORMAT_INFO, 0, 4, "\xe3\x10\0\1"},
+  {FORMAT_FLI,  4, 2, "\x11\xaf"},
+  {FORMAT_FLI,  4, 2, "\x12\xaf"},
+#ifndef __no_tifflib__
+  {FORMAT_TIFF, 0, 4, "II*\0"},
+  {FORMAT_TIFF, 0, 4, "MM\0*"},
+#endif
+};
+
+#define NB_FILE_FORMATS (sizeof(File_formats)/sizeof(File_formats[0]))
+
+/// Calls the Test function of File_formats[index], unless it was
+/// already done for this file.
+/// @return 1 if the file is recognized
+static int Try_file_format(T_IO_Context *context, FILE * f, unsigned int index, byte * tested)
+{
+  if (tested[index] || File_formats[index].Test == NULL)
+    return 0;
+  tested[index] = 1;
+  fseek(f, 0, SEEK_SET); // rewind
+  File_error = 1;
+  File_formats[index].Test(context, f);
+  return File_error == 0;
+}
+
+///
+/// Finds the format of a file.
+///
+/// The formats which signature is found in the first bytes of the file are
+/// tested first, then all the remaining formats in the order of
+/// File_formats, as before the signatures were used. So a file without a
+/// known signature is recognized as the same format as before.
+/// @param context the IO context, with the file name
+/// @param f the opened file
+/// @param tested one byte per entry of File_formats, non-zero for the
+///        formats already tested
+/// @return the format of the file, or NULL if it is unknown
+static const T_Format * Find_file_format(T_IO_Context *context, FILE * f, byte * tested)
+{
+  byte header[SIGNATURE_HEADER_SIZE];
+  size_t header_size;
+  const char * method = "signature";
+  unsigned int index;
+  unsigned int i;
+
+  // Signatures
+  fseek(f, 0, SEEK_SET);
+  header_size = fread(header, 1, sizeof(header), f);
+  for (i = 0; i < sizeof(Format_signatures)/sizeof(Format_signatures[0]); i++)
+  {
+    const T_Format_signature * signature = Format_signatures + i;
+
+    if ((size_t)signature->Offset + signature->Length > header_size
+        || memcmp(header + signature->Offset, signature->Magic, signature->Length) != 0)
+      continue;
+    for (index = 0; index < NB_FILE_FORMATS; index++)
+    {
+      if (File_formats[index].Identifier == signature->Identifier)
+      {
+        if (Try_file_format(context, f, index, tested))
+          goto found;
+        break;
+      }
+    }
+  }
+
+  // All the other formats
+  method = "scan";
+  for (index = 0; index < NB_FILE_FORMATS; index++)
+  {
+    if (Try_file_format(context, f, index, tested))
+      goto found;
+  }
+  File_error = 1;
+  return NULL;
+
+found:
+  GFX2_Log(GFX2_DEBUG, "Find_file_format() %s : %s format found by %s\n",
+           context->File_name, File_formats[index].Default_extension, method);
+  return File_formats + index;
+}
+
 // -- Charger n'importe connu quel type de fichier d'image (ou palette) -----
 void Load_image(T_IO_Context *context)
 {
-  unsigned int index; // index de balayage des formats
+  byte tested[NB_FILE_FORMATS]; // formats déjà testés
   const T_Format *format = &(File_formats[FORMAT_ALL_FILES+1]); // Format du fichier à charger
   int i;
   byte old_cursor_shape;
@@ -619,31 +770,23 @@ void Load_image(T_IO_Context *context)
       return;
     }
 
+    memset(tested, 0, sizeof(tested));
     if (context->Format > FORMAT_ALL_FILES)
     {
       format = Get_fileformat(context->Format);
       if (format->Test)
+      {
         format->Test(context, f);
+        tested[format - File_formats] = 1;
+      }
     }
 
     if (File_error)
     {
-      //  Sinon, on va devoir scanner les différents formats qu'on connait pour
-      // savoir à quel format est le fichier:
-      for (index=0; index < Nb_known_formats(); index++)
-      {
-        format = Get_fileformat(index);
-        // Loadable format
-        if (format->Test == NULL)
-          continue;
-
-        fseek(f, 0, SEEK_SET); // rewind
-        // On appelle le testeur du format:
-        format->Test(context, f);
-        // On s'arrête si le fichier est au bon format:
-        if (File_error==0)
-          break;
-      }
+      //  Sinon, on va devoir chercher à quel format est le fichier:
+      const T_Format * found = Find_file_format(context, f, tested);
+      if (found != NULL)
+        format = found;
     }
     fclose(f);
 
@@ -803,6 +946,7 @@ void Load_image(T_IO_Context *context)
       }
       // Copy the loaded palette
       memcpy(Main.palette, context->Palette, sizeof(T_Palette));
+      Palette_generation++;
       memcpy(Main.backups->Pages->Palette, context->Palette, sizeof(T_Palette));
 
       // For formats that handle more than just the palette:
@@ -897,6 +1041,7 @@ void Load_image(T_IO_Context *context)
       Backup_layers(LAYER_NONE);
       // Copy the loaded palette
       memcpy(Main.palette, context->Palette, sizeof(T_Palette));
+      Palette_generation++;
       memcpy(Main.backups->Pages->Palette, context->Palette, sizeof(T_Palette));
     }
   }
@@ -1831,6 +1976,12 @@ byte Get_pixel(T_IO_Context *context, short x, short y)
   return *(context->Target_address + y*context->Pitch + x);
 }
 
+/// Query the colors of a row of pixels (to save)
+void Get_pixel_line(T_IO_Context *context, short x, short y, short width, byte * pixels)
+{
+  memcpy(pixels, context->Target_address + y*context->Pitch + x, width);
+}
+
 /// Cleans up resources
 void Destroy_context(T_IO_Context *context)
 {
@@ -91,6 +91,15 @@ typedef struct
   /// Internal: during load, marks which layer is being loaded.
   int Current_layer;
 
+  /// Internal: image mode given by the loader, for the contexts which
+  /// don't store it in a page.
+  enum IMAGE_MODES Image_mode;
+
+  /// For CONTEXT_SURFACE: the layers above the first one are drawn over it,
+  /// skipping their transparent pixels. Only the first frame of an
+  /// animation is kept.
+  byte Flatten_layers;
+
   /// Internal: Used to mark truecolor images on loading. Only used by preview.
   //byte Is_truecolor;
   /// Internal: Temporary RGB buffer when loading 24bit images
@@ -157,6 +166,9 @@ void Save_image(T_IO_Context *context);
 /// Returns non-zero if some backups were loaded.
 int Check_recovery(void);
 
+/// Global indicator that tells if the safety backup system is active
+extern byte Safety_backup_active;
+
 /// Makes a safety backup periodically.
 void Rotate_safety_backups(void);
 
@@ -215,8 +227,12 @@ void Fill_canvas(T_IO_Context *context, byte color);
 
 /// Query the color of a pixel (to save)
 byte Get_pixel(T_IO_Context *context, short x, short y);
+/// Query the colors of @a width consecutive pixels of a row (to save)
+void Get_pixel_line(T_IO_Context *context, short x, short y, short width, byte * pixels);
 /// Set the color of a pixel (on load)
 void Set_pixel(T_IO_Context *context, short x, short y, byte c);
+/// Set the color of @a width consecutive pixels of a row (on load)
+void Set_pixel_line(T_IO_Context *context, short x, short y, short width, const byte * pixels);
 /// Set the color of a 24bit pixel (on load)
 void Set_pixel_24b(T_IO_Context *context, short x, short y, byte r, byte g, byte b);
 /// Function to call when need to switch layers.
@@ -132,6 +132,7 @@
 #include "help.h"
 #include "filesel.h"
 #include "factory.h"
+#include "convert.h"
 #if defined(WIN32) && !(defined(USE_SDL) || defined(USE_SDL2))
 #include "win32screen.h"
 #endif
@@ -149,6 +150,19 @@ extern char Program_version[]; // generated in pversion.c
 static int setsize_width;
 static int setsize_height;
 
+/// Script given with -script : Grafx2 runs it without opening a window, then quits.
+static char * Batch_script = NULL;
+/// -convert was given : Grafx2 converts the pictures without opening a window, then quits.
+static int Batch_convert = 0;
+/// Output format given with -format
+static const char * Batch_format = NULL;
+/// Pictures given after -script or -convert. With -script, each one is loaded,
+/// processed and saved. With -convert, the last one is the output.
+static char ** Batch_files = NULL;
+static int Batch_files_count = 0;
+/// Time when the video was initialized, for the batch timing report
+static dword Batch_start_ticks;
+
 #if (defined(USE_SDL) || defined(USE_SDL2)) && defined(USE_JOYSTICK)
 /// Pointer to the current joystick controller.
 static SDL_Joystick* Joystick;
@@ -181,6 +195,13 @@ void Display_syntax(void)
     "\t-skin <filename>   to use an alternate file with the menu graphics\n"
     "\t-mode <videomode>  to set a video mode\n"
     "\t-size <resolution> to set the image size\n"
+    "\t-script <filename> [<picture>...]\n"
+    "\t                   to run a Lua script on each picture without opening a\n"
+    "\t                   window. Pictures are saved back in their own format.\n"
+    "\t-convert <picture>... <output> [-format <extension>]\n"
+    "\t                   to convert pictures without opening a window. The\n"
+    "\t                   pictures can have wildcards, the output is a directory\n"
+    "\t                   or the name of the converted picture.\n"
     "Arguments can be prefixed either by / - or --\n"
     "They can also be abbreviated.\n\n";
   fputs(syntax, stdout);
@@ -229,6 +250,8 @@ void Error_function(int error_code, const char *filename, int line_number, const
   {
     // L'erreur 0 n'est pas une vraie erreur, elle fait seulement un flash rouge de l'écran pour dire qu'il y a un problème.
     // Toutes les autres erreurs déclenchent toujours une sortie en catastrophe du programme !
+    if (Batch_script != NULL || Batch_convert)
+      return; // nobody to see the flash
     memcpy(backup_palette, Get_current_palette(), sizeof(T_Palette));
     memcpy(temp_palette, backup_palette, sizeof(T_Palette));
     for (index=0;index<=255;index++)
@@ -321,30 +344,37 @@ enum CMD_PARAMS
     CMDPARAM_SKIN,
     CMDPARAM_SIZE,
     CMDPARAM_VERBOSE,
+    CMDPARAM_SCRIPT,
+    CMDPARAM_CONVERT,
+    CMDPARAM_FORMAT,
 };
 
 struct {
     const char *param;
     int id;
+    int prefix_only; ///< Abbreviations must be the start of the name, so the older ones stay unique
 } cmdparams[] = {
-    {"?", CMDPARAM_HELP},
-    {"h", CMDPARAM_HELP},
-    {"H", CMDPARAM_HELP},
-    {"help", CMDPARAM_HELP},
-    {"mode", CMDPARAM_MODE},
-    {"tall", CMDPARAM_PIXELRATIO_TALL},
-    {"wide", CMDPARAM_PIXELRATIO_WIDE},
-    {"double", CMDPARAM_PIXELRATIO_DOUBLE},
-    {"triple", CMDPARAM_PIXELRATIO_TRIPLE},
-    {"quadruple", CMDPARAM_PIXELRATIO_QUAD},
-    {"tall2", CMDPARAM_PIXELRATIO_TALL2},
-    {"tall3", CMDPARAM_PIXELRATIO_TALL3},
-    {"wide2", CMDPARAM_PIXELRATIO_WIDE2},
-    {"rgb", CMDPARAM_RGB},
-    {"gamma", CMDPARAM_GAMMA},
-    {"skin", CMDPARAM_SKIN},
-    {"size", CMDPARAM_SIZE},
-    {"verbose", CMDPARAM_VERBOSE},
+    {"?", CMDPARAM_HELP, 0},
+    {"h", CMDPARAM_HELP, 0},
+    {"H", CMDPARAM_HELP, 0},
+    {"help", CMDPARAM_HELP, 0},
+    {"mode", CMDPARAM_MODE, 0},
+    {"tall", CMDPARAM_PIXELRATIO_TALL, 0},
+    {"wide", CMDPARAM_PIXELRATIO_WIDE, 0},
+    {"double", CMDPARAM_PIXELRATIO_DOUBLE, 0},
+    {"triple", CMDPARAM_PIXELRATIO_TRIPLE, 0},
+    {"quadruple", CMDPARAM_PIXELRATIO_QUAD, 0},
+    {"tall2", CMDPARAM_PIXELRATIO_TALL2, 0},
+    {"tall3", CMDPARAM_PIXELRATIO_TALL3, 0},
+    {"wide2", CMDPARAM_PIXELRATIO_WIDE2, 0},
+    {"rgb", CMDPARAM_RGB, 0},
+    {"gamma", CMDPARAM_GAMMA, 0},
+    {"skin", CMDPARAM_SKIN, 0},
+    {"size", CMDPARAM_SIZE, 0},
+    {"verbose", CMDPARAM_VERBOSE, 0},
+    {"script", CMDPARAM_SCRIPT, 1},
+    {"convert", CMDPARAM_CONVERT, 1},
+    {"format", CMDPARAM_FORMAT, 1},
 };
 
 #define ARRAY_SIZE(x) (int)(sizeof(x) / sizeof(x[0]))
@@ -405,7 +435,7 @@ int Analyze_command_line(int argc, char * argv[], char * filenames[], char * dir
           paramtype = cmdparams[tmpi].id;
           break;
         }
-        else if (strstr(cmdparams[tmpi].param, s))
+        else if (cmdparams[tmpi].prefix_only ? !strncmp(cmdparams[tmpi].param, s, strlen(s)) : strstr(cmdparams[tmpi].param, s) != NULL)
         {
           param_matches++;
           param_match = cmdparams[tmpi].id;
@@ -540,7 +570,65 @@ int Analyze_command_line(int argc, char * argv[], char * filenames[], char * dir
       case CMDPARAM_VERBOSE:
         GFX2_verbosity_level++;
         break;
+      case CMDPARAM_SCRIPT:
+        index++;
+        if (index<argc && Batch_script == NULL && !Batch_convert && File_exists(argv[index]))
+        {
+          Batch_script = Realpath(argv[index], NULL);
+          // all the remaining file names are for the script
+          Batch_files = (char **)GFX2_malloc(sizeof(char *) * argc);
+          if (Batch_script == NULL || Batch_files == NULL)
+            Error(ERROR_MEMORY);
+        }
+        else
+        {
+          Error(ERROR_COMMAND_LINE);
+          exit(0);
+        }
+        break;
+      case CMDPARAM_CONVERT:
+        if (Batch_script != NULL || Batch_convert)
+        {
+          Error(ERROR_COMMAND_LINE);
+          exit(0);
+        }
+        Batch_convert = 1;
+        // all the remaining file names are for the conversion
+        Batch_files = (char **)GFX2_malloc(sizeof(char *) * argc);
+        if (Batch_files == NULL)
+          Error(ERROR_MEMORY);
+        break;
+      case CMDPARAM_FORMAT:
+        index++;
+        if (index<argc)
+          Batch_format = argv[index];
+        else
+        {
+          Error(ERROR_COMMAND_LINE);
+          exit(0);
+        }
+        break;
       default:
+        if (Batch_convert)
+        {
+          // Not checked : they can have wildcards, and the output doesn't exist yet
+          Batch_files[Batch_files_count] = strdup(argv[index]);
+          if (Batch_files[Batch_files_count++] == NULL)
+            Error(ERROR_MEMORY);
+          break;
+        }
+        if (Batch_script != NULL)
+        {
+          if (!File_exists(argv[index]))
+          {
+            Error(ERROR_COMMAND_LINE);
+            exit(0);
+          }
+          Batch_files[Batch_files_count] = Realpath(argv[index], NULL);
+          if (Batch_files[Batch_files_count++] == NULL)
+            Error(ERROR_MEMORY);
+          break;
+        }
         // Si ce n'est pas un paramètre, c'est le nom du fichier à ouvrir
         if (file_in_command_line > 1)
         {
@@ -643,6 +731,8 @@ int Init_program(int argc,char * argv[])
 
   // Analyse command-line as soon as possible.
   file_in_command_line = Analyze_command_line(argc, argv, filenames, directories, &videomode, &cmdline_pixelratio);
+  if (Batch_script != NULL)
+    GFX2_Set_headless();
 
   // On crée dès maintenant les descripteurs des listes de pages pour la page
   // principale et la page de brouillon afin que leurs champs ne soient pas
@@ -672,6 +762,20 @@ int Init_program(int argc,char * argv[])
   // On en profite pour le mémoriser dans le répertoire principal:
   Initial_directory = strdup(Main.selector.Directory);
 
+  if (Batch_convert)
+  {
+    // The conversion only needs the settings : no video, menus, skin or fonts.
+    if (Batch_files_count < 2)
+    {
+      Error(ERROR_COMMAND_LINE);
+      exit(0);
+    }
+    temp=Load_INI(&Config);
+    if (temp)
+      Error(temp);
+    return(1);
+  }
+
   // On initialise les données sur le nom de fichier de l'image de brouillon:
   Spare.selector.Directory = strdup(Main.selector.Directory);
   Spare.selector.Directory_unicode = Unicode_strdup(Main.selector.Directory_unicode);
@@ -766,6 +870,7 @@ int Init_program(int argc,char * argv[])
   SDL_EnableUNICODE(SDL_ENABLE);
   SDL_WM_SetCaption("GrafX2","GrafX2");
 #endif
+  Batch_start_ticks = GFX2_GetTicks();
   Define_icon();
 
   // Texte
@@ -960,6 +1065,7 @@ int Init_program(int argc,char * argv[])
   Load_Unicode_fonts();
 
   memcpy(Main.palette, Gfx->Default_palette, sizeof(T_Palette));
+  Palette_generation++;
 
   Fore_color=Best_color_range(255,255,255,Config.Palette_cells_X*Config.Palette_cells_Y);
   Back_color=Best_color_range(0,0,0,Config.Palette_cells_X*Config.Palette_cells_Y);
@@ -1104,6 +1210,18 @@ int Init_program(int argc,char * argv[])
   *Brush=MC_White;
   *Brush_original_pixels=MC_White;
 
+  if (Batch_script != NULL)
+  {
+    // No recovery, no splash screen and no drag and drop in batch mode :
+    // Run_batch() takes care of the pictures.
+    while (file_in_command_line-- > 0)
+    {
+      free(directories[file_in_command_line]);
+      free(filenames[file_in_command_line]);
+    }
+    return(1);
+  }
+
   // Make sure the load dialog points to the right place when first shown.
   // Done after loading everything else, but before checking for emergency
   // backups
@@ -1287,6 +1405,7 @@ void Program_shutdown(void)
 
   // Free all images
   Set_number_of_backups(-1); // even delete the main page
+  Close_undo_swap_file();
 
   FREE_POINTER(Main.visible_image.Image);
   FREE_POINTER(Spare.visible_image.Image);
@@ -1361,6 +1480,7 @@ void Program_shutdown(void)
   {
     FREE_POINTER(Bound_script[i]);
   }
+  Free_script_cache();
 
   Uninit_text();
 
@@ -1387,6 +1507,92 @@ void Program_shutdown(void)
 }
 
 
+/**
+ * Run the -script command line : load each picture, run the script on it
+ * and save it back in the same file and format.
+ *
+ * The time spent in each stage is printed on the standard output.
+ * @return the program exit code : 0 when all pictures were processed
+ */
+static int Run_batch(void)
+{
+  T_IO_Context context;
+  dword start, load_start, script_start, save_start, end;
+  int i;
+  int errors = 0;
+
+  start = GFX2_GetTicks();
+  printf("init: %lu ms\n", (unsigned long)(start - Batch_start_ticks));
+
+  if (Batch_files_count == 0)
+  {
+    // The script doesn't work on pictures, or loads them itself
+    if (!Run_script_batch(Batch_script))
+      errors++;
+    printf("%s: script %lu ms\n", Batch_script, (unsigned long)(GFX2_GetTicks() - start));
+  }
+  for (i = 0; i < Batch_files_count; i++)
+  {
+    char * directory = Batch_files[i];
+    char * filename = Find_last_separator(directory);
+
+    if (filename == NULL)
+    {
+      filename = directory;
+      directory = ".";
+    }
+    else
+      *filename++ = '\0';
+
+    load_start = GFX2_GetTicks();
+    Init_context_layered_image(&context, filename, directory);
+    Load_image(&context);
+    Destroy_context(&context);
+    if (File_error)
+    {
+      GFX2_Log(GFX2_ERROR, "%s: cannot load the picture\n", filename);
+      errors++;
+      continue;
+    }
+    Redraw_layered_image();
+    End_of_modification();
+
+    script_start = GFX2_GetTicks();
+    if (!Run_script_batch(Batch_script))
+    {
+      errors++;
+      continue;
+    }
+
+    save_start = GFX2_GetTicks();
+    // Same format as the loaded file, which is now in Main.fileformat
+    Init_context_layered_image(&context, filename, directory);
+    Save_image(&context);
+    Destroy_context(&context);
+    if (File_error)
+    {
+      GFX2_Log(GFX2_ERROR, "%s: cannot save the picture\n", filename);
+      errors++;
+      continue;
+    }
+    end = GFX2_GetTicks();
+    printf("%s: load %lu ms, script %lu ms, save %lu ms\n", filename,
+           (unsigned long)(script_start - load_start),
+           (unsigned long)(save_start - script_start),
+           (unsigned long)(end - save_start));
+  }
+  printf("total: %lu ms, %d picture(s), %d error(s)\n",
+         (unsigned long)(GFX2_GetTicks() - Batch_start_ticks), Batch_files_count, errors);
+
+  for (i = 0; i < Batch_files_count; i++)
+    free(Batch_files[i]);
+  free(Batch_files);
+  Batch_files = NULL;
+  free(Batch_script);
+  Batch_script = NULL;
+  return errors ? 1 : 0;
+}
+
 /**
  * Program entry point
  */
@@ -1550,6 +1756,24 @@ int main(int argc,char * argv[])
 #ifdef _MSC_VER
   GFX2_Log(GFX2_DEBUG, "built with _MSC_VER=%d   Windows ANSI Code Page=%u\n", _MSC_VER, GetACP());
 #endif
+  if (Batch_convert)
+  {
+    int exit_code = Convert_pictures(Batch_files, Batch_files_count - 1,
+                                     Batch_files[Batch_files_count - 1], Batch_format);
+    // Nothing else was initialized, the process exit frees the rest.
+    while (Batch_files_count > 0)
+      free(Batch_files[--Batch_files_count]);
+    free(Batch_files);
+    return exit_code;
+  }
+  if (Batch_script != NULL)
+  {
+    int exit_code = Run_batch();
+
+    Config.Auto_save = 0; // a batch doesn't change the settings
+    Program_shutdown();
+    return exit_code;
+  }
   Main_handler();
 
   Program_shutdown();
@@ -181,6 +181,7 @@ void Set_palette(T_Palette palette)
 {
   int i;
 
+  Palette_generation++;
   memcpy(Current_palette, palette, sizeof(T_Palette));
   for(i=0;i<256;i++)
   {
@@ -400,6 +401,58 @@ byte Read_pixel_from_backup_screen (word x,word y)
   return *(Screen_backup + x + Main.image_width * y);
 }
 
+///
+/// Results of the current colorize mode, for each color painted and color
+/// under it. Each result is computed the first time it is needed, and the
+/// whole table is forgotten when the mode, the palette, the excluded
+/// colors or a parameter of the mode change.
+static struct
+{
+  byte Mode;               ///< 1 + Colorize_current_mode, 0 when nothing is computed
+  byte Opacity;            ///< Colorize_opacity, only for the interpolated mode
+  byte Fore_color;         ///< Fore_color, only for the alpha mode
+  dword Palette_generation; ///< ::Palette_generation when the table was emptied
+  byte Known[256*256/8];   ///< Bitfield : result is computed
+  byte Color[256*256];     ///< Indexed by color*256 + color under
+} Colorize_cache;
+
+///
+/// Looks for the result of a colorize mode in ::Colorize_cache.
+/// @return 1 if @a result was found, 0 if it has to be computed.
+static int Colorize_cache_lookup(byte mode, byte color, byte color_under, byte * result)
+{
+  byte opacity = (mode == 0) ? Colorize_opacity : 0;
+  byte fore_color = (mode == 3) ? Fore_color : 0;
+  word index = (word)(color << 8) | color_under;
+
+  if (Colorize_cache.Mode != mode + 1
+    || Colorize_cache.Opacity != opacity
+    || Colorize_cache.Fore_color != fore_color
+    || Colorize_cache.Palette_generation != Palette_generation)
+  {
+    Colorize_cache.Mode = mode + 1;
+    Colorize_cache.Opacity = opacity;
+    Colorize_cache.Fore_color = fore_color;
+    Colorize_cache.Palette_generation = Palette_generation;
+    memset(Colorize_cache.Known, 0, sizeof(Colorize_cache.Known));
+    return 0;
+  }
+  if (!(Colorize_cache.Known[index >> 3] & (1 << (index & 7))))
+    return 0;
+  *result = Colorize_cache.Color[index];
+  return 1;
+}
+
+/// Stores a result in ::Colorize_cache, after Colorize_cache_lookup() failed.
+static byte Colorize_cache_store(byte color, byte color_under, byte result)
+{
+  word index = (word)(color << 8) | color_under;
+
+  Colorize_cache.Known[index >> 3] |= 1 << (index & 7);
+  Colorize_cache.Color[index] = result;
+  return result;
+}
+
 byte Effect_interpolated_colorize  (word x,word y,byte color)
 {
   // factor_a = 256*(100-Colorize_opacity)/100
@@ -417,6 +470,10 @@ byte Effect_interpolated_colorize  (word x,word y,byte color)
   byte green=Main.palette[color].G;
   byte red_under=Main.palette[color_under].R;
   byte red=Main.palette[color].R;
+  byte result;
+
+  if (Colorize_cache_lookup(0, color, color_under, &result))
+    return result;
 
   // On récupère les 3 composantes RVB
 
@@ -427,7 +484,7 @@ byte Effect_interpolated_colorize  (word x,word y,byte color)
       + Factors_table[green_under]) / 256;
   red = (Factors_inv_table[red]
       + Factors_table[red_under]) / 256;
-  return Best_color(red,green,blue);
+  return Colorize_cache_store(color, color_under, Best_color(red,green,blue));
 
 }
 
@@ -440,11 +497,14 @@ byte Effect_additive_colorize    (word x,word y,byte color)
   byte blue=Main.palette[color].B;
   byte green=Main.palette[color].G;
   byte red=Main.palette[color].R;
+  byte result;
 
-  return Best_color(
+  if (Colorize_cache_lookup(1, color, color_under, &result))
+    return result;
+  return Colorize_cache_store(color, color_under, Best_color(
     red>red_under?red:red_under,
     green>green_under?green:green_under,
-    blue>blue_under?blue:blue_under);
+    blue>blue_under?blue:blue_under));
 }
 
 byte Effect_substractive_colorize(word x,word y,byte color)
@@ -456,11 +516,14 @@ byte Effect_substractive_colorize(word x,word y,byte color)
   byte blue=Main.palette[color].B;
   byte green=Main.palette[color].G;
   byte red=Main.palette[color].R;
+  byte result;
 
-  return Best_color(
+  if (Colorize_cache_lookup(2, color, color_under, &result))
+    return result;
+  return Colorize_cache_store(color, color_under, Best_color(
     red<red_under?red:red_under,
     green<green_under?green:green_under,
-    blue<blue_under?blue:blue_under);
+    blue<blue_under?blue:blue_under));
 }
 
 byte Effect_alpha_colorize    (word x,word y,byte color)
@@ -472,11 +535,14 @@ byte Effect_alpha_colorize    (word x,word y,byte color)
   int factor=(Main.palette[color].R*76 +
     Main.palette[color].G*151 +
     Main.palette[color].B*28)/255;
+  byte result;
 
-  return Best_color(
+  if (Colorize_cache_lookup(3, color, color_under, &result))
+    return result;
+  return Colorize_cache_store(color, color_under, Best_color(
     (Main.palette[Fore_color].R*factor + red_under*(255-factor))/255,
     (Main.palette[Fore_color].G*factor + green_under*(255-factor))/255,
-    (Main.palette[Fore_color].B*factor + blue_under*(255-factor))/255);
+    (Main.palette[Fore_color].B*factor + blue_under*(255-factor))/255));
 }
 
 void Check_timer(void)
@@ -673,23 +739,6 @@ void Scroll_picture(byte * main_src, byte * main_dest, short x_offset,short y_of
   Update_rect(0,0,0,0);
 }
 
-void Zoom_a_line(byte* original_line, byte* zoomed_line,
-    word factor, word width
-    )
-{
-  byte color;
-  word x;
-
-  // Pour chaque pixel
-  for(x=0;x<width;x++){
-    color = *original_line;
-
-    memset(zoomed_line,color,factor);
-    zoomed_line+=factor;
-
-    original_line++;
-  }
-}
 
 /*############################################################################*/
 
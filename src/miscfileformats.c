@@ -654,10 +654,25 @@ void Load_PKM(T_IO_Context * context)
 }
 
 
+/// Counts the pixels of each color in the picture being saved. Unlike
+/// Count_used_colors(), it doesn't need the main page, which doesn't exist
+/// in the command line conversion.
+static void Count_context_colors(T_IO_Context * context, dword * usage)
+{
+  short x_pos;
+  short y_pos;
+
+  memset(usage, 0, 256 * sizeof(dword));
+  for (y_pos = 0; y_pos < context->Height; y_pos++)
+    for (x_pos = 0; x_pos < context->Width; x_pos++)
+      usage[Get_pixel(context, x_pos, y_pos)]++;
+}
+
+
 // -- Sauver un fichier au format PKM ---------------------------------------
 
   // Trouver quels sont les octets de reconnaissance
-  void Find_recog(byte * recog1, byte * recog2)
+  void Find_recog(T_IO_Context * context, byte * recog1, byte * recog2)
   {
     dword Find_recon[256]; // Table d'utilisation de couleurs
     byte  best;   // Meilleure couleur pour recon (recon1 puis recon2)
@@ -666,7 +681,7 @@ void Load_PKM(T_IO_Context * context)
 
 
     // On commence par compter l'utilisation de chaque couleurs
-    Count_used_colors(Find_recon);
+    Count_context_colors(context, Find_recon);
 
     // Ensuite recog1 devient celle la moins utilisée de celles-ci
     *recog1=0;
@@ -710,7 +725,7 @@ void Save_PKM(T_IO_Context * context)
   // Construction du header
   memcpy(header.Ident,"PKM",3);
   header.Method=0;
-  Find_recog(&header.Recog1,&header.Recog2);
+  Find_recog(context, &header.Recog1,&header.Recog2);
   header.Width=context->Width;
   header.Height=context->Height;
   memcpy(header.Palette,context->Palette,sizeof(T_Palette));
@@ -752,12 +767,13 @@ void Save_PKM(T_IO_Context * context)
           Write_one_byte(file,context->Comment[Compteur_de_pixels]);
       }
       // Ecriture des dimensions de l'écran
+      // (no video mode in the command line conversion: use the picture size)
       Write_one_byte(file,1);
       Write_one_byte(file,4);
-      Write_one_byte(file,Screen_width&0xFF);
-      Write_one_byte(file,Screen_width>>8);
-      Write_one_byte(file,Screen_height&0xFF);
-      Write_one_byte(file,Screen_height>>8);
+      Write_one_byte(file,(Screen_width ? Screen_width : context->Width)&0xFF);
+      Write_one_byte(file,(Screen_width ? Screen_width : context->Width)>>8);
+      Write_one_byte(file,(Screen_height ? Screen_height : context->Height)&0xFF);
+      Write_one_byte(file,(Screen_height ? Screen_height : context->Height)>>8);
       // Ecriture de la back-color
       Write_one_byte(file,2);
       Write_one_byte(file,1);
@@ -1060,7 +1076,7 @@ void Save_CEL(T_IO_Context * context)
 
 
   // On commence par compter l'utilisation de chaque couleurs
-  Count_used_colors(color_usage);
+  Count_context_colors(context, color_usage);
 
   File_error=0;
   if ((file=Open_file_write(context)))
@@ -34,6 +34,7 @@
 #include "op_c.h"
 #include "errors.h"
 #include "colorred.h"
+#include "gfx2thread.h"
 
 // If GRAFX2_QUANTIZE_CLUSTER_POPULATION_SPLIT is defined,
 // the clusters are splitted in two half of equal (pixel) population.
@@ -45,6 +46,13 @@
 // are sorted by length of the diagonal
 //#define GRAFX2_QUANTIZE_CLUSTER_SORT_BY_VOLUME
 
+// Pictures with less pixels than this are processed in a single thread
+#define OP_C_PARALLEL_MIN_PIXELS (256*256)
+
+// Minimum number of pixels for which the color tree is flattened in a
+// lookup table before the conversion (the table has to be filled first)
+#define OP_C_TABLE_MIN_PIXELS (1L << (3*CT_TABLE_BITS))
+
 #if defined(__GP2X__) || defined(__gp2x__) || defined(__WIZ__) || defined(__CAANOO__)
 static int Convert_24b_bitmap_to_256_fast(T_Bitmap256 dest,T_Bitmap24B source,int width,int height,T_Components * palette);
 #endif
@@ -284,12 +292,67 @@ void OT_inc(T_Occurrence_table * t,byte r,byte g,byte b)
 }
 
 
+/// Parameters of the jobs of OT_count_occurrences()
+typedef struct
+{
+  const T_Occurrence_table * t;
+  T_Bitmap24B image;
+  int size;
+  int * tables[GFX2_MAX_THREADS]; ///< Counts of each job. The first one is the table of t.
+} T_Count_occurrences_job;
+
+///
+/// Job of OT_count_occurrences() : counts the pixels of the part @a part
+/// of @a count of the picture, in its own table.
+static void OT_count_occurrences_job(int part, int count, void * data)
+{
+  T_Count_occurrences_job * p = (T_Count_occurrences_job *)data;
+  const T_Occurrence_table * t = p->t;
+  int * table = p->tables[part];
+  int first = (int)((long)p->size * part / count);
+  int last = (int)((long)p->size * (part + 1) / count);
+  T_Bitmap24B ptr;
+  int n;
+
+  for (n = last - first, ptr = p->image + first; n > 0; n--, ptr++)
+    table[((ptr->R >> t->red_r) << t->dec_r)
+        | ((ptr->G >> t->red_g) << t->dec_g)
+        | ((ptr->B >> t->red_b) << t->dec_b)]++;
+}
+
 /// Count the use of each color in a 24bit picture and fill in the table
 void OT_count_occurrences(T_Occurrence_table* t, T_Bitmap24B image, int size)
 {
   T_Bitmap24B ptr;
   int index;
 
+  if (size >= OP_C_PARALLEL_MIN_PIXELS && GFX2_Thread_count() > 1)
+  {
+    T_Count_occurrences_job job;
+    int table_size = t->rng_r * t->rng_g * t->rng_b;
+    int count;
+    int i;
+
+    job.t = t;
+    job.image = image;
+    job.size = size;
+    job.tables[0] = t->table;
+    for (count = 1; count < GFX2_Thread_count() && count < GFX2_MAX_THREADS; count++)
+    {
+      job.tables[count] = (int *)calloc(table_size, sizeof(int));
+      if (job.tables[count] == NULL)
+        break; // Less threads
+    }
+    GFX2_Run_parallel(OT_count_occurrences_job, count, &job);
+    // Sum the counts of the other jobs
+    for (i = 1; i < count; i++)
+    {
+      for (index = 0; index < table_size; index++)
+        t->table[index] += job.tables[i][index];
+      free(job.tables[i]);
+    }
+    return;
+  }
   for (index = size, ptr = image; index > 0; index--, ptr++)
     OT_inc(t, ptr->R, ptr->G, ptr->B);
 }
@@ -1238,6 +1301,19 @@ int Modified_value(int value,int modif)
 }
 
 
+/// Palette index of a color, using the flattened table when there is one.
+static byte Lookup_color(const CT_Tree* tc, const CT_Table* table, byte r, byte g, byte b)
+{
+  word entry;
+
+  if (table == NULL)
+    return CT_get_from(tc, 0, r, g, b);
+  entry = table->entries[CT_TABLE_INDEX(r, g, b)];
+  if (entry & CT_TABLE_LEAF)
+    return (byte)entry;
+  return CT_get_from(tc, entry, r, g, b);
+}
+
 /// Convert a 24b image to 256 colors (with a given palette and conversion table).
 /// This destroys the 24b picture !
 /// Uses floyd steinberg dithering.
@@ -1252,6 +1328,10 @@ void Convert_24b_bitmap_to_256_Floyd_Steinberg(T_Bitmap256 dest,T_Bitmap24B sour
   int x_pos,y_pos;
   int red,green,blue;
   float e_red,e_green,e_blue;
+  CT_Table* table = NULL;
+
+  if ((long)width * height >= OP_C_TABLE_MIN_PIXELS)
+    table = CT_table_new(tc); // NULL if out of memory : the tree is used
 
   // On initialise les variables de parcours:
   current =source;      // Le pixel dont on s'occupe
@@ -1272,7 +1352,7 @@ void Convert_24b_bitmap_to_256_Floyd_Steinberg(T_Bitmap256 dest,T_Bitmap24B sour
       green =current->G;
       blue =current->B;
       // Cherche la couleur correspondant dans la palette et la range dans l'image de destination
-      *d=CT_get(tc,red,green,blue);
+      *d=Lookup_color(tc,table,red,green,blue);
 
       // Puis on calcule pour chaque composante l'erreur dûe à l'approximation
       red-=palette[*d].R;
@@ -1331,9 +1411,35 @@ void Convert_24b_bitmap_to_256_Floyd_Steinberg(T_Bitmap256 dest,T_Bitmap24B sour
       d++;
     }
   }
+  CT_table_delete(table);
 }
 
 
+/// Parameters of the jobs of Convert_24b_bitmap_to_256_nearest_neighbor()
+typedef struct
+{
+  T_Bitmap256 dest;
+  T_Bitmap24B source;
+  int width;
+  int height;
+  CT_Tree* tc;
+  CT_Table* table;
+} T_Nearest_neighbor_job;
+
+/// Job of Convert_24b_bitmap_to_256_nearest_neighbor() : converts a band of lines.
+static void Convert_nearest_neighbor_job(int part, int count, void * data)
+{
+  T_Nearest_neighbor_job * p = (T_Nearest_neighbor_job *)data;
+  int first_line = (int)((long)p->height * part / count);
+  int last_line = (int)((long)p->height * (part + 1) / count);
+  T_Bitmap24B current = p->source + (long)first_line * p->width;
+  T_Bitmap256 d = p->dest + (long)first_line * p->width;
+  long n;
+
+  for (n = (long)(last_line - first_line) * p->width; n > 0; n--, current++, d++)
+    *d = Lookup_color(p->tc, p->table, current->R, current->G, current->B);
+}
+
 /// Converts from 24b to 256c without dithering, using given conversion table
 void Convert_24b_bitmap_to_256_nearest_neighbor(T_Bitmap256 dest,
   T_Bitmap24B source, int width, int height, T_Components * palette,
@@ -1343,8 +1449,28 @@ void Convert_24b_bitmap_to_256_nearest_neighbor(T_Bitmap256 dest,
   T_Bitmap256 d;
   int x_pos, y_pos;
   int red, green, blue;
+  CT_Table* table = NULL;
   (void)palette; // unused
 
+  if ((long)width * height >= OP_C_TABLE_MIN_PIXELS)
+    table = CT_table_new(tc); // NULL if out of memory : the tree is used
+
+  if ((long)width * height >= OP_C_PARALLEL_MIN_PIXELS && GFX2_Thread_count() > 1)
+  {
+    // The conversion table is only read : the lines can be split between threads
+    T_Nearest_neighbor_job job;
+
+    job.dest = dest;
+    job.source = source;
+    job.width = width;
+    job.height = height;
+    job.tc = tc;
+    job.table = table;
+    GFX2_Run_parallel(Convert_nearest_neighbor_job, GFX2_Thread_count(), &job);
+    CT_table_delete(table);
+    return;
+  }
+
   // On initialise les variables de parcours:
   current =source; // Le pixel dont on s'occupe
 
@@ -1362,13 +1488,14 @@ void Convert_24b_bitmap_to_256_nearest_neighbor(T_Bitmap256 dest,
       blue = current->B;
       // Cherche la couleur correspondant dans la palette et la range dans
       // l'image de destination
-      *d = CT_get(tc, red, green, blue);
+      *d = Lookup_color(tc, table, red, green, blue);
 
       // On passe au pixel suivant :
       current++;
       d++;
     }
   }
+  CT_table_delete(table);
 }
 
 
@@ -69,12 +69,59 @@ int PackBits_unpack_from_file(FILE * f, byte * dest, unsigned int count)
   return PACKBITS_UNPACK_OK;
 }
 
+int PackBits_unpack_from_memory(byte * dest, unsigned int count, const byte * src, unsigned int src_size)
+{
+  unsigned int i = 0;
+  unsigned int j = 0;
+  while (i < count)
+  {
+    byte cmd;
+    if (j >= src_size)
+      return PACKBITS_UNPACK_READ_ERROR;
+    cmd = src[j++];
+    if (cmd > 128)
+    {
+      // cmd > 128 => repeat (257 - cmd) the next byte
+      if (j >= src_size)
+        return PACKBITS_UNPACK_READ_ERROR;
+      if (count < (i + 257 - cmd))
+        return PACKBITS_UNPACK_OVERFLOW_ERROR;
+      memset(dest + i, src[j++], (257 - cmd));
+      i += (257 - cmd);
+    }
+    else if (cmd < 128)
+    {
+      // cmd < 128 => copy (cmd + 1) bytes
+      if (count < (i + cmd + 1))
+        return PACKBITS_UNPACK_OVERFLOW_ERROR;
+      if (src_size < (j + cmd + 1))
+        return PACKBITS_UNPACK_READ_ERROR;
+      memcpy(dest + i, src + j, (cmd + 1));
+      i += (cmd + 1);
+      j += (cmd + 1);
+    }
+    else
+    {
+      // 128 = NOP
+      GFX2_Log(GFX2_WARNING, "NOP in packbits stream\n");
+    }
+  }
+  return PACKBITS_UNPACK_OK;
+}
+
 void PackBits_pack_init(T_PackBits_data * data, FILE * f)
 {
   memset(data, 0, sizeof(T_PackBits_data));
   data->f = f;
 }
 
+void PackBits_pack_init_buffer(T_PackBits_data * data, byte * buffer, int size)
+{
+  memset(data, 0, sizeof(T_PackBits_data));
+  data->buffer = buffer;
+  data->buffer_size = size;
+}
+
 int PackBits_pack_add(T_PackBits_data * data, byte b)
 {
   switch (data->list_size)
@@ -163,6 +210,13 @@ int PackBits_pack_flush(T_PackBits_data * data)
             !Write_byte(data->f, data->list[0]))
           return -1;
       }
+      else if (data->buffer != NULL)
+      {
+        if (data->output_count + 2 > data->buffer_size)
+          return -1;
+        data->buffer[data->output_count] = 257 - data->list_size;
+        data->buffer[data->output_count + 1] = data->list[0];
+      }
       data->output_count += 2;
     }
     else
@@ -173,6 +227,13 @@ int PackBits_pack_flush(T_PackBits_data * data)
             !Write_bytes(data->f, data->list, data->list_size))
           return -1;
       }
+      else if (data->buffer != NULL)
+      {
+        if (data->output_count + 1 + data->list_size > data->buffer_size)
+          return -1;
+        data->buffer[data->output_count] = data->list_size - 1;
+        memcpy(data->buffer + data->output_count + 1, data->list, data->list_size);
+      }
       data->output_count += 1 + data->list_size;
     }
     data->list_size = 0;
@@ -193,3 +254,16 @@ int PackBits_pack_buffer(FILE * f, const byte * buffer, size_t size)
   }
   return PackBits_pack_flush(&pb_data);
 }
+
+int PackBits_pack_to_memory(byte * dest, int dest_size, const byte * buffer, size_t size)
+{
+  T_PackBits_data pb_data;
+
+  PackBits_pack_init_buffer(&pb_data, dest, dest_size);
+  while (size-- > 0)
+  {
+    if (PackBits_pack_add(&pb_data, *buffer++))
+      return -1;
+  }
+  return PackBits_pack_flush(&pb_data);
+}
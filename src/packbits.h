@@ -43,6 +43,8 @@ int PackBits_unpack_from_file(FILE * f, byte * dest, unsigned int count);
  */
 typedef struct {
   FILE * f;
+  byte * buffer;      ///< memory output, used when f is NULL
+  int buffer_size;
   int output_count;
   byte list_size;
   byte repetition_mode;
@@ -57,6 +59,15 @@ typedef struct {
  */
 void PackBits_pack_init(T_PackBits_data * data, FILE * f);
 
+/**
+ * init before packing to memory
+ *
+ * @param data storage for packbits data
+ * @param buffer output buffer
+ * @param size size of the output buffer
+ */
+void PackBits_pack_init_buffer(T_PackBits_data * data, byte * buffer, int size);
+
 /**
  * Add a byte to the packbits stream
  * @return -1 for error, 0 if OK
@@ -79,4 +90,24 @@ int PackBits_pack_flush(T_PackBits_data * data);
  */
 int PackBits_pack_buffer(FILE * f, const byte * buffer, size_t size);
 
+/**
+ * Pack a full buffer to memory
+ * @param dest output buffer
+ * @param dest_size size of the output buffer
+ * @param buffer input buffer
+ * @param size byte size of input buffer
+ * @return -1 if the packed data doesn't fit in dest_size bytes, or the size of the packed data
+ */
+int PackBits_pack_to_memory(byte * dest, int dest_size, const byte * buffer, size_t size);
+
+/**
+ * Unpack from memory
+ * @param dest output buffer
+ * @param count number of bytes to unpack
+ * @param src packed data
+ * @param src_size size of the packed data
+ * @return PACKBITS_UNPACK_OK or PACKBITS_UNPACK_READ_ERROR or PACKBITS_UNPACK_OVERFLOW_ERROR
+ */
+int PackBits_unpack_from_memory(byte * dest, unsigned int count, const byte * src, unsigned int src_size);
+
 #endif
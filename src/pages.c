@@ -23,9 +23,11 @@
 /////////////////////////// GESTION DU BACKUP ////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
+#include <stdio.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #ifdef _MSC_VER
 #define strdup _strdup
 #endif
@@ -40,7 +42,11 @@
 #include "tiles.h"
 #include "graph.h"
 #include "layers.h"
+#include "layerblend.h"
 #include "unicode.h"
+#include "packbits.h"
+#include "gfx2log.h"
+#include "io.h"
 
 // -- Layers data
 
@@ -75,6 +81,7 @@ T_Page * New_page(int nb_layers)
     {
       page->Image[i].Pixels = NULL;
       page->Image[i].Duration = 100;
+      page->Image[i].Tiled = NULL;
     }
     page->Width=0;
     page->Height=0;
@@ -97,60 +104,678 @@ T_Page * New_page(int nb_layers)
 // ==============================================================
 // Layers allocation functions.
 //
-// Layers are made of a "number of users" (short), followed by
+// Layers are made of a header with a "number of users", followed by
 // the actual pixel data (a large number of bytes).
 // Every time a layer is 'duplicated' as a reference, the number
 // of users is incremented.
 // Every time a layer is freed, the number of users is decreased,
 // and only when it reaches zero the pixel data is freed.
+//
+// Only the current page and the previous one (the one read by effects
+// without "feedback") need their layers as a single block of pixels.
+// In all the other Undo/Redo pages, layers are stored as tiles of
+// UNDO_TILE_SIZE x UNDO_TILE_SIZE pixels, and each tile is shared with
+// the same layer of the neighbour pages when it has the same pixels.
+// So a small change in a big image only keeps the modified tiles in the
+// old pages. This is not copy-on-write for the drawing: the drawing
+// functions write straight into the bitmap of the current page, so
+// Backup() still copies the whole layer, and Tile_layer() compares the
+// whole layer again to find the shared tiles when the page gets older.
+// Beyond the UNDO_UNCOMPRESSED_PAGES most recent pages, the tiles are
+// also compressed with PackBits. They are uncompressed when needed, for
+// example on Undo.
+// When all the pages use more than Config.Undo_memory_limit megabytes,
+// the tiles of the oldest pages are moved to a swap file in the
+// configuration directory, and read back from it when needed.
 // ==============================================================
 
+/// Size (in pixels) of the square tiles used to store old Undo pages.
+#define UNDO_TILE_SIZE 64
+/// Number of most recent pages that are never compressed.
+#define UNDO_UNCOMPRESSED_PAGES 4
+/// Name of the swap file, in the configuration directory.
+#define UNDO_SWAP_FILENAME "gfx2undo.tmp"
+/// Each tile in the swap file uses a slot of this size (in bytes).
+#define UNDO_SWAP_SLOT_SIZE (UNDO_TILE_SIZE*UNDO_TILE_SIZE)
+
+/// One tile of a tiled layer.
+typedef struct
+{
+  int Users;       ///< Number of tiled layers using this tile
+  int Size;        ///< Number of pixels
+  int Packed_size; ///< Size of the PackBits data, or 0 if Data are the pixels
+  byte * Data;     ///< Pixels, or PackBits data. NULL if the tile is in the swap file.
+  long Swap_slot;  ///< Slot in the swap file, when Data is NULL
+} T_Layer_tile;
+
+/// A layer stored as tiles. The array of tile pointers follows this header.
+typedef struct T_Tiled_layer
+{
+  int Users;    ///< Number of pages (and bitmap) using this tiled layer
+  byte * Source;///< Bitmap layer with the same pixels, if it still exists
+  int Width;
+  int Height;
+  int Tiles_w;  ///< Number of tiles in a row
+  int Tiles_h;  ///< Number of rows of tiles
+  byte Packed;  ///< Boolean, true when compression of the tiles was done
+  byte Swapped; ///< Boolean, true when all the tiles are in the swap file
+} T_Tiled_layer;
+
+/// Header in front of the pixels of each bitmap layer
+typedef struct
+{
+  T_Tiled_layer * Tiled; ///< Tiled copy of the same pixels, or NULL
+  long Size;             ///< Number of pixels
+  long Users;            ///< Number of pages using this layer
+} T_Layer_header;
+
+#define LAYER_HEADER(pixels) (((T_Layer_header *)(pixels))-1)
+#define LAYER_TILES(layer) ((T_Layer_tile **)((layer)+1))
+
+/// Swap file for the tiles of the oldest pages. Opened on first use.
+static FILE * Undo_swap_file = NULL;
+/// Boolean, true when the swap file could not be created.
+static byte Undo_swap_failed = 0;
+/// Number of slots in the swap file, used or not.
+static long Undo_swap_slots = 0;
+/// Stack of the unused slots of the swap file.
+static long * Undo_swap_free_slots = NULL;
+static long Undo_swap_free_count = 0;
+static long Undo_swap_free_max = 0;
+
+/// Releases a slot of the swap file.
+static void Free_swap_slot(long slot)
+{
+  Undo_swap_free_slots[Undo_swap_free_count++] = slot;
+  if (Undo_swap_free_count == Undo_swap_slots)
+  {
+    // Nothing left in the file : start again from the beginning
+    Undo_swap_slots = 0;
+    Undo_swap_free_count = 0;
+  }
+}
+
 /// Allocate a new layer
 byte * New_layer(long pixel_size)
 {
-  short * ptr = GFX2_malloc(sizeof(short)+pixel_size);
-  if (ptr==NULL)
+  T_Layer_header * header = GFX2_malloc(sizeof(T_Layer_header)+pixel_size);
+  if (header==NULL)
     return NULL;
     
   // Stats
   Stats_pages_number++;
   Stats_pages_memory+=pixel_size;
   
-  *ptr = 1;
-  return (byte *)(ptr+1);
+  header->Tiled = NULL;
+  header->Size = pixel_size;
+  header->Users = 1;
+  return (byte *)(header+1);
 }
 
-/// Free a layer
-void Free_layer(T_Page * page, int layer)
+/// Release a reference to a tiled layer, and its tiles.
+static void Free_tiled_layer(T_Tiled_layer * layer)
 {
-  short * ptr;
-  if (page->Image[layer].Pixels==NULL)
+  int i;
+
+  if (--layer->Users)
     return;
-    
-  ptr = (short *)(page->Image[layer].Pixels);
-  if (-- (*(ptr-1))) // Users--
+  for (i = 0; i < layer->Tiles_w * layer->Tiles_h; i++)
+  {
+    T_Layer_tile * tile = LAYER_TILES(layer)[i];
+    if (tile != NULL && --tile->Users == 0)
+    {
+      if (tile->Data == NULL)
+        Free_swap_slot(tile->Swap_slot);
+      else
+      {
+        Stats_pages_memory -= tile->Packed_size ? tile->Packed_size : tile->Size;
+        free(tile->Data);
+      }
+      free(tile);
+    }
+  }
+  free(layer);
+  Stats_pages_number--;
+}
+
+/// Release a reference to a bitmap layer
+static void Free_bitmap_layer(byte * pixels)
+{
+  T_Layer_header * header = LAYER_HEADER(pixels);
+
+  if (-- header->Users) // Users--
     return;
-  else {
-    free(ptr-1);
+  if (header->Tiled != NULL)
+  {
+    // The tiled copy may outlive this bitmap
+    header->Tiled->Source = NULL;
+    Free_tiled_layer(header->Tiled);
   }
-    
   // Stats
   Stats_pages_number--;
-  Stats_pages_memory-=page->Width * page->Height;
+  Stats_pages_memory-=header->Size;
+  free(header);
+}
+
+/// Free a layer
+void Free_layer(T_Page * page, int layer)
+{
+  if (page->Image[layer].Tiled!=NULL)
+  {
+    Free_tiled_layer(page->Image[layer].Tiled);
+    page->Image[layer].Tiled = NULL;
+  }
+  if (page->Image[layer].Pixels!=NULL)
+    Free_bitmap_layer(page->Image[layer].Pixels);
 }
 
 /// Duplicate a layer (new reference)
 byte * Dup_layer(byte * layer)
 {
-  short * ptr = (short *)(layer);
-  
   if (layer==NULL)
     return NULL;
   
-  (*(ptr-1)) ++; // Users ++
+  LAYER_HEADER(layer)->Users++;
+  return layer;
+}
+
+///
+/// Returns the pixels of a tile. @a buffer is used if the tile is
+/// compressed, or in the swap file.
+/// @return NULL if the tile could not be read back
+static const byte * Tile_pixels(const T_Layer_tile * tile, byte * buffer)
+{
+  if (tile->Data == NULL)
+  {
+    // In the swap file
+    if (fseek(Undo_swap_file, tile->Swap_slot * UNDO_SWAP_SLOT_SIZE, SEEK_SET) != 0)
+    {
+      GFX2_Log(GFX2_ERROR, "Failed to read an Undo tile from the swap file\n");
+      return NULL;
+    }
+    if (tile->Packed_size == 0)
+    {
+      if (fread(buffer, 1, tile->Size, Undo_swap_file) != (size_t)tile->Size)
+      {
+        GFX2_Log(GFX2_ERROR, "Failed to read an Undo tile from the swap file\n");
+        return NULL;
+      }
+    }
+    else
+    {
+      byte swapped[UNDO_SWAP_SLOT_SIZE];
+
+      if (fread(swapped, 1, tile->Packed_size, Undo_swap_file) != (size_t)tile->Packed_size)
+      {
+        GFX2_Log(GFX2_ERROR, "Failed to read an Undo tile from the swap file\n");
+        return NULL;
+      }
+      if (PackBits_unpack_from_memory(buffer, tile->Size, swapped, tile->Packed_size) != PACKBITS_UNPACK_OK)
+      {
+        GFX2_Log(GFX2_ERROR, "Failed to uncompress an Undo tile\n");
+        return NULL;
+      }
+    }
+    return buffer;
+  }
+  if (tile->Packed_size == 0)
+    return tile->Data;
+  if (PackBits_unpack_from_memory(buffer, tile->Size, tile->Data, tile->Packed_size) != PACKBITS_UNPACK_OK)
+  {
+    GFX2_Log(GFX2_ERROR, "Failed to uncompress an Undo tile\n");
+    return NULL;
+  }
+  return buffer;
+}
+
+/// Compresses a tile, if it makes it smaller.
+static void Pack_tile(T_Layer_tile * tile)
+{
+  byte packed[UNDO_TILE_SIZE*UNDO_TILE_SIZE];
+  byte * data;
+  int packed_size;
+
+  if (tile->Packed_size || tile->Data == NULL)
+    return; // Already compressed, or in the swap file
+  packed_size = PackBits_pack_to_memory(packed, tile->Size - 1, tile->Data, tile->Size);
+  if (packed_size <= 0)
+    return; // Doesn't compress
+  data = GFX2_malloc(packed_size);
+  if (data == NULL)
+    return;
+  memcpy(data, packed, packed_size);
+  free(tile->Data);
+  tile->Data = data;
+  tile->Packed_size = packed_size;
+  Stats_pages_memory -= tile->Size - packed_size;
+}
+
+/// Compresses all the tiles of a tiled layer.
+static void Pack_tiled_layer(T_Tiled_layer * layer)
+{
+  int i;
+
+  if (layer->Packed)
+    return;
+  for (i = 0; i < layer->Tiles_w * layer->Tiles_h; i++)
+    Pack_tile(LAYER_TILES(layer)[i]);
+  layer->Packed = 1;
+}
+
+/// Opens the swap file. @return 0 if it is not possible.
+static int Open_undo_swap_file(void)
+{
+  char * filename;
+
+  if (Undo_swap_file != NULL)
+    return 1;
+  // Only one instance of the program can own the configuration directory
+  if (Undo_swap_failed || !Safety_backup_active)
+    return 0;
+  filename = Filepath_append_to_dir(Config_directory, UNDO_SWAP_FILENAME);
+  Undo_swap_file = fopen(filename, "w+b");
+  if (Undo_swap_file == NULL)
+  {
+    GFX2_Log(GFX2_WARNING, "Cannot create Undo swap file %s\n", filename);
+    Undo_swap_failed = 1;
+  }
+  free(filename);
+  return Undo_swap_file != NULL;
+}
+
+void Close_undo_swap_file(void)
+{
+  char * filename;
+
+  if (Undo_swap_file == NULL)
+    return;
+  fclose(Undo_swap_file);
+  Undo_swap_file = NULL;
+  filename = Filepath_append_to_dir(Config_directory, UNDO_SWAP_FILENAME);
+  Remove_path(filename);
+  free(filename);
+  free(Undo_swap_free_slots);
+  Undo_swap_free_slots = NULL;
+  Undo_swap_free_max = 0;
+  Undo_swap_free_count = 0;
+  Undo_swap_slots = 0;
+}
+
+/// Moves the data of a tile to the swap file. @return 0 on error.
+static int Swap_tile(T_Layer_tile * tile)
+{
+  size_t size = tile->Packed_size ? tile->Packed_size : tile->Size;
+  long slot;
+
+  if (tile->Data == NULL)
+    return 1; // Already done
+  if (Undo_swap_free_count > 0)
+    slot = Undo_swap_free_slots[--Undo_swap_free_count];
+  else
+  {
+    if (Undo_swap_slots >= LONG_MAX / UNDO_SWAP_SLOT_SIZE)
+      return 0; // File is too big for fseek()
+    if (Undo_swap_slots >= Undo_swap_free_max)
+    {
+      // Room to free all slots
+      long new_max = Undo_swap_free_max ? Undo_swap_free_max * 2 : 1024;
+      long * slots = realloc(Undo_swap_free_slots, new_max * sizeof(long));
+      if (slots == NULL)
+        return 0;
+      Undo_swap_free_slots = slots;
+      Undo_swap_free_max = new_max;
+    }
+    slot = Undo_swap_slots++;
+  }
+  if (fseek(Undo_swap_file, slot * UNDO_SWAP_SLOT_SIZE, SEEK_SET) != 0
+    || fwrite(tile->Data, 1, size, Undo_swap_file) != size)
+  {
+    GFX2_Log(GFX2_ERROR, "Failed to write an Undo tile in the swap file\n");
+    Free_swap_slot(slot);
+    return 0;
+  }
+  free(tile->Data);
+  tile->Data = NULL;
+  tile->Swap_slot = slot;
+  Stats_pages_memory -= size;
+  return 1;
+}
+
+/// Moves all the tiles of a tiled layer to the swap file. @return 0 on error.
+static int Swap_tiled_layer(T_Tiled_layer * layer)
+{
+  int i;
+
+  if (layer->Swapped)
+    return 1;
+  for (i = 0; i < layer->Tiles_w * layer->Tiles_h; i++)
+    if (!Swap_tile(LAYER_TILES(layer)[i]))
+      return 0;
+  layer->Swapped = 1;
+  return 1;
+}
+
+/// Checks if a tile has the same pixels as an area of a bitmap.
+static int Tile_is_same_as_area(const T_Layer_tile * tile, const byte * pixels, int stride, int width, int height)
+{
+  byte buffer[UNDO_TILE_SIZE*UNDO_TILE_SIZE];
+  const byte * tile_pixels = Tile_pixels(tile, buffer);
+  int y;
+
+  if (tile_pixels == NULL)
+    return 0; // The tile will be replaced by a fresh copy
+  for (y = 0; y < height; y++)
+  {
+    if (memcmp(tile_pixels, pixels, width))
+      return 0;
+    tile_pixels += width;
+    pixels += stride;
+  }
+  return 1;
+}
+
+///
+/// Returns a (new reference to a) tiled copy of a bitmap layer.
+///
+/// Tiles which have the same pixels in @a reference (the same layer in
+/// a neighbour page) are shared instead of copied.
+static T_Tiled_layer * Tile_layer(byte * pixels, int width, int height, const T_Tiled_layer * reference)
+{
+  T_Layer_header * header = LAYER_HEADER(pixels);
+  T_Tiled_layer * layer;
+  int tiles_w = (width + UNDO_TILE_SIZE - 1) / UNDO_TILE_SIZE;
+  int tiles_h = (height + UNDO_TILE_SIZE - 1) / UNDO_TILE_SIZE;
+  int tile_x, tile_y;
+
+  if (header->Tiled != NULL)
+  {
+    // Already done for an other page using the same bitmap
+    header->Tiled->Users++;
+    return header->Tiled;
+  }
+  if (reference != NULL && (reference->Width != width || reference->Height != height))
+    reference = NULL;
+
+  layer = GFX2_malloc(sizeof(T_Tiled_layer) + tiles_w * tiles_h * sizeof(T_Layer_tile *));
+  if (layer == NULL)
+    return NULL;
+  layer->Width = width;
+  layer->Height = height;
+  layer->Tiles_w = tiles_w;
+  layer->Tiles_h = tiles_h;
+  layer->Packed = 0;
+  layer->Swapped = 0;
+  memset(LAYER_TILES(layer), 0, tiles_w * tiles_h * sizeof(T_Layer_tile *));
+  for (tile_y = 0; tile_y < tiles_h; tile_y++)
+  {
+    int y = tile_y * UNDO_TILE_SIZE;
+    int tile_height = Min(UNDO_TILE_SIZE, height - y);
+
+    for (tile_x = 0; tile_x < tiles_w; tile_x++)
+    {
+      int x = tile_x * UNDO_TILE_SIZE;
+      int tile_width = Min(UNDO_TILE_SIZE, width - x);
+      const byte * area = pixels + (long)y * width + x;
+      T_Layer_tile * tile = NULL;
+
+      if (reference != NULL)
+      {
+        tile = LAYER_TILES(reference)[tile_y * tiles_w + tile_x];
+        if (Tile_is_same_as_area(tile, area, width, tile_width, tile_height))
+          tile->Users++;
+        else
+          tile = NULL;
+      }
+      if (tile == NULL)
+      {
+        // New tile
+        int line;
+
+        tile = GFX2_malloc(sizeof(T_Layer_tile));
+        if (tile != NULL)
+        {
+          tile->Data = GFX2_malloc(tile_width * tile_height);
+          if (tile->Data == NULL)
+          {
+            free(tile);
+            tile = NULL;
+          }
+        }
+        if (tile == NULL)
+        {
+          layer->Users = 1;
+          layer->Source = NULL;
+          Stats_pages_number++;
+          Free_tiled_layer(layer);
+          return NULL;
+        }
+        tile->Users = 1;
+        tile->Size = tile_width * tile_height;
+        tile->Packed_size = 0;
+        for (line = 0; line < tile_height; line++)
+          memcpy(tile->Data + line * tile_width, area + (long)line * width, tile_width);
+        Stats_pages_memory += tile->Size;
+      }
+      LAYER_TILES(layer)[tile_y * tiles_w + tile_x] = tile;
+    }
+  }
+  Stats_pages_number++;
+  // One reference for the caller, one for the bitmap, as long as it exists.
+  layer->Users = 2;
+  layer->Source = pixels;
+  header->Tiled = layer;
   return layer;
 }
 
+///
+/// Returns a (new reference to a) bitmap layer with the pixels of a tiled
+/// layer, or NULL on error.
+static byte * Untile_layer(T_Tiled_layer * layer)
+{
+  byte * pixels;
+  byte buffer[UNDO_TILE_SIZE*UNDO_TILE_SIZE];
+  int tile_x, tile_y;
+
+  if (layer->Source != NULL)
+    return Dup_layer(layer->Source);
+
+  pixels = New_layer((long)layer->Width * layer->Height);
+  if (pixels == NULL)
+    return NULL;
+  for (tile_y = 0; tile_y < layer->Tiles_h; tile_y++)
+  {
+    int y = tile_y * UNDO_TILE_SIZE;
+    int tile_height = Min(UNDO_TILE_SIZE, layer->Height - y);
+
+    for (tile_x = 0; tile_x < layer->Tiles_w; tile_x++)
+    {
+      int x = tile_x * UNDO_TILE_SIZE;
+      int tile_width = Min(UNDO_TILE_SIZE, layer->Width - x);
+      const byte * tile_pixels = Tile_pixels(LAYER_TILES(layer)[tile_y * layer->Tiles_w + tile_x], buffer);
+      int line;
+
+      if (tile_pixels == NULL)
+      {
+        Free_bitmap_layer(pixels);
+        return NULL;
+      }
+      for (line = 0; line < tile_height; line++)
+        memcpy(pixels + (long)(y + line) * layer->Width + x, tile_pixels + line * tile_width, tile_width);
+    }
+  }
+  // Link both, so the next Tile_layer() or Untile_layer() is free.
+  layer->Users++;
+  layer->Source = pixels;
+  LAYER_HEADER(pixels)->Tiled = layer;
+  return pixels;
+}
+
+/// Returns the tiled version of a layer of a page, if it exists and has the requested size.
+static T_Tiled_layer * Tiled_version(const T_Page * page, int layer, int width, int height)
+{
+  T_Tiled_layer * tiled;
+
+  if (layer >= page->Nb_layers || page->Width != width || page->Height != height)
+    return NULL;
+  tiled = page->Image[layer].Tiled;
+  if (tiled == NULL && page->Image[layer].Pixels != NULL)
+    tiled = LAYER_HEADER(page->Image[layer].Pixels)->Tiled;
+  return tiled;
+}
+
+/// Checks if a bitmap layer is used by a page.
+static int Page_uses_bitmap(const T_Page * page, const byte * pixels)
+{
+  int i;
+
+  for (i = 0; i < page->Nb_layers; i++)
+    if (page->Image[i].Pixels == pixels)
+      return 1;
+  return 0;
+}
+
+///
+/// Ensures the layers of the current page, and of the previous one, are
+/// available as bitmaps. It must be done every time the head of a list
+/// of pages changes.
+/// @return 0 if a layer could not be restored
+static int Untile_current_pages(T_List_of_pages * list)
+{
+  T_Page * page = list->Pages;
+  int n;
+
+  for (n = 0; n < 2 && n < list->List_size; n++, page = page->Next)
+  {
+    int i;
+
+    for (i = 0; i < page->Nb_layers; i++)
+    {
+      T_Tiled_layer * tiled = page->Image[i].Tiled;
+      if (tiled != NULL)
+      {
+        byte * pixels = Untile_layer(tiled);
+        if (pixels == NULL)
+          return 0;
+        page->Image[i].Pixels = pixels;
+        page->Image[i].Tiled = NULL;
+        Free_tiled_layer(tiled);
+      }
+    }
+  }
+  return 1;
+}
+
+///
+/// Number of Undo or Redo steps between the current page of a list and
+/// the page at position @a index (following ->Next), whichever is smaller.
+/// The pages at the end of the list are the Redo steps.
+static int Page_distance(const T_List_of_pages * list, int index)
+{
+  return Min(index, list->List_size - index);
+}
+
+/// Moves all the tiled layers of a page to the swap file. @return 0 on error.
+static int Swap_page(T_Page * page)
+{
+  int i;
+
+  for (i = 0; i < page->Nb_layers; i++)
+  {
+    if (page->Image[i].Tiled != NULL && !Swap_tiled_layer(page->Image[i].Tiled))
+      return 0;
+  }
+  return 1;
+}
+
+///
+/// Moves the tiles of the pages which are the farthest from the current
+/// one (in Undo or Redo steps) to the swap file, until the memory used
+/// by all the pages is below Config.Undo_memory_limit.
+static void Swap_history_pages(T_List_of_pages * list)
+{
+  long long limit = (long long)Config.Undo_memory_limit << 20;
+  int distance;
+
+  if (limit == 0 || Stats_pages_memory <= limit)
+    return;
+  if (!Open_undo_swap_file())
+    return;
+  // Only the compressed pages are moved, starting with the farthest ones.
+  for (distance = list->List_size / 2;
+    distance > UNDO_UNCOMPRESSED_PAGES && Stats_pages_memory > limit;
+    distance--)
+  {
+    T_Page * undo_page = list->Pages;
+    T_Page * redo_page = list->Pages;
+    int i;
+
+    for (i = 0; i < distance; i++)
+    {
+      undo_page = undo_page->Next;
+      redo_page = redo_page->Prev;
+    }
+    if (!Swap_page(undo_page))
+      return;
+    if (redo_page != undo_page && !Swap_page(redo_page))
+      return;
+  }
+}
+
+///
+/// Converts to tiles the layers of all the Undo/Redo pages which are
+/// not used anymore by the current page or the previous one, and
+/// compresses the tiles of the page which just went past
+/// UNDO_UNCOMPRESSED_PAGES steps from the current one.
+static void Tile_history_pages(T_List_of_pages * list)
+{
+  T_Page * page0 = list->Pages;
+  T_Page * page1 = list->Pages->Next;
+  T_Page * page;
+  int page_number = 2;
+
+  if (list->List_size < 3)
+    return;
+  for (page = page1->Next; page != page0; page = page->Next, page_number++)
+  {
+    int distance = Page_distance(list, page_number);
+    int newly_tiled = 0;
+    int i;
+
+    for (i = 0; i < page->Nb_layers; i++)
+    {
+      byte * pixels = page->Image[i].Pixels;
+      T_Tiled_layer * reference;
+      T_Tiled_layer * tiled;
+
+      if (pixels == NULL
+        || Page_uses_bitmap(page0, pixels)
+        || Page_uses_bitmap(page1, pixels))
+        continue;
+      // Share the unmodified tiles with the older page, or the newer one.
+      reference = Tiled_version(page->Next, i, page->Width, page->Height);
+      if (reference == NULL)
+        reference = Tiled_version(page->Prev, i, page->Width, page->Height);
+      tiled = Tile_layer(pixels, page->Width, page->Height, reference);
+      if (tiled == NULL)
+        continue; // Not enough memory : keep the bitmap
+      page->Image[i].Tiled = tiled;
+      page->Image[i].Pixels = NULL;
+      Free_bitmap_layer(pixels);
+      newly_tiled = 1;
+    }
+    // Undo, Redo and Backup move each page by one step at most, so the
+    // farther pages were compressed when they went past this limit.
+    if (distance == UNDO_UNCOMPRESSED_PAGES + 1
+      || (newly_tiled && distance > UNDO_UNCOMPRESSED_PAGES))
+    {
+      for (i = 0; i < page->Nb_layers; i++)
+        if (page->Image[i].Tiled != NULL)
+          Pack_tiled_layer(page->Image[i].Tiled);
+    }
+  }
+  Swap_history_pages(list);
+}
+
 // ==============================================================
 
 /// Adds a shared reference to the gradient data of another page. Pass NULL for new.
@@ -185,6 +810,7 @@ void Download_infos_page_main(T_Page * page)
     Main.image_width=page->Width;
     Main.image_height=page->Height;
     memcpy(Main.palette,page->Palette,sizeof(T_Palette));
+    Palette_generation++;
     Main.fileformat=page->File_format;
 
     if (size_is_modified)
@@ -203,77 +829,97 @@ void Download_infos_page_main(T_Page * page)
   
 }
 
-void Redraw_layered_image(void)
+/// Size (in pixels) of the square tiles used to find which parts of the
+/// flattened image have to be recomposed after an Undo or Redo.
+#define COMPOSITE_TILE_SIZE 64
+
+/// Re-constructs the visible image and the depth buffer, only in the given
+/// rectangle. The rectangle must be inside the image.
+static void Redraw_layered_area(int x, int y, int width, int height)
 {
-  if (Main.backups->Pages->Image_mode != IMAGE_MODE_ANIMATION)
+  T_Page * page = Main.backups->Pages;
+  byte layer=0;
+  int line;
+
+  // First layer
+  if ((page->Image_mode == IMAGE_MODE_MODE5
+      || page->Image_mode == IMAGE_MODE_RASTER) && Main.layers_visible & (1<<4))
   {
-    // Re-construct the image with the visible layers
-    byte layer=0;  
-    // First layer
-    if ((Main.backups->Pages->Image_mode == IMAGE_MODE_MODE5
-		|| Main.backups->Pages->Image_mode == IMAGE_MODE_RASTER) && Main.layers_visible & (1<<4))
+    // The raster result layer is visible: start there
+    for (line = y; line < y + height; line++)
     {
-      // The raster result layer is visible: start there
-      // Copy it in Main_visible_image
+      long offset = (long)line * Main.image_width + x;
       int i;
-      for (i=0; i< Main.image_width*Main.image_height; i++)
+
+      // Copy it in Main_visible_image
+      for (i=0; i<width; i++)
       {
-        layer = *(Main.backups->Pages->Image[4].Pixels+i);
+        layer = *(page->Image[4].Pixels+offset+i);
         if (Main.layers_visible & (1 << layer))
-          Main.visible_image.Image[i]=*(Main.backups->Pages->Image[layer].Pixels+i);
+          Main.visible_image.Image[offset+i]=*(page->Image[layer].Pixels+offset+i);
         else
-          Main.visible_image.Image[i] = layer;
+          Main.visible_image.Image[offset+i] = layer;
       }
-        
       // Copy it to the depth buffer
-      memcpy(Main_visible_image_depth_buffer.Image,
-        Main.backups->Pages->Image[4].Pixels,
-        Main.image_width*Main.image_height);
-        
-      // Next
-      layer= (1<<4)+1;
+      memcpy(Main_visible_image_depth_buffer.Image+offset,
+        page->Image[4].Pixels+offset,
+        width);
     }
-    else
+    // Next
+    layer= (1<<4)+1;
+  }
+  else
+  {
+    for (layer=0; layer<page->Nb_layers; layer++)
     {
-      for (layer=0; layer<Main.backups->Pages->Nb_layers; layer++)
+      if ((1<<layer) & Main.layers_visible)
       {
-        if ((1<<layer) & Main.layers_visible)
+        for (line = y; line < y + height; line++)
         {
-           // Copy it in Main_visible_image
-           memcpy(Main.visible_image.Image,
-             Main.backups->Pages->Image[layer].Pixels,
-             Main.image_width*Main.image_height);
-           
-           // Initialize the depth buffer
-           memset(Main_visible_image_depth_buffer.Image,
-             layer,
-             Main.image_width*Main.image_height);
-           
-           // skip all other layers
-           layer++;
-           break;
+          long offset = (long)line * Main.image_width + x;
+
+          // Copy it in Main_visible_image
+          memcpy(Main.visible_image.Image+offset,
+            page->Image[layer].Pixels+offset,
+            width);
+          // Initialize the depth buffer
+          memset(Main_visible_image_depth_buffer.Image+offset,
+            layer,
+            width);
         }
+        // skip all other layers
+        layer++;
+        break;
       }
     }
-    // subsequent layer(s)
-    for (; layer<Main.backups->Pages->Nb_layers; layer++)
+  }
+  // subsequent layer(s)
+  for (; layer<page->Nb_layers; layer++)
+  {
+    if ((1<<layer) & Main.layers_visible)
     {
-      if ((1<<layer) & Main.layers_visible)
+      for (line = y; line < y + height; line++)
       {
-        int i;
-        for (i=0; i<Main.image_width*Main.image_height; i++)
-        {
-          byte color = *(Main.backups->Pages->Image[layer].Pixels+i);
-          if (color != Main.backups->Pages->Transparent_color) // transparent color
-          {
-            *(Main.visible_image.Image+i) = color;
-            if (layer != Main.current_layer)
-              *(Main_visible_image_depth_buffer.Image+i) = layer;
-          }
-        }
+        long offset = (long)line * Main.image_width + x;
+
+        Blend_layer_line(Main.visible_image.Image+offset,
+          (layer != Main.current_layer) ? Main_visible_image_depth_buffer.Image+offset : NULL,
+          page->Image[layer].Pixels+offset,
+          width,
+          page->Transparent_color,
+          layer);
       }
     }
   }
+}
+
+void Redraw_layered_image(void)
+{
+  if (Main.backups->Pages->Image_mode != IMAGE_MODE_ANIMATION)
+  {
+    // Re-construct the image with the visible layers
+    Redraw_layered_area(0, 0, Main.image_width, Main.image_height);
+  }
   else
   {
     Update_screen_targets();
@@ -281,6 +927,116 @@ void Redraw_layered_image(void)
   Update_FX_feedback(Config.FX_Feedback);
 }
 
+/// Checks if a layer has different pixels in two pages, inside a rectangle.
+static int Layer_area_differs(const byte * pixels1, const byte * pixels2, int x, int y, int width, int height)
+{
+  int line;
+
+  if (pixels1 == pixels2)
+    return 0; // Same bitmap (shared by Undo pages)
+  for (line = y; line < y + height; line++)
+  {
+    long offset = (long)line * Main.image_width + x;
+    if (memcmp(pixels1 + offset, pixels2 + offset, width))
+      return 1;
+  }
+  return 0;
+}
+
+///
+/// Re-constructs the visible image and the depth buffer after the
+/// current page changed from @a previous (Undo, Redo).
+///
+/// Layers which are shared by both pages (same bitmap) are not modified,
+/// so only the tiles where a visible layer has different pixels in both
+/// pages are recomposed.
+/// The visible image must be the one of @a previous, with
+/// @a previous_layers_visible and @a previous_current_layer. Otherwise
+/// (or when the dimensions changed) the whole image is redrawn.
+static void Redraw_layered_image_from_page(const T_Page * previous, dword previous_layers_visible, int previous_current_layer)
+{
+  T_Page * page = Main.backups->Pages;
+  byte * dirty_tiles;
+  int tiles_w, tiles_h;
+  int tile_x, tile_y;
+  int layer;
+  dword changed_layers = 0;
+
+  if (page->Image_mode == IMAGE_MODE_ANIMATION
+    || previous == page
+    || previous->Image_mode != page->Image_mode
+    || previous->Width != page->Width
+    || previous->Height != page->Height
+    || previous->Nb_layers != page->Nb_layers
+    || previous->Transparent_color != page->Transparent_color
+    || previous_layers_visible != Main.layers_visible
+    || previous_current_layer != Main.current_layer)
+  {
+    Redraw_layered_image();
+    return;
+  }
+
+  for (layer = 0; layer < page->Nb_layers; layer++)
+  {
+    if (((1<<layer) & Main.layers_visible)
+      && previous->Image[layer].Pixels != page->Image[layer].Pixels)
+      changed_layers |= 1<<layer;
+  }
+  if (changed_layers == 0)
+  {
+    // Only the palette or other settings differ
+    Update_FX_feedback(Config.FX_Feedback);
+    return;
+  }
+
+  tiles_w = (Main.image_width + COMPOSITE_TILE_SIZE - 1) / COMPOSITE_TILE_SIZE;
+  tiles_h = (Main.image_height + COMPOSITE_TILE_SIZE - 1) / COMPOSITE_TILE_SIZE;
+  dirty_tiles = GFX2_malloc(tiles_w);
+  if (dirty_tiles == NULL)
+  {
+    Redraw_layered_image();
+    return;
+  }
+
+  for (tile_y = 0; tile_y < tiles_h; tile_y++)
+  {
+    int y = tile_y * COMPOSITE_TILE_SIZE;
+    int height = Min(COMPOSITE_TILE_SIZE, Main.image_height - y);
+
+    // Find the tiles of this row that have changed in at least one layer
+    for (tile_x = 0; tile_x < tiles_w; tile_x++)
+    {
+      int x = tile_x * COMPOSITE_TILE_SIZE;
+      int width = Min(COMPOSITE_TILE_SIZE, Main.image_width - x);
+
+      dirty_tiles[tile_x] = 0;
+      for (layer = 0; layer < page->Nb_layers && !dirty_tiles[tile_x]; layer++)
+      {
+        if ((1<<layer) & changed_layers)
+          dirty_tiles[tile_x] = Layer_area_differs(previous->Image[layer].Pixels,
+                                                   page->Image[layer].Pixels,
+                                                   x, y, width, height);
+      }
+    }
+    // Recompose each run of consecutive dirty tiles at once
+    for (tile_x = 0; tile_x < tiles_w; tile_x++)
+    {
+      int run_start;
+
+      if (!dirty_tiles[tile_x])
+        continue;
+      run_start = tile_x;
+      while (tile_x + 1 < tiles_w && dirty_tiles[tile_x + 1])
+        tile_x++;
+      Redraw_layered_area(run_start * COMPOSITE_TILE_SIZE, y,
+        Min((tile_x + 1) * COMPOSITE_TILE_SIZE, Main.image_width) - run_start * COMPOSITE_TILE_SIZE,
+        height);
+    }
+  }
+  free(dirty_tiles);
+  Update_FX_feedback(Config.FX_Feedback);
+}
+
 void Update_depth_buffer(void)
 {
   if (Main.backups->Pages->Image_mode != IMAGE_MODE_ANIMATION)
@@ -314,15 +1070,11 @@ void Update_depth_buffer(void)
         
       if ((1<<layer) & Main.layers_visible)
       {
-        int i;
-        for (i=0; i<Main.image_width*Main.image_height; i++)
-        {
-          byte color = *(Main.backups->Pages->Image[layer].Pixels+i);
-          if (color != Main.backups->Pages->Transparent_color) // transparent color
-          {
-            *(Main_visible_image_depth_buffer.Image+i) = layer;
-          }
-        }
+        Depth_layer_line(Main_visible_image_depth_buffer.Image,
+          Main.backups->Pages->Image[layer].Pixels,
+          Main.image_width*Main.image_height,
+          Main.backups->Pages->Transparent_color,
+          layer);
       }
     }
   }
@@ -360,17 +1112,13 @@ void Redraw_spare_image(void)
     {
       if ((1<<layer) & Spare.layers_visible)
       {
-        int i;
-        for (i=0; i<Spare.image_width*Spare.image_height; i++)
-        {
-          byte color = *(Spare.backups->Pages->Image[layer].Pixels+i);
-          if (color != Spare.backups->Pages->Transparent_color) // transparent color
-          {
-            *(Spare.visible_image.Image+i) = color;
-            //if (layer != Spare.current_layer)
-            //  *(Spare_visible_image_depth_buffer.Image+i) = layer;
-          }
-        }
+        // No depth buffer in the spare
+        Blend_layer_line(Spare.visible_image.Image,
+          NULL,
+          Spare.backups->Pages->Image[layer].Pixels,
+          Spare.image_width*Spare.image_height,
+          Spare.backups->Pages->Transparent_color,
+          layer);
       }
     }
   }
@@ -442,6 +1190,7 @@ void Clear_page(T_Page * page)
   {
     Free_layer(page, i);
     page->Image[i].Pixels=NULL;
+    page->Image[i].Tiled=NULL;
     page->Image[i].Duration=0;
   }
 
@@ -511,7 +1260,7 @@ int Allocate_list_of_pages(T_List_of_pages * list)
 }
 
 
-void Backward_in_list_of_pages(T_List_of_pages * list)
+int Backward_in_list_of_pages(T_List_of_pages * list)
 {
   // Cette fonction fait l'équivalent d'un "Undo" dans la liste de pages.
   // Elle effectue une sorte de ROL (Rotation Left) sur la liste:
@@ -546,12 +1295,19 @@ void Backward_in_list_of_pages(T_List_of_pages * list)
       page0->Prev = page1;
       page1->Next = page0;
       list->Pages = page0;
-      return;
+      return 1;
   }
   list->Pages = list->Pages->Next;
+  if (!Untile_current_pages(list))
+  {
+    // Stay on the page we had: its layers are still bitmaps
+    list->Pages = list->Pages->Prev;
+    return 0;
+  }
+  return 1;
 }
 
-void Advance_in_list_of_pages(T_List_of_pages * list)
+int Advance_in_list_of_pages(T_List_of_pages * list)
 {
   // Cette fonction fait l'équivalent d'un "Redo" dans la liste de pages.
   // Elle effectue une sorte de ROR (Rotation Right) sur la liste:
@@ -585,9 +1341,16 @@ void Advance_in_list_of_pages(T_List_of_pages * list)
       page0->Next = page1;
       page1->Prev = page0;
       list->Pages = page1;
-      return;
+      return 1;
   }
   list->Pages = list->Pages->Prev;
+  if (!Untile_current_pages(list))
+  {
+    // Stay on the page we had: its layers are still bitmaps
+    list->Pages = list->Pages->Next;
+    return 0;
+  }
+  return 1;
 }
 
 void Free_last_page_of_list(T_List_of_pages * list)
@@ -653,6 +1416,9 @@ int Create_new_page(T_Page * new_page, T_List_of_pages * list, int layer)
   list->Pages->Prev = new_page;
   list->Pages = new_page;
   list->List_size++;
+
+  // The page which was previous is now too old to be kept as bitmaps
+  Tile_history_pages(list);
   
   return 1;
 }
@@ -666,7 +1432,7 @@ void Change_page_number_of_list(T_List_of_pages * list,int number)
   }
 }
 
-void Free_page_of_a_list(T_List_of_pages * list)
+int Free_page_of_a_list(T_List_of_pages * list)
 {
   // On ne peut pas détruire la page courante de la liste si après
   // destruction il ne reste pas encore au moins une page.
@@ -674,11 +1440,14 @@ void Free_page_of_a_list(T_List_of_pages * list)
   {
     // On fait faire un undo à la liste, comme ça, la nouvelle page courante
     // est la page précédente
-    Backward_in_list_of_pages(Main.backups);
+    if (!Backward_in_list_of_pages(Main.backups))
+      return 0;
 
     // Puis on détruit la dernière page, qui est l'ancienne page courante
     Free_last_page_of_list(list);
+    Tile_history_pages(list);
   }
+  return 1;
 }
 
 void Update_screen_targets(void)
@@ -1212,6 +1981,10 @@ void Undo(void)
 {
   int width = Main.image_width;
   int height = Main.image_height;
+  T_Page * previous_page;
+  dword layers_visible = Main.layers_visible;
+  int current_layer = Main.current_layer;
+  const byte * layer_pixels;
 
   if (Last_backed_up_layers)
   {
@@ -1223,7 +1996,14 @@ void Undo(void)
   // retrouver plus tard)
   Upload_infos_page(&Main);
   // On fait faire un undo à la liste des backups de la page principale
-  Backward_in_list_of_pages(Main.backups);
+  previous_page = Main.backups->Pages;
+  layer_pixels = previous_page->Image[current_layer].Pixels;
+  if (!Backward_in_list_of_pages(Main.backups))
+  {
+    // The Undo page could not be read back
+    Error(0);
+    return;
+  }
 
   Update_buffers(Main.backups->Pages->Width, Main.backups->Pages->Height);
 
@@ -1235,17 +2015,30 @@ void Undo(void)
   //       poser de problèmes.
   
   Check_layers_limits();
-  Redraw_layered_image();
+  Redraw_layered_image_from_page(previous_page, layers_visible, current_layer);
   End_of_modification();
+  // The page we left is no more needed as bitmaps
+  Tile_history_pages(Main.backups);
 
   if (width != Main.image_width || height != Main.image_height)
     Tilemap_update();
+  else if (Main.current_layer != current_layer
+    || Main.backups->Pages->Image[current_layer].Pixels != layer_pixels)
+  {
+    // The tiles may have changed in any way
+    Tilemap_invalidate();
+    Tilemap_refresh();
+  }
 }
 
 void Redo(void)
 {
   int width = Main.image_width;
   int height = Main.image_height;
+  T_Page * previous_page;
+  dword layers_visible = Main.layers_visible;
+  int current_layer = Main.current_layer;
+  const byte * layer_pixels;
 
   if (Last_backed_up_layers)
   {
@@ -1256,7 +2049,14 @@ void Redo(void)
   // retrouver plus tard)
   Upload_infos_page(&Main);
   // On fait faire un redo à la liste des backups de la page principale
-  Advance_in_list_of_pages(Main.backups);
+  previous_page = Main.backups->Pages;
+  layer_pixels = previous_page->Image[current_layer].Pixels;
+  if (!Advance_in_list_of_pages(Main.backups))
+  {
+    // The Redo page could not be read back
+    Error(0);
+    return;
+  }
 
   Update_buffers(Main.backups->Pages->Width, Main.backups->Pages->Height);
 
@@ -1268,17 +2068,30 @@ void Redo(void)
   //       poser de problèmes.
   
   Check_layers_limits();
-  Redraw_layered_image();
+  Redraw_layered_image_from_page(previous_page, layers_visible, current_layer);
   End_of_modification();
+  // The page we left is no more needed as bitmaps
+  Tile_history_pages(Main.backups);
 
   if (width != Main.image_width || height != Main.image_height)
     Tilemap_update();
+  else if (Main.current_layer != current_layer
+    || Main.backups->Pages->Image[current_layer].Pixels != layer_pixels)
+  {
+    // The tiles may have changed in any way
+    Tilemap_invalidate();
+    Tilemap_refresh();
+  }
 }
 
 void Free_current_page(void)
 {
   // On détruit la page courante de la liste principale
-  Free_page_of_a_list(Main.backups);
+  if (!Free_page_of_a_list(Main.backups))
+  {
+    Error(0);
+    return;
+  }
   
   // On extrait ensuite les infos sur la nouvelle page courante
   Download_infos_page_main(Main.backups->Pages);
@@ -1314,6 +2127,7 @@ void End_of_modification(void)
     Update_screen_targets();
   }
   Update_FX_feedback(Config.FX_Feedback);
+  Tilemap_refresh();
 /*  
   Last_backed_up_layers = 0;
   Backup();
@@ -1373,6 +2187,7 @@ byte Add_layer(T_List_of_pages *list, int layer)
     new_page->Image[i]=new_page->Image[i-1];
   }
   new_page->Image[layer].Pixels=new_image;
+  new_page->Image[layer].Tiled=NULL;
   if (list->Pages->Nb_layers==0)
     duration=100;
   else if (layer>0)
@@ -1484,13 +2299,12 @@ byte Delete_layer(T_List_of_pages *list, int layer)
 /// Merges the current layer onto the one below it.
 byte Merge_layer(void)
 {
-  int i;
-  for (i=0; i<Main.image_width*Main.image_height; i++)
-  {
-    byte color = *(Main.backups->Pages->Image[Main.current_layer].Pixels+i);
-    if (color != Main.backups->Pages->Transparent_color) // transparent color
-      *(Main.backups->Pages->Image[Main.current_layer-1].Pixels+i) = color;
-  }
+  Blend_layer_line(Main.backups->Pages->Image[Main.current_layer-1].Pixels,
+    NULL,
+    Main.backups->Pages->Image[Main.current_layer].Pixels,
+    Main.image_width*Main.image_height,
+    Main.backups->Pages->Transparent_color,
+    Main.current_layer-1);
   return Delete_layer(Main.backups,Main.current_layer);
 }
 
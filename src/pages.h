@@ -72,12 +72,12 @@ void Upload_infos_page(T_Document * doc);
 void Init_list_of_pages(T_List_of_pages * list);
 // private
 int Allocate_list_of_pages(T_List_of_pages * list);
-void Backward_in_list_of_pages(T_List_of_pages * list);
-void Advance_in_list_of_pages(T_List_of_pages * list);
+int Backward_in_list_of_pages(T_List_of_pages * list);
+int Advance_in_list_of_pages(T_List_of_pages * list);
 void Free_last_page_of_list(T_List_of_pages * list);
 int Create_new_page(T_Page * new_page,T_List_of_pages * current_list, int layer);
 void Change_page_number_of_list(T_List_of_pages * list,int number);
-void Free_page_of_a_list(T_List_of_pages * list);
+int Free_page_of_a_list(T_List_of_pages * list);
 
 
 
@@ -108,6 +108,8 @@ void Undo(void);
 void Redo(void);
 void Free_current_page(void); // 'Kill' button
 void End_of_modification(void);
+/// Closes and deletes the swap file of the Undo pages. Call it on program exit.
+void Close_undo_swap_file(void);
 
 void Update_depth_buffer(void);
 void Redraw_layered_image(void);
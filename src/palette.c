@@ -572,6 +572,7 @@ void Set_nice_menu_colors(dword * color_usage,int not_picture)
 
   //   Maintenant qu'on a placé notre nouvelle palette, on va chercher quelles
   // sont les couleurs qui peuvent remplacer les anciennes
+  Palette_generation++;
   Hide_cursor();
   for (index=0; index<4; index++)
     replace_table[new_colors[index]]=Best_color_nonexcluded
@@ -1981,6 +1982,7 @@ void Button_Palette(int btn)
                 Set_nice_menu_colors(color_usage, 0);
                 memcpy(working_palette, Main.palette, sizeof(T_Palette));
                 memcpy(Main.palette, temp_palette, sizeof(T_Palette));
+                Palette_generation++;
             }
 
             Set_palette(working_palette); // On définit la nouvelle palette
@@ -2028,6 +2030,7 @@ void Button_Palette(int btn)
           Set_nice_menu_colors(color_usage,0);
           memcpy(working_palette,Main.palette,sizeof(T_Palette));
           memcpy(Main.palette,temp_palette,sizeof(T_Palette));
+          Palette_generation++;
         }
 
         Set_palette(working_palette);
@@ -2619,6 +2622,7 @@ void Button_Palette(int btn)
         Set_palette(working_palette);
         memcpy(temp_palette,working_palette,sizeof(T_Palette));
         memcpy(Main.palette, backup_palette, sizeof(T_Palette));
+        Palette_generation++;
         need_to_remap=1;
         break;
 
@@ -2628,6 +2632,7 @@ void Button_Palette(int btn)
         memcpy(Main.palette, working_palette, sizeof(T_Palette));
         Save_picture(CONTEXT_PALETTE);
         memcpy(Main.palette, backup_palette, sizeof(T_Palette));
+        Palette_generation++;
         need_to_remap=1;
         break;
 
@@ -2733,6 +2738,7 @@ void Button_Palette(int btn)
           Set_nice_menu_colors(color_usage,0);
           memcpy(working_palette,Main.palette,sizeof(T_Palette));
           memcpy(Main.palette,temp_palette,sizeof(T_Palette));
+          Palette_generation++;
           Set_palette(working_palette);
           memcpy(temp_palette,working_palette,sizeof(T_Palette));
           Draw_all_palette_sliders(red_slider,green_slider,blue_slider,working_palette,block_start,block_end);
@@ -3059,6 +3065,7 @@ void Button_Secondary_palette(int btn)
   if (clicked_button==1)
   {
     Menu_tag_colors("Tag colors to exclude",Exclude_color,&dummy,1, NULL, SPECIAL_EXCLUDE_COLORS_MENU);
+    Palette_generation++;
   }
   else if (clicked_button==2)
   {
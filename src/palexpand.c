@@ -0,0 +1,131 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file palexpand.c
+/// Conversion of 8-bit screen lines to 32-bit true color lines.
+
+#include <stddef.h>
+#include "struct.h"
+#include "gfx2log.h"
+#include "palexpand.h"
+
+// AVX2 is compiled with a function attribute, and checked at run time.
+#if (defined(__x86_64__) || defined(__i386__)) \
+ && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define PALEXPAND_AVX2
+#include <immintrin.h>
+#endif
+
+static void Expand_palette_line_select(dword * dest, const byte * pixels, int width, const dword * palette);
+
+void (*Expand_palette_line)(dword * dest, const byte * pixels, int width, const dword * palette) = Expand_palette_line_select;
+
+// -- Plain C --
+
+static void Expand_palette_line_scalar(dword * dest, const byte * pixels, int width, const dword * palette)
+{
+  int i = 0;
+
+  for (; i + 4 <= width; i += 4)
+  {
+    dest[i] = palette[pixels[i]];
+    dest[i + 1] = palette[pixels[i + 1]];
+    dest[i + 2] = palette[pixels[i + 2]];
+    dest[i + 3] = palette[pixels[i + 3]];
+  }
+  for (; i < width; i++)
+    dest[i] = palette[pixels[i]];
+}
+
+// -- AVX2 : 8 pixels at a time --
+
+#ifdef PALEXPAND_AVX2
+__attribute__((target("avx2")))
+static void Expand_palette_line_avx2(dword * dest, const byte * pixels, int width, const dword * palette)
+{
+  int i = 0;
+
+  for (; i + 8 <= width; i += 8)
+  {
+    // 8 color indexes widened to 32 bits
+    __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(pixels + i)));
+
+    _mm256_storeu_si256((__m256i *)(dest + i), _mm256_i32gather_epi32((const int *)palette, index, 4));
+  }
+  Expand_palette_line_scalar(dest + i, pixels + i, width - i, palette);
+}
+#endif
+
+// -- Selection --
+
+int Select_palette_expand_kernel(enum PALETTE_EXPAND_KERNEL kernel)
+{
+  switch (kernel)
+  {
+    case PALETTE_EXPAND_SCALAR:
+      Expand_palette_line = Expand_palette_line_scalar;
+      return 1;
+#ifdef PALEXPAND_AVX2
+    case PALETTE_EXPAND_AVX2:
+      __builtin_cpu_init();
+      if (!__builtin_cpu_supports("avx2"))
+        return 0;
+      Expand_palette_line = Expand_palette_line_avx2;
+      return 1;
+#endif
+    default:
+      return 0;
+  }
+}
+
+void Select_best_palette_expand_kernel(void)
+{
+  int kernel;
+
+  for (kernel = PALETTE_EXPAND_KERNEL_COUNT - 1; kernel > PALETTE_EXPAND_SCALAR; kernel--)
+  {
+    if (Select_palette_expand_kernel((enum PALETTE_EXPAND_KERNEL)kernel))
+      break;
+  }
+  if (kernel == PALETTE_EXPAND_SCALAR)
+    Select_palette_expand_kernel(PALETTE_EXPAND_SCALAR);
+  GFX2_Log(GFX2_DEBUG, "Palette expansion kernel : %s\n", Palette_expand_kernel_name((enum PALETTE_EXPAND_KERNEL)kernel));
+}
+
+const char * Palette_expand_kernel_name(enum PALETTE_EXPAND_KERNEL kernel)
+{
+  switch (kernel)
+  {
+    case PALETTE_EXPAND_SCALAR:
+      return "scalar";
+    case PALETTE_EXPAND_AVX2:
+      return "AVX2";
+    default:
+      return "?";
+  }
+}
+
+/// Initial value of ::Expand_palette_line : selects the kernel on first use.
+static void Expand_palette_line_select(dword * dest, const byte * pixels, int width, const dword * palette)
+{
+  Select_best_palette_expand_kernel();
+  Expand_palette_line(dest, pixels, width, palette);
+}
@@ -0,0 +1,60 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file palexpand.h
+/// Conversion of 8-bit screen lines to 32-bit true color lines.
+///
+/// The kernel exists in a plain C version, and in an AVX2 version
+/// (8 palette lookups with one gather instruction) on x86 CPUs.
+/// The fastest version supported by the CPU is selected the first time
+/// the kernel is called.
+
+#ifndef PALEXPAND_H_INCLUDED
+#define PALEXPAND_H_INCLUDED
+
+#include "struct.h"
+
+/// Implementations of the palette expansion kernel
+enum PALETTE_EXPAND_KERNEL
+{
+  PALETTE_EXPAND_SCALAR = 0, ///< Plain C, four pixels per loop
+  PALETTE_EXPAND_AVX2,       ///< 8 pixels at a time
+  PALETTE_EXPAND_KERNEL_COUNT
+};
+
+///
+/// Writes palette[pixels[i]] in dest[i] for each of the @a width pixels.
+/// @a palette holds the 32-bit value of each of the 256 colors, in the
+/// format of the destination.
+extern void (*Expand_palette_line)(dword * dest, const byte * pixels, int width, const dword * palette);
+
+///
+/// Selects an implementation for ::Expand_palette_line.
+/// @return 1 on success, 0 if it is not supported by the CPU or the build.
+int Select_palette_expand_kernel(enum PALETTE_EXPAND_KERNEL kernel);
+
+/// Selects the fastest supported implementation.
+void Select_best_palette_expand_kernel(void);
+
+/// Name of an implementation, for logs and benchmarks.
+const char * Palette_expand_kernel_name(enum PALETTE_EXPAND_KERNEL kernel);
+
+#endif
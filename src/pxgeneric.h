@@ -0,0 +1,443 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2008 Yves Rizoud
+    Copyright 2008 Franck Charlet
+    Copyright 2007 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+//////////////////////////////////////////////////////////////////////////////
+///@file pxgeneric.h
+/// Generic renderer, for pixels of ZOOMX x ZOOMY screen pixels.
+///
+/// This file is not a normal header : it is included once by each of
+/// the pxsimple.c, pxtall.c, ... files, after defining ZOOMX, ZOOMY and
+/// PX_SUFFIX. It defines all the functions of the renderer, with names
+/// ending with _PX_SUFFIX (Pixel_double, Block_double, ...).
+///
+/// As ZOOMX and ZOOMY are constants, the compiler unrolls the loops
+/// which replicate the pixels, so each ratio gets its own specialized
+/// code. Opaque lines are replicated with Zoom_a_line().
+//////////////////////////////////////////////////////////////////////////////
+
+#if !defined(ZOOMX) || !defined(ZOOMY) || !defined(PX_SUFFIX)
+#error "ZOOMX, ZOOMY and PX_SUFFIX must be defined before including pxgeneric.h"
+#endif
+
+#include <string.h>
+#include "global.h"
+#include "screen.h"
+#include "misc.h"
+#include "graph.h"
+#include "zoomline.h"
+
+#define PX_CONCAT(name,suffix) name##_##suffix
+#define PX_EXPAND(name,suffix) PX_CONCAT(name,suffix)
+/// Name of a function of the renderer : PX_FUNC(Pixel) is Pixel_double, etc.
+#define PX_FUNC(name) PX_EXPAND(name,PX_SUFFIX)
+
+/// Writes a line of pixels on a screen line, each pixel ZOOMX times.
+/// The pixels of color transp_color are skipped.
+static void PX_FUNC(Zoom_line_transparent)(byte * dest, const byte * src, int width, byte transp_color)
+{
+  int x, i;
+
+  for (x = 0; x < width; x++)
+  {
+    if (src[x] != transp_color)
+      for (i = 0; i < ZOOMX; i++)
+        dest[i] = src[x];
+    dest += ZOOMX;
+  }
+}
+
+/// Writes color for each pixel of the line which is not transp_color,
+/// each pixel ZOOMX times.
+static void PX_FUNC(Zoom_line_mono)(byte * dest, const byte * src, int width, byte transp_color, byte color)
+{
+  int x, i;
+
+  for (x = 0; x < width; x++)
+  {
+    if (src[x] != transp_color)
+      for (i = 0; i < ZOOMX; i++)
+        dest[i] = color;
+    dest += ZOOMX;
+  }
+}
+
+/// Copies the screen line y on the ZOOMY-1 following lines.
+/// x and width are in screen pixels.
+static void PX_FUNC(Copy_line_down)(int x, int y, int width)
+{
+#if ZOOMY > 1
+  const byte * src = Get_Screen_pixel_ptr(x, y);
+  int i;
+
+  for (i = 1; i < ZOOMY; i++)
+    memcpy(Get_Screen_pixel_ptr(x, y + i), src, width);
+#else
+  (void)x;
+  (void)y;
+  (void)width;
+#endif
+}
+
+void PX_FUNC(Pixel) (word x,word y,byte color)
+/* Affiche un pixel de la color aux coords x;y à l'écran */
+{
+  int dx, dy;
+
+  for (dy = 0; dy < ZOOMY; dy++)
+    for (dx = 0; dx < ZOOMX; dx++)
+      Set_Screen_pixel(x * ZOOMX + dx, y * ZOOMY + dy, color);
+}
+
+byte PX_FUNC(Read_pixel) (word x,word y)
+/* On retourne la couleur du pixel aux coords données */
+{
+  return Get_Screen_pixel(x * ZOOMX, y * ZOOMY);
+}
+
+void PX_FUNC(Block) (word start_x,word start_y,word width,word height,byte color)
+/* On affiche un rectangle de la couleur donnée */
+{
+  Screen_FillRect(start_x * ZOOMX, start_y * ZOOMY, width * ZOOMX, height * ZOOMY, color);
+}
+
+void PX_FUNC(Display_part_of_screen) (word width,word height,word image_width)
+/* Afficher une partie de l'image telle quelle sur l'écran */
+{
+  const byte * src = Main.offset_Y*image_width+Main.offset_X+Main_screen; //Coords de départ ds la source (src)
+  int y;
+
+  for (y = 0; y < height; y++)
+  {
+    Zoom_a_line(src, Get_Screen_pixel_ptr(0, y * ZOOMY), ZOOMX, width);
+    PX_FUNC(Copy_line_down)(0, y * ZOOMY, width * ZOOMX);
+    src += image_width;
+  }
+  //Update_rect(0,0,width,height);
+}
+
+void PX_FUNC(Pixel_preview_normal) (word x,word y,byte color)
+/* Affichage d'un pixel dans l'écran, par rapport au décalage de l'image
+ * dans l'écran, en mode normal (pas en mode loupe)
+ * Note: si on modifie cette procédure, il faudra penser à faire également
+ * la modif dans la procédure Pixel_Preview_Loupe_SDL. */
+{
+  PX_FUNC(Pixel)(x-Main.offset_X,y-Main.offset_Y,color);
+}
+
+void PX_FUNC(Pixel_preview_magnifier) (word x,word y,byte color)
+{
+  // Affiche le pixel dans la partie non zoomée
+  PX_FUNC(Pixel)(x-Main.offset_X,y-Main.offset_Y,color);
+
+  // Regarde si on doit aussi l'afficher dans la partie zoomée
+  if (y >= Limit_top_zoom && y <= Limit_visible_bottom_zoom
+          && x >= Limit_left_zoom && x <= Limit_visible_right_zoom)
+  {
+    // On est dedans
+    int height;
+    int y_zoom = Main.magnifier_factor * (y-Main.magnifier_offset_Y);
+
+    if (Menu_Y - y_zoom < Main.magnifier_factor)
+      // On ne doit dessiner qu'un morceau du pixel
+      // sinon on dépasse sur le menu
+      height = Menu_Y - y_zoom;
+    else
+      height = Main.magnifier_factor;
+
+    PX_FUNC(Block)(
+      Main.magnifier_factor * (x-Main.magnifier_offset_X) + Main.X_zoom,
+      y_zoom, Main.magnifier_factor, height, color
+      );
+  }
+}
+
+void PX_FUNC(Horizontal_XOR_line) (word x_pos,word y_pos,word width)
+{
+  byte * dest = Get_Screen_pixel_ptr(x_pos * ZOOMX, y_pos * ZOOMY);
+  int x, i;
+
+  for (x = 0; x < width; x++)
+  {
+    byte color = xor_lut[*dest];
+    for (i = 0; i < ZOOMX; i++)
+      dest[i] = color;
+    dest += ZOOMX;
+  }
+  PX_FUNC(Copy_line_down)(x_pos * ZOOMX, y_pos * ZOOMY, width * ZOOMX);
+}
+
+void PX_FUNC(Vertical_XOR_line) (word x_pos,word y_pos,word height)
+{
+  int i;
+
+  for (i = 0; i < height; i++)
+    PX_FUNC(Pixel)(x_pos, y_pos + i, xor_lut[Get_Screen_pixel(x_pos * ZOOMX, (y_pos + i) * ZOOMY)]);
+}
+
+// Affiche une brosse (arbitraire) à l'écran
+void PX_FUNC(Display_brush) (byte * brush, word x_pos,word y_pos,word x_offset,word y_offset,word width,word height,byte transp_color,word brush_width)
+{
+  // src = Position dans la brosse
+  const byte * src = brush + y_offset * brush_width + x_offset;
+  int y, dy;
+
+  for (y = 0; y < height; y++)
+  {
+    for (dy = 0; dy < ZOOMY; dy++)
+      PX_FUNC(Zoom_line_transparent)(Get_Screen_pixel_ptr(x_pos * ZOOMX, (y_pos + y) * ZOOMY + dy), src, width, transp_color);
+    src += brush_width;
+  }
+}
+
+void PX_FUNC(Display_brush_color) (word x_pos,word y_pos,word x_offset,word y_offset,word width,word height,byte transp_color,word brush_width)
+{
+  PX_FUNC(Display_brush)(Brush, x_pos, y_pos, x_offset, y_offset, width, height, transp_color, brush_width);
+  Update_rect(x_pos,y_pos,width,height);
+}
+
+void PX_FUNC(Display_brush_mono) (word x_pos, word y_pos,
+        word x_offset, word y_offset, word width, word height,
+        byte transp_color, byte color, word brush_width)
+/* On affiche la brosse en monochrome */
+{
+  const byte * src = brush_width*y_offset+x_offset+Brush;
+  int y, dy;
+
+  for (y = 0; y < height; y++)
+  {
+    for (dy = 0; dy < ZOOMY; dy++)
+      PX_FUNC(Zoom_line_mono)(Get_Screen_pixel_ptr(x_pos * ZOOMX, (y_pos + y) * ZOOMY + dy), src, width, transp_color, color);
+    src += brush_width;
+  }
+  Update_rect(x_pos,y_pos,width,height);
+}
+
+void PX_FUNC(Clear_brush) (word x_pos,word y_pos,word x_offset,word y_offset,word width,word height,byte transp_color,word image_width)
+{
+  const byte * src = ( y_pos + Main.offset_Y ) * image_width + x_pos + Main.offset_X + Main_screen; //Coords de départ ds la source (src)
+  int y;
+  (void)x_offset; // unused
+  (void)y_offset; // unused
+  (void)transp_color; // unused
+
+  for (y = 0; y < height; y++)
+  {
+    Zoom_a_line(src, Get_Screen_pixel_ptr(x_pos * ZOOMX, (y_pos + y) * ZOOMY), ZOOMX, width);
+    PX_FUNC(Copy_line_down)(x_pos * ZOOMX, (y_pos + y) * ZOOMY, width * ZOOMX);
+    src += image_width;
+  }
+  Update_rect(x_pos,y_pos,width,height);
+}
+
+void PX_FUNC(Remap_screen) (word x_pos,word y_pos,word width,word height,byte * conversion_table)
+{
+  int x, y, i;
+
+  for (y = 0; y < height; y++)
+  {
+    byte * dest = Get_Screen_pixel_ptr(x_pos * ZOOMX, (y_pos + y) * ZOOMY);
+
+    for (x = 0; x < width; x++)
+    {
+      byte color = conversion_table[*dest];
+      for (i = 0; i < ZOOMX; i++)
+        dest[i] = color;
+      dest += ZOOMX;
+    }
+    PX_FUNC(Copy_line_down)(x_pos * ZOOMX, (y_pos + y) * ZOOMY, width * ZOOMX);
+  }
+  Update_rect(x_pos,y_pos,width,height);
+}
+
+void PX_FUNC(Display_line_on_screen) (word x_pos,word y_pos,word width,byte * line)
+/* On affiche une ligne de pixels en les répétant ZOOMX fois. */
+{
+  byte * dest = Get_Screen_pixel_ptr(x_pos * ZOOMX, y_pos * ZOOMY);
+
+  if (dest != NULL)
+  {
+    Zoom_a_line(line, dest, ZOOMX, width);
+    PX_FUNC(Copy_line_down)(x_pos * ZOOMX, y_pos * ZOOMY, width * ZOOMX);
+  }
+}
+
+void PX_FUNC(Display_line_on_screen_fast) (word x_pos,word y_pos,word width,byte * line)
+/* On affiche toute une ligne de pixels telle quelle. */
+/* Utilisée si le buffer contient déja des pixels répétés ZOOMX fois. */
+{
+  int dy;
+
+  for (dy = 0; dy < ZOOMY; dy++)
+    memcpy(Get_Screen_pixel_ptr(x_pos * ZOOMX, y_pos * ZOOMY + dy), line, width * ZOOMX);
+}
+
+void PX_FUNC(Read_line_screen) (word x_pos,word y_pos,word width,byte * line)
+{
+  memcpy(line, Get_Screen_pixel_ptr(x_pos * ZOOMX, y_pos * ZOOMY), width * ZOOMX);
+}
+
+void PX_FUNC(Display_part_of_screen_scaled) (
+        word width, // width non zoomée
+        word height, // height zoomée
+        word image_width,byte * buffer)
+{
+  const byte * src = Main_screen + Main.magnifier_offset_Y * image_width
+                      + Main.magnifier_offset_X;
+  int y = 0; // Ligne en cours de traitement
+
+  // Pour chaque ligne à zoomer
+  while(1)
+  {
+    int x;
+
+    // On éclate la ligne
+    Zoom_a_line(src,buffer,Main.magnifier_factor*ZOOMX,width);
+    // On l'affiche Facteur fois, sur des lignes consécutives
+    x = Main.magnifier_factor;
+    do{
+      PX_FUNC(Display_line_on_screen_fast)(
+        Main.X_zoom, y, width*Main.magnifier_factor,
+        buffer
+      );
+      y++;
+      if(y==height)
+      {
+        Redraw_grid(Main.X_zoom,0,
+          width*Main.magnifier_factor,height);
+        Update_rect(Main.X_zoom,0,
+          width*Main.magnifier_factor,height);
+        return;
+      }
+      x--;
+    }while (x > 0);
+    src += image_width;
+  }
+}
+
+// Affiche une partie de la brosse couleur zoomée
+void PX_FUNC(Display_brush_color_zoom) (word x_pos,word y_pos,
+        word x_offset,word y_offset,
+        word width, // width non zoomée
+        word end_y_pos,byte transp_color,
+        word brush_width, // width réelle de la brosse
+        byte * buffer)
+{
+  const byte * src = Brush+y_offset*brush_width + x_offset;
+  int y = y_pos;
+  int bx, dy;
+
+  // Pour chaque ligne
+  while(1)
+  {
+    Zoom_a_line(src,buffer,Main.magnifier_factor,width);
+    // On affiche facteur fois la ligne zoomée
+    for(bx=Main.magnifier_factor;bx>0;bx--)
+    {
+      for (dy = 0; dy < ZOOMY; dy++)
+        PX_FUNC(Zoom_line_transparent)(Get_Screen_pixel_ptr(x_pos * ZOOMX, y * ZOOMY + dy),
+          buffer, width * Main.magnifier_factor, transp_color);
+      y++;
+      if(y==end_y_pos)
+        return;
+    }
+    src += brush_width;
+  }
+}
+
+void PX_FUNC(Display_brush_mono_zoom) (word x_pos, word y_pos,
+        word x_offset, word y_offset,
+        word width, // width non zoomée
+        word end_y_pos,
+        byte transp_color, byte color,
+        word brush_width, // width réelle de la brosse
+        byte * buffer
+)
+{
+  const byte * src = Brush + y_offset * brush_width + x_offset;
+  int y = y_pos;
+  int bx, dy;
+
+  //Pour chaque ligne à zoomer :
+  while(1)
+  {
+    // On éclate la ligne
+    Zoom_a_line(src,buffer,Main.magnifier_factor,width);
+
+    // On affiche la ligne Facteur fois à l'écran (sur des
+    // lignes consécutives)
+    for(bx=Main.magnifier_factor;bx>0;bx--)
+    {
+      for (dy = 0; dy < ZOOMY; dy++)
+        PX_FUNC(Zoom_line_mono)(Get_Screen_pixel_ptr(x_pos * ZOOMX, y * ZOOMY + dy),
+          buffer, width * Main.magnifier_factor, transp_color, color);
+      y++;
+      // On vérifie qu'on est pas à la ligne finale
+      if(y == end_y_pos)
+      {
+        Redraw_grid( x_pos, y_pos,
+          width * Main.magnifier_factor, end_y_pos - y_pos );
+        Update_rect( x_pos, y_pos,
+          width * Main.magnifier_factor, end_y_pos - y_pos );
+        return;
+      }
+    }
+    // Passage à la ligne suivante dans la brosse aussi
+    src+=brush_width;
+  }
+}
+
+void PX_FUNC(Clear_brush_scaled) (word x_pos,word y_pos,word x_offset,word y_offset,word width,word end_y_pos,byte transp_color,word image_width,byte * buffer)
+{
+  // En fait on va recopier l'image non zoomée dans la partie zoomée !
+  const byte * src = Main_screen + y_offset * image_width + x_offset;
+  int y = y_pos;
+  int bx;
+  (void)transp_color; // unused
+
+  // Pour chaque ligne à zoomer
+  while(1){
+    Zoom_a_line(src,buffer,Main.magnifier_factor*ZOOMX,width);
+
+    bx=Main.magnifier_factor;
+
+    // Pour chaque ligne
+    do{
+      PX_FUNC(Display_line_on_screen_fast)(x_pos,y,
+        width * Main.magnifier_factor,buffer);
+
+      // Ligne suivante
+      y++;
+      if(y==end_y_pos)
+      {
+        Redraw_grid(x_pos,y_pos,
+          width*Main.magnifier_factor,end_y_pos-y_pos);
+        Update_rect(x_pos,y_pos,
+          width*Main.magnifier_factor,end_y_pos-y_pos);
+        return;
+      }
+      bx--;
+    }while(bx!=0);
+
+    src+= image_width;
+  }
+}
@@ -47,7 +47,4 @@
   void Clear_brush_scaled_simple           (word x_pos,word y_pos,word x_offset,word y_offset,word width,word end_y_pos,byte transp_color,word image_width,byte * buffer);
   void Display_brush_simple             (byte * brush, word x_pos,word y_pos,word x_offset,word y_offset,word width,word height,byte transp_color,word brush_width);
 
-void Display_transparent_mono_line_on_screen_simple(
-        word x_pos, word y_pos, word width, byte* line, 
-        byte transp_color, byte color);
-void Display_transparent_line_on_screen_simple(word x_pos,word y_pos,word width,byte* line,byte transp_color);
+  void Display_line_on_screen_fast_simple   (word x_pos,word y_pos,word width,byte * line);
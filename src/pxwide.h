@@ -48,4 +48,3 @@
   void Display_brush_wide             (byte * brush, word x_pos,word y_pos,word x_offset,word y_offset,word width,word height,byte transp_color,word brush_width);
 
   void Display_line_on_screen_fast_wide   (word x_pos,word y_pos,word width,byte * line);
-  void Display_transparent_line_on_screen_wide(word x_pos,word y_pos,word width,byte* line,byte transp_color);
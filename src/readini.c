@@ -1057,6 +1057,28 @@ int Load_INI(T_Config * conf)
   {
     conf->MOTO_gamma=(byte)values[0];
   }
+
+  conf->Undo_memory_limit=1024;
+  // Optional, memory used by Undo pages before using a swap file (>=2.7)
+  if (!Load_INI_get_values (file,buffer,"Undo_memory_limit",1,values))
+  {
+    if (values[0]>=0 && values[0]<=65535)
+      conf->Undo_memory_limit=(word)values[0];
+  }
+  
+  conf->Tilemap_show_stats=0;
+  // Optional, shows the number of unique tiles in the status bar (>=2.7)
+  if (!Load_INI_get_values (file,buffer,"Tilemap_stats",1,values))
+  {
+    conf->Tilemap_show_stats=(values[0]!=0);
+  }
+  
+  conf->Lua_keep_state=0;
+  // Optional, keeps the Lua state between scripts of a directory (>=2.7)
+  if (!Load_INI_get_values (file,buffer,"Lua_keep_state",1,values))
+  {
+    conf->Lua_keep_state=(values[0]!=0);
+  }
   
   // Insert new values here
 
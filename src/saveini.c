@@ -774,6 +774,18 @@ int Save_INI(const T_Config * conf)
   if ((return_code=Save_INI_set_values (old_file,new_file,buffer,"MOTO_gamma",1,values,0)))
     goto Erreur_Retour;
 
+  values[0]=conf->Undo_memory_limit;
+  if ((return_code=Save_INI_set_values (old_file,new_file,buffer,"Undo_memory_limit",1,values,0)))
+    goto Erreur_Retour;
+
+  values[0]=conf->Tilemap_show_stats;
+  if ((return_code=Save_INI_set_values (old_file,new_file,buffer,"Tilemap_stats",1,values,1)))
+    goto Erreur_Retour;
+
+  values[0]=conf->Lua_keep_state;
+  if ((return_code=Save_INI_set_values (old_file,new_file,buffer,"Lua_keep_state",1,values,1)))
+    goto Erreur_Retour;
+
   // Insert new values here
   
   Save_INI_flush(old_file, new_file, buffer);
@@ -46,6 +46,12 @@
 
 void GFX2_Set_mode(int *width, int *height, int fullscreen);
 
+///
+/// Keeps the screen in memory only, without opening a window.
+/// Used by the command line batch modes. Must be called before the video
+/// initialization: with SDL, it selects the "dummy" video driver.
+void GFX2_Set_headless(void);
+
 byte Get_Screen_pixel(int x, int y);
 
 void Set_Screen_pixel(int x, int y, byte value);
@@ -72,7 +78,16 @@ extern volatile int Allow_colorcycling;
 void Allow_drag_and_drop(int flag);
 
 #if defined(USE_SDL2)
+///
+/// Commits the pending updates and presents the screen, at most once
+/// per refresh of the display. When called too early, the updates wait
+/// for a later call.
 void GFX2_UpdateScreen(void);
+
+///
+/// Time to wait before GFX2_UpdateScreen() can present the pending
+/// updates, in ms. Returns -1 when there is nothing to present.
+int GFX2_Frame_delay(void);
 #endif
 
 #if defined(WIN32)
@@ -37,10 +37,15 @@
 
 #include "global.h"
 #include "sdlscreen.h"
+#include "screen.h"
 #include "errors.h"
 #include "misc.h"
 #include "gfx2log.h"
 #include "io.h"
+#include "dirtyrect.h"
+#if defined(USE_SDL2)
+#include "palexpand.h"
+#endif
 
 // Update method that does a large number of small rectangles, aiming
 // for a minimum number of total pixels updated.
@@ -50,6 +55,9 @@
 #define UPDATE_METHOD_CUMULATED       2
 // Total screen update, for platforms that impose a Vsync on each SDL update.
 #define UPDATE_METHOD_FULL_PAGE       3
+// List of rectangles, updated once per frame. Close rectangles are merged
+// when it costs less than updating them separately (see dirtyrect.h).
+#define UPDATE_METHOD_DIRTY_REGION    4
 
 // UPDATE_METHOD can be set from makefile, otherwise it's selected here
 // depending on the platform :
@@ -65,7 +73,7 @@
   #elif defined(__SWITCH__)
     #define UPDATE_METHOD     UPDATE_METHOD_CUMULATED
   #else
-    #define UPDATE_METHOD     UPDATE_METHOD_CUMULATED
+    #define UPDATE_METHOD     UPDATE_METHOD_DIRTY_REGION
   #endif
 #endif
 
@@ -75,6 +83,29 @@ static SDL_Window * Window_SDL = NULL;
 static SDL_Renderer * Renderer_SDL = NULL;
 static SDL_Texture * Texture_SDL = NULL;
 static SDL_Surface * icon = NULL;
+
+/// ARGB8888 value of each color of the palette, as written in the texture
+static dword Palette_ARGB[256];
+
+#endif
+
+/// Number of pixels which cost about as much to update as one more
+/// rectangle : below this, close rectangles are merged.
+#define UPDATE_RECT_OVERHEAD 4096
+
+#if defined(USE_SDL2)
+/// Rectangles of Screen_SDL modified since the last GFX2_UpdateScreen()
+static T_Dirty_region Pending_region = { 0, UPDATE_RECT_OVERHEAD, {{0, 0, 0, 0}} };
+
+/// Time between two refreshes of the display, in SDL_GetPerformanceCounter() units
+static Uint64 Frame_duration = 0;
+/// SDL_GetPerformanceCounter() of the last SDL_RenderPresent()
+static Uint64 Last_present_time = 0;
+
+/// Counters for the debug log, over about one second
+static dword Present_stats_start = 0;
+static unsigned int Present_stats_frames = 0;
+static unsigned int Present_stats_delayed = 0;
 #endif
 
 volatile int Allow_colorcycling=1;
@@ -119,6 +150,16 @@ void Screen_FillRect(int x, int y, int w, int h, byte color)
   SDL_FillRect(Screen_SDL,&rectangle,color);
 }
 
+void GFX2_Set_headless(void)
+{
+#if defined(USE_SDL2)
+  SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+#else
+  static char variable[] = "SDL_VIDEODRIVER=dummy";
+  SDL_putenv(variable);
+#endif
+}
+
 /// Sets the new screen/window dimensions.
 void GFX2_Set_mode(int *width, int *height, int fullscreen)
 {
@@ -161,12 +202,27 @@ void GFX2_Set_mode(int *width, int *height, int fullscreen)
     SDL_SetWindowFullscreen(Window_SDL, fullscreen?SDL_WINDOW_FULLSCREEN:0);
   }
   //SDL_GetWindowSize(Window_SDL, width, height);
+  {
+    SDL_DisplayMode mode;
+
+    int refresh_rate = 60;
+
+    // The screen is presented at most once per refresh of the display.
+    // The performance counter keeps the exact period : 1000/refresh_rate ms
+    // would be rounded down, and let a few more frames per second through.
+    if (SDL_GetWindowDisplayMode(Window_SDL, &mode) == 0 && mode.refresh_rate > 0)
+      refresh_rate = mode.refresh_rate;
+    Frame_duration = SDL_GetPerformanceFrequency() / refresh_rate;
+    GFX2_Log(GFX2_DEBUG, "Presenting the screen at most %d times per second\n", refresh_rate);
+  }
   if (Texture_SDL != NULL)
     SDL_DestroyTexture(Texture_SDL);
   Texture_SDL = SDL_CreateTexture(Renderer_SDL, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, *width, *height);
   if (Screen_SDL != NULL)
     SDL_FreeSurface(Screen_SDL);
   Screen_SDL = SDL_CreateRGBSurface(0, *width, *height, 8, 0, 0, 0, 0);
+  // the pending rectangles were for the previous size
+  Dirty_region_clear(&Pending_region);
 #endif
 
   // Trick borrowed to Barrage (http://www.mail-archive.com/debian-bugs-dist@lists.debian.org/msg737265.html) :
@@ -188,52 +244,114 @@ void GFX2_Set_mode(int *width, int *height, int fullscreen)
 }
 
 #if defined(USE_SDL2)
-static void GFX2_UpdateRect(int x, int y, int width, int height)
+/// Converts a rectangle of the 8-bit Screen_SDL, directly in the locked
+/// ARGB texture.
+static void Upload_rect(const T_Dirty_rect * dirty)
 {
   byte * pixels;
   int pitch;
   int line;
-  static SDL_Surface *RGBcopy = NULL;
-  SDL_Rect source_rect;
-
-  source_rect.x = x;
-  source_rect.y = y;
-  if (width == 0 && height == 0) {
-    source_rect.w = Screen_SDL->w;
-    source_rect.h = Screen_SDL->h;
-  } else {
-    source_rect.w = width;
-    source_rect.h = height;
+  SDL_Rect rect;
+  const byte * src = (const byte *)Screen_SDL->pixels + dirty->y * Screen_SDL->pitch + dirty->x;
+
+  rect.x = dirty->x;
+  rect.y = dirty->y;
+  rect.w = dirty->w;
+  rect.h = dirty->h;
+  if (SDL_LockTexture(Texture_SDL, &rect, (void **)(&pixels), &pitch) < 0)
+  {
+    GFX2_Log(GFX2_WARNING, "SDL_LockTexture failed : %s\n", SDL_GetError());
+    return;
   }
-
-  if (RGBcopy != NULL && (Screen_SDL->w > RGBcopy->w || Screen_SDL->h > RGBcopy->h))
+  for (line = 0; line < rect.h; line++)
   {
-    SDL_FreeSurface(RGBcopy);
-    RGBcopy = NULL;
+    Expand_palette_line((dword *)(pixels + line * pitch), src, rect.w, Palette_ARGB);
+    src += Screen_SDL->pitch;
   }
+  SDL_UnlockTexture(Texture_SDL);
+}
 
-  if (RGBcopy == NULL)
+/// Marks a rectangle of the screen (in real pixels) to be copied to the
+/// texture before the next GFX2_UpdateScreen().
+/// The rectangles which overlap are merged, so each pixel is
+/// converted only once per frame.
+static void GFX2_UpdateRect(int x, int y, int width, int height)
+{
+  if (Screen_SDL == NULL)
+    return;
+  if (width == 0 && height == 0)
   {
-    RGBcopy = SDL_CreateRGBSurface(0,
-    Screen_SDL->w, Screen_SDL->h,
-    32, 0, 0, 0, 0);
+    x = 0;
+    y = 0;
+    width = Screen_SDL->w;
+    height = Screen_SDL->h;
   }
-  // conversion ARGB
-  SDL_BlitSurface(Screen_SDL, &source_rect, RGBcopy, &source_rect);
-  // upload texture
-  SDL_LockTexture(Texture_SDL, &source_rect, (void **)(&pixels), &pitch );
-  for (line = 0; line < source_rect.h; line++)
+  // clip to the screen
+  if (x < 0)
   {
-     memcpy(pixels + line * pitch, (const byte *)RGBcopy->pixels + source_rect.x * 4 + (source_rect.y+line)* RGBcopy->pitch, source_rect.w * 4 );
+    width += x;
+    x = 0;
   }
-  SDL_UnlockTexture(Texture_SDL);
-  //SDL_RenderCopy(Renderer_SDL, Texture_SDL, &source_rect, &source_rect);
+  if (y < 0)
+  {
+    height += y;
+    y = 0;
+  }
+  if (x + width > Screen_SDL->w)
+    width = Screen_SDL->w - x;
+  if (y + height > Screen_SDL->h)
+    height = Screen_SDL->h - y;
+  Dirty_region_add(&Pending_region, x, y, width, height);
 }
 
 void GFX2_UpdateScreen(void)
 {
+  int i;
+  Uint64 now;
+  dword ticks;
+
+  Flush_update();
+  if (Pending_region.count == 0)
+    return; // Nothing new to show
+  now = SDL_GetPerformanceCounter();
+  if (now - Last_present_time < Frame_duration)
+  {
+    // Too early : the updates wait for the next refresh of the display
+    Present_stats_delayed++;
+    return;
+  }
+  for (i = 0; i < Pending_region.count; i++)
+    Upload_rect(Pending_region.rects + i);
+  Dirty_region_clear(&Pending_region);
   SDL_RenderCopy(Renderer_SDL, Texture_SDL, NULL, NULL);
   SDL_RenderPresent(Renderer_SDL);
+  Last_present_time = now;
+
+  Present_stats_frames++;
+  ticks = GFX2_GetTicks();
+  if (ticks - Present_stats_start >= 1000)
+  {
+    GFX2_Log(GFX2_DEBUG, "%u frames presented in %ums, %u delayed to the next refresh\n",
+             Present_stats_frames, (unsigned)(ticks - Present_stats_start), Present_stats_delayed);
+    Present_stats_start = ticks;
+    Present_stats_frames = 0;
+    Present_stats_delayed = 0;
+  }
+}
+
+int GFX2_Frame_delay(void)
+{
+  Uint64 elapsed;
+  Uint64 frequency;
+
+  if (Pending_region.count == 0)
+    return -1;
+  elapsed = SDL_GetPerformanceCounter() - Last_present_time;
+  if (elapsed >= Frame_duration)
+    return 0;
+  // Rounded up, so the caller doesn't wake up just before the refresh
+  frequency = SDL_GetPerformanceFrequency();
+  return (int)(((Frame_duration - elapsed) * 1000 + frequency - 1) / frequency);
 }
 #endif
 
@@ -250,6 +368,16 @@ short Status_line_dirty_end=0;
   int update_is_required=0;
 #endif
 
+#if (UPDATE_METHOD == UPDATE_METHOD_DIRTY_REGION)
+/// Rectangles modified since the last Flush_update(), in real pixels
+static T_Dirty_region Dirty_region = { 0, UPDATE_RECT_OVERHEAD, {{0, 0, 0, 0}} };
+/// Counters for the debug log, over about one second
+static dword Update_stats_start = 0;
+static unsigned long Update_count = 0;    ///< Flush_update() which updated something
+static unsigned long Update_rects = 0;    ///< Rectangles updated
+static unsigned long long Update_pixels = 0; ///< Pixels updated
+#endif
+
 void Flush_update(void)
 {
 #if (UPDATE_METHOD == UPDATE_METHOD_FULL_PAGE)
@@ -299,6 +427,47 @@ void Flush_update(void)
 
     #endif
 
+#if (UPDATE_METHOD == UPDATE_METHOD_DIRTY_REGION)
+  if (Dirty_region.count > 0)
+  {
+    int i;
+    dword now;
+
+    for (i = 0; i < Dirty_region.count; i++)
+    {
+      const T_Dirty_rect * rect = Dirty_region.rects + i;
+      // clip to the screen
+      int x = Max(rect->x, 0);
+      int y = Max(rect->y, 0);
+      int w = Min(rect->x + rect->w, Screen_width*Pixel_width) - x;
+      int h = Min(rect->y + rect->h, Screen_height*Pixel_height) - y;
+
+      if (w <= 0 || h <= 0)
+        continue;
+#if defined(USE_SDL)
+      SDL_UpdateRect(Screen_SDL, x, y, w, h);
+#else
+      GFX2_UpdateRect(x, y, w, h);
+#endif
+      Update_rects++;
+      Update_pixels += (unsigned long)w * h;
+    }
+    Update_count++;
+    Dirty_region_clear(&Dirty_region);
+    now = GFX2_GetTicks();
+    if (now - Update_stats_start >= 1000)
+    {
+      GFX2_Log(GFX2_DEBUG, "Screen updates in %ums : %lu updates, %lu rectangles, %lu pixels per update\n",
+               (unsigned)(now - Update_stats_start), Update_count, Update_rects,
+               (unsigned long)(Update_pixels / Update_count));
+      Update_stats_start = now;
+      Update_count = 0;
+      Update_rects = 0;
+      Update_pixels = 0;
+    }
+  }
+#endif
+
 }
 
 void Update_rect(short x, short y, unsigned short width, unsigned short height)
@@ -335,6 +504,13 @@ void Update_rect(short x, short y, unsigned short width, unsigned short height)
   update_is_required=1;
   #endif
 
+  #if (UPDATE_METHOD == UPDATE_METHOD_DIRTY_REGION)
+  if (width==0 || height==0)
+    Dirty_region_add(&Dirty_region, 0, 0, Screen_width*Pixel_width, Screen_height*Pixel_height);
+  else
+    Dirty_region_add(&Dirty_region, x*Pixel_width, y*Pixel_height, width*Pixel_width, height*Pixel_height);
+  #endif
+
 }
 
 void Update_status_line(short char_pos, short width)
@@ -361,6 +537,11 @@ void Update_status_line(short char_pos, short width)
   update_is_required=1;
   #endif
 
+  #if (UPDATE_METHOD == UPDATE_METHOD_DIRTY_REGION)
+  if (width > 0)
+    Update_rect((18+char_pos*8)*Menu_factor_X,Menu_status_Y,width*8*Menu_factor_X,8*Menu_factor_Y);
+  #endif
+
 }
 
 ///
@@ -484,6 +665,8 @@ int SetPalette(const T_Components * colors, int firstcolor, int ncolors)
 #else
   // When using SDL2, we need to force screen update so the
   // 8bit => True color conversion will be performed
+  for (i = 0; i < ncolors; i++)
+    Palette_ARGB[firstcolor + i] = 0xff000000 | ((dword)colors[i].R << 16) | ((dword)colors[i].G << 8) | colors[i].B;
   i = SDL_SetPaletteColors(Screen_SDL->format->palette, PaletteSDL, firstcolor, ncolors);
   if (i == 0)
     Update_rect(0, 0, Screen_SDL->w, Screen_SDL->h);
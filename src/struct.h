@@ -383,6 +383,9 @@ typedef struct
   byte Use_virtual_keyboard;             ///< 0: Auto, 1: On, 2: Off
   byte Default_mode_layers;              ///< Indicates if default new image has layers (alternative is animation)
   byte MOTO_gamma;                       ///< Number, 10 x the Gamma used for converting MO6/TO8/TO9 palette
+  word Undo_memory_limit;                ///< Memory (in MB) used by Undo pages before the oldest go to a swap file. 0 for no limit.
+  byte Tilemap_show_stats;               ///< Boolean, true if the number of unique tiles is shown in the status bar in Tilemap mode.
+  byte Lua_keep_state;                   ///< Boolean, true to keep the Lua state of a script directory for its next scripts, with their globals and loaded modules.
 
 } T_Config;
 
@@ -397,12 +400,17 @@ typedef struct T_Image
 {
   byte * Pixels;
   int Duration;
+  /// Tiled storage of the pixels, shared between pages, only for old Undo pages
+  /// (then Pixels is NULL). See pages.c
+  struct T_Tiled_layer * Tiled;
 } T_Image;
 
 /// This is the data for one step of Undo/Redo, for one image.
 /// This structure is resized dynamically to hold pointers to all of the layers in the picture.
-/// The pointed layers are just byte* holding the raw pixel data. But at Image[0]-1 you will find a short that is used as a reference counter for each layer.
+/// The pointed layers are just byte* holding the raw pixel data. But before Image[0] you will find a header with a reference counter for each layer.
 /// This way we can use the same pixel data in many undo pages when the user edit only one of the layers (which is what they usually do).
+/// Pages older than the previous one store their layers as shared tiles
+/// instead, so old Undo steps only keep the tiles which were modified.
 typedef struct T_Page
 {
   int       Width;   ///< Image width in pixels.
@@ -549,9 +557,20 @@ typedef struct
 {
   int Previous; ///< Previous similar tile in the linked list
   int Next;     ///< Next similar tile in the linked list
+  dword Key;    ///< Hash of the tile content, which doesn't depend on flipping
   byte Flipped; ///< 0:no, 1:horizontally, 2:vertically, 3:both
+  byte Dirty;   ///< Boolean, true if the tile was drawn on since the last update
 } T_Tile;
 
+/**
+ * Entry of the hash table of the unique tiles in the tile map
+ */
+typedef struct
+{
+  dword Key; ///< T_Tile::Key of the tile
+  int Tile;  ///< A tile with this content, or -1 for an empty entry
+} T_Tile_hash_entry;
+
 /// Settings for an entire file selector screen
 typedef struct T_Selector_settings
 {
@@ -623,6 +642,14 @@ typedef struct
   short tilemap_width;
   /// Number of tiles (vertically) for the tilemap
   short tilemap_height;
+  /// Hash table of the unique tiles of the tilemap
+  T_Tile_hash_entry * tilemap_hash;
+  /// Size of tilemap_hash minus one (the size is a power of two)
+  int tilemap_hash_mask;
+  /// Number of unique tiles in the tilemap
+  int tilemap_unique;
+  /// Number of tiles with T_Tile::Dirty set
+  int tilemap_dirty;
   /// The pixels of visible layers, flattened copy.
   T_Bitmap visible_image;
   /// List of backup pages for the main image.
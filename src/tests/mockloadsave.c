@@ -59,6 +59,14 @@ byte Get_pixel(T_IO_Context *context, short x, short y)
   return context->Target_address[y*context->Pitch + x];
 }
 
+void Get_pixel_line(T_IO_Context *context, short x, short y, short width, byte * pixels)
+{
+  short i;
+
+  for (i = 0; i < width; i++)
+    pixels[i] = Get_pixel(context, x + i, y);
+}
+
 void Pixel_in_layer(int layer, word x, word y, byte color)
 {
   (void)layer;
@@ -85,6 +93,14 @@ void Set_pixel(T_IO_Context *context, short x, short y, byte c)
   }
 }
 
+void Set_pixel_line(T_IO_Context *context, short x, short y, short width, const byte * pixels)
+{
+  short i;
+
+  for (i = 0; i < width; i++)
+    Set_pixel(context, x + i, y, pixels[i]);
+}
+
 void Set_pixel_24b(T_IO_Context *context, short x, short y, byte r, byte g, byte b)
 {
   (void)context;
@@ -0,0 +1,124 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2018-2019 Thomas Bernard
+    Copyright 2011 Pawel Góralski
+    Copyright 2009 Petter Lindquist
+    Copyright 2008 Yves Rizoud
+    Copyright 2008 Franck Charlet
+    Copyright 2007-2011 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file testdirtyrect.c
+/// Unit tests.
+///
+#include <stdio.h>
+#include "../dirtyrect.h"
+#include "../gfx2log.h"
+
+/// Number of random rectangles added by Test_Dirty_region()
+#define DIRTY_TEST_RECTS 200000
+/// Maximum number of rectangles added between two Dirty_region_clear()
+#define DIRTY_TEST_FRAME 64
+
+/// Small pseudo random generator, so the test is the same on all platforms
+static unsigned int Dirty_test_random(unsigned int * seed, unsigned int max)
+{
+  *seed = *seed * 1103515245u + 12345u;
+  return (*seed >> 8) % max;
+}
+
+static int Rect_contains(const T_Dirty_rect * a, const T_Dirty_rect * b)
+{
+  return b->x >= a->x && b->y >= a->y
+      && b->x + b->w <= a->x + a->w && b->y + b->h <= a->y + a->h;
+}
+
+static int Rect_overlap(const T_Dirty_rect * a, const T_Dirty_rect * b)
+{
+  return a->x < b->x + b->w && b->x < a->x + a->w
+      && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+/**
+ * Adds random rectangles to a region, as a screen would between two
+ * refreshes, and checks after each refresh that :
+ * - all the rectangles added are in one rectangle of the region,
+ * - the rectangles of the region don't overlap.
+ */
+int Test_Dirty_region(void)
+{
+  T_Dirty_region region;
+  T_Dirty_rect added[DIRTY_TEST_FRAME];
+  unsigned int seed = 42;
+  unsigned long frames = 0;
+  unsigned long long added_pixels = 0;
+  unsigned long long region_pixels = 0;
+  int total = 0;
+
+  Dirty_region_init(&region, 4096);
+  while (total < DIRTY_TEST_RECTS)
+  {
+    int count = 1 + Dirty_test_random(&seed, DIRTY_TEST_FRAME);
+    int i, j;
+
+    Dirty_region_clear(&region);
+    for (i = 0; i < count; i++)
+    {
+      T_Dirty_rect * rect = added + i;
+      // Mostly small rectangles (brush, cursor), and a few big ones (windows)
+      int size = Dirty_test_random(&seed, 8) ? 32 : 400;
+
+      rect->x = Dirty_test_random(&seed, 1920);
+      rect->y = Dirty_test_random(&seed, 1080);
+      rect->w = 1 + Dirty_test_random(&seed, size);
+      rect->h = 1 + Dirty_test_random(&seed, size);
+      Dirty_region_add(&region, rect->x, rect->y, rect->w, rect->h);
+      if (region.count < 1 || region.count > DIRTY_RECTS_MAX)
+      {
+        GFX2_Log(GFX2_ERROR, "Dirty_region_add() : %d rectangles in the region\n", region.count);
+        return 0;
+      }
+      added_pixels += (unsigned long)rect->w * rect->h;
+    }
+    for (i = 0; i < count; i++)
+    {
+      for (j = 0; j < region.count; j++)
+        if (Rect_contains(region.rects + j, added + i))
+          break;
+      if (j == region.count)
+      {
+        GFX2_Log(GFX2_ERROR, "Dirty_region_add() : rectangle (%d,%d) %dx%d is lost\n",
+                 added[i].x, added[i].y, added[i].w, added[i].h);
+        return 0;
+      }
+    }
+    for (i = 0; i < region.count; i++)
+      for (j = i + 1; j < region.count; j++)
+        if (Rect_overlap(region.rects + i, region.rects + j))
+        {
+          GFX2_Log(GFX2_ERROR, "Dirty_region_add() : rectangles %d and %d overlap\n", i, j);
+          return 0;
+        }
+    region_pixels += Dirty_region_pixels(&region);
+    total += count;
+    frames++;
+  }
+  GFX2_Log(GFX2_DEBUG, "%d rectangles in %lu frames : %lu pixels added, %lu pixels updated\n",
+           total, frames, (unsigned long)added_pixels, (unsigned long)region_pixels);
+  return 1;
+}
@@ -4,7 +4,10 @@
 TEST(MOTO_MAP_pack)
 TEST(CPC_compare_colors)
 TEST(Packbits)
+TEST(Packbits_memory)
 TEST(Convert_24b_bitmap_to_256)
+TEST(OT_count_occurrences)
+TEST(Dirty_region)
 TEST(Formats)
 TEST(Load)
 TEST(Save)
@@ -27,6 +27,7 @@
 /// Unit tests.
 ///
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../op_c.h"
 #include "../gfx2log.h"
@@ -58,3 +59,46 @@ int Test_Convert_24b_bitmap_to_256(void)
   // TODO: test a real reduction
   return 1;
 }
+
+/**
+ * Checks that OT_count_occurrences(), which splits a big picture between
+ * threads, gives the same counts as OT_inc() for each pixel.
+ */
+int Test_OT_count_occurrences(void)
+{
+  const int size = 1024*512;
+  T_Components * image;
+  T_Occurrence_table * counted;
+  T_Occurrence_table * expected;
+  int table_size;
+  int i;
+  int ok = 0;
+
+  image = malloc(size * sizeof(T_Components));
+  counted = OT_new(5, 6, 5);
+  expected = OT_new(5, 6, 5);
+  if (image == NULL || counted == NULL || expected == NULL)
+    goto cleanup;
+  srand(42);
+  for (i = 0; i < size; i++)
+  {
+    image[i].R = rand();
+    image[i].G = rand() & 0x3f; // a few colors used a lot
+    image[i].B = rand();
+  }
+  OT_count_occurrences(counted, image, size);
+  for (i = 0; i < size; i++)
+    OT_inc(expected, image[i].R, image[i].G, image[i].B);
+  table_size = expected->rng_r * expected->rng_g * expected->rng_b;
+  ok = memcmp(counted->table, expected->table, table_size * sizeof(int)) == 0;
+  if (!ok)
+    GFX2_Log(GFX2_ERROR, "OT_count_occurrences() counts differ from OT_inc()\n");
+
+cleanup:
+  free(image);
+  if (counted != NULL)
+    OT_delete(counted);
+  if (expected != NULL)
+    OT_delete(expected);
+  return ok;
+}
@@ -240,3 +240,54 @@ int Test_Packbits(void)
   unlink(tempfilename);
   return 1; // test OK
 }
+
+/**
+ * Tests for the packbits compression in memory (used for old Undo pages)
+ */
+int Test_Packbits_memory(void)
+{
+  byte source[4096];
+  byte packed[4096];
+  byte unpacked[4096];
+  int packed_size;
+  int i;
+
+  // runs, random bytes and runs again
+  memset(source, 12, 1000);
+  for (i = 1000; i < 3000; i++)
+    source[i] = (byte)random();
+  memset(source + 3000, 200, 1096);
+
+  packed_size = PackBits_pack_to_memory(packed, sizeof(packed), source, sizeof(source));
+  GFX2_Log(GFX2_DEBUG, "Compressed %lu bytes to %d\n", (unsigned long)sizeof(source), packed_size);
+  if (packed_size < 0 || packed_size >= (int)sizeof(source))
+  {
+    GFX2_Log(GFX2_ERROR, "PackBits_pack_to_memory() failed\n");
+    return 0;
+  }
+  if (PackBits_unpack_from_memory(unpacked, sizeof(unpacked), packed, packed_size) != PACKBITS_UNPACK_OK)
+  {
+    GFX2_Log(GFX2_ERROR, "PackBits_unpack_from_memory() failed\n");
+    return 0;
+  }
+  if (memcmp(source, unpacked, sizeof(source)) != 0)
+  {
+    GFX2_Log(GFX2_ERROR, "uncompressed buffer mismatch !\n");
+    return 0;
+  }
+  // truncated stream
+  if (PackBits_unpack_from_memory(unpacked, sizeof(unpacked), packed, packed_size / 2) != PACKBITS_UNPACK_READ_ERROR)
+  {
+    GFX2_Log(GFX2_ERROR, "PackBits_unpack_from_memory() should fail on truncated data\n");
+    return 0;
+  }
+  // random data doesn't fit in a buffer of the same size
+  for (i = 0; i < (int)sizeof(source); i++)
+    source[i] = (byte)random();
+  if (PackBits_pack_to_memory(packed, sizeof(packed), source, sizeof(source)) >= 0)
+  {
+    GFX2_Log(GFX2_ERROR, "PackBits_pack_to_memory() should not fit\n");
+    return 0;
+  }
+  return 1; // test OK
+}
@@ -38,6 +38,11 @@
 #define TILE_X(t) (((t)%Main.tilemap_width)*Snap_width+Snap_offset_X)
 #define TILE_Y(t) (((t)/Main.tilemap_width)*Snap_height+Snap_offset_Y)
 
+/// Maximum number of tiles : a 1x1 grid on a 2048x2048 image
+#define TILEMAP_MAX_TILES 4194304l
+/// Number of tiles above which Tilemap_update() shows a "Please wait" window
+#define TILEMAP_WAIT_TILES 100000l
+
 enum TILE_FLIPPED
 {
   TILE_FLIPPED_NONE = 0,
@@ -93,7 +98,12 @@ void Tilemap_draw(word x, word y, byte color)
       Pixel_in_current_screen_with_preview(xx,yy,color);
     else
       Pixel_in_current_screen(xx,yy,color);
-      
+    
+    if (!Main.tilemap[tile].Dirty)
+    {
+      Main.tilemap[tile].Dirty = 1;
+      Main.tilemap_dirty++;
+    }
     tile = Main.tilemap[tile].Next;
   } while (tile != first_tile);
 
@@ -171,14 +181,187 @@ int Tile_is_same_flipped_xy(int t1, int t2)
   return 1;
 }
 
+///
+static int Tile_is_same_flipped(int t1, int t2, enum TILE_FLIPPED flipped)
+{
+  switch (flipped)
+  {
+    case TILE_FLIPPED_NONE:
+    default:
+      return Tile_is_same(t1, t2);
+    case TILE_FLIPPED_X:
+      return Tile_is_same_flipped_x(t1, t2);
+    case TILE_FLIPPED_Y:
+      return Tile_is_same_flipped_y(t1, t2);
+    case TILE_FLIPPED_XY:
+      return Tile_is_same_flipped_xy(t1, t2);
+  }
+}
+
+/// Hash of the pixels of a tile, read in the order given by the flipping
+static dword Tile_hash(int t, enum TILE_FLIPPED flipped)
+{
+  const byte *bmp;
+  long step_y = Main.image_width;
+  int step_x = 1;
+  int x, y;
+  dword hash = 2166136261u; // FNV-1a
+
+  bmp = Main.backups->Pages->Image[Main.current_layer].Pixels+(TILE_Y(t))*Main.image_width+(TILE_X(t));
+  if (flipped & TILE_FLIPPED_X)
+  {
+    bmp += Snap_width-1;
+    step_x = -1;
+  }
+  if (flipped & TILE_FLIPPED_Y)
+  {
+    bmp += (Snap_height-1)*step_y;
+    step_y = -step_y;
+  }
+  for (y=0; y < Snap_height; y++, bmp+=step_y)
+  {
+    for (x=0; x < Snap_width; x++)
+      hash = (hash ^ bmp[x*step_x]) * 16777619u;
+  }
+  return hash;
+}
+
+/// Flippings tried to match a tile with a known one, in order of preference
+static const enum TILE_FLIPPED Tile_flippings[4] =
+{
+  TILE_FLIPPED_NONE, TILE_FLIPPED_Y, TILE_FLIPPED_X, TILE_FLIPPED_XY
+};
+
+/// Returns true if the flipping is allowed by the tilemap settings
+static int Tile_flipping_allowed(enum TILE_FLIPPED flipped)
+{
+  return (!(flipped & TILE_FLIPPED_X) || Config.Tilemap_allow_flipped_x)
+      && (!(flipped & TILE_FLIPPED_Y) || Config.Tilemap_allow_flipped_y);
+}
+
+///
+/// Hash of a tile which doesn't depend on its flipping : the smallest hash
+/// of all the allowed flippings. Similar tiles get the same key.
+static dword Tile_key(int t)
+{
+  dword key = Tile_hash(t, TILE_FLIPPED_NONE);
+  int i;
+
+  for (i=1; i<4; i++)
+  {
+    if (Tile_flipping_allowed(Tile_flippings[i]))
+    {
+      dword hash = Tile_hash(t, Tile_flippings[i]);
+      if (hash < key)
+        key = hash;
+    }
+  }
+  return key;
+}
+
+///
+/// Finds the tiles similar to a tile, and links it with them in their
+/// circular linked list. If there is none, the tile is added to the hash
+/// table of unique tiles.
+static void Tile_insert(int tile)
+{
+  dword key = Tile_key(tile);
+  int slot = key & Main.tilemap_hash_mask;
+
+  Main.tilemap[tile].Key = key;
+  Main.tilemap[tile].Previous = tile;
+  Main.tilemap[tile].Next = tile;
+  Main.tilemap[tile].Flipped = TILE_FLIPPED_NONE;
+
+  for (; Main.tilemap_hash[slot].Tile != -1; slot = (slot+1) & Main.tilemap_hash_mask)
+  {
+    int ref_tile = Main.tilemap_hash[slot].Tile;
+    int i;
+
+    if (Main.tilemap_hash[slot].Key != key)
+      continue;
+    for (i=0; i<4; i++)
+    {
+      if (Tile_flipping_allowed(Tile_flippings[i])
+       && Tile_is_same_flipped(ref_tile, tile, Tile_flippings[i]))
+      {
+        // New occurrence of a known tile
+        // Insert at the end. classic doubly-linked-list.
+        int last_tile=Main.tilemap[ref_tile].Previous;
+        Main.tilemap[tile].Previous=last_tile;
+        Main.tilemap[tile].Next=ref_tile;
+        Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped ^ Tile_flippings[i];
+        Main.tilemap[ref_tile].Previous=tile;
+        Main.tilemap[last_tile].Next=tile;
+        return;
+      }
+    }
+  }
+  // This tile is really unique.
+  Main.tilemap_hash[slot].Key = key;
+  Main.tilemap_hash[slot].Tile = tile;
+  Main.tilemap_unique++;
+}
+
+///
+/// Takes a tile out of its circular linked list, before its content is
+/// analyzed again. The hash table entry of the list is given to another
+/// tile of the list, or removed if the tile was alone.
+static void Tile_remove(int tile)
+{
+  int previous = Main.tilemap[tile].Previous;
+  int next = Main.tilemap[tile].Next;
+  int slot = Main.tilemap[tile].Key & Main.tilemap_hash_mask;
+
+  while (Main.tilemap_hash[slot].Tile != -1 && Main.tilemap_hash[slot].Tile != tile)
+    slot = (slot+1) & Main.tilemap_hash_mask;
+
+  if (Main.tilemap_hash[slot].Tile == tile)
+  {
+    if (next != tile)
+      Main.tilemap_hash[slot].Tile = next;
+    else
+    {
+      // Remove the entry, and move back the following entries of the
+      // cluster which would no longer be found after the hole.
+      int hole = slot;
+
+      Main.tilemap_hash[hole].Tile = -1;
+      for (slot = (slot+1) & Main.tilemap_hash_mask;
+           Main.tilemap_hash[slot].Tile != -1;
+           slot = (slot+1) & Main.tilemap_hash_mask)
+      {
+        int home = Main.tilemap_hash[slot].Key & Main.tilemap_hash_mask;
+
+        // Can the entry stay where it is, with its home slot in (hole,slot] ?
+        if (hole < slot ? (home > hole && home <= slot) : (home > hole || home <= slot))
+          continue;
+        Main.tilemap_hash[hole] = Main.tilemap_hash[slot];
+        Main.tilemap_hash[slot].Tile = -1;
+        hole = slot;
+      }
+      Main.tilemap_unique--;
+    }
+  }
+
+  Main.tilemap[previous].Next = next;
+  Main.tilemap[next].Previous = previous;
+  Main.tilemap[tile].Previous = tile;
+  Main.tilemap[tile].Next = tile;
+}
+
 /// Create or update a tilemap based on current screen (layer)'s pixels.
+///
+/// The unique tiles are stored in a hash table with open addressing, so
+/// each tile is only compared with the ones which have the same key.
 void Tilemap_update(void)
 {
   int width;
   int height;
   int tile;
-  int count=1;
   T_Tile * tile_ptr;
+  T_Tile_hash_entry * hash_table;
+  int hash_mask;
   
   int wait_window=0;
   byte old_cursor=0;
@@ -189,30 +372,45 @@ void Tilemap_update(void)
   width=(Main.image_width-Snap_offset_X)/Snap_width;
   height=(Main.image_height-Snap_offset_Y)/Snap_height;
   
-  if (width<1 || height<1 || width*height>1000000l
+  if (width<1 || height<1 || width*height>TILEMAP_MAX_TILES
    || (tile_ptr=(T_Tile *)malloc(width*height*sizeof(T_Tile))) == NULL)
   {
     // Cannot enable tilemap because either the image is too small
     // for the grid settings (and I don't want to implement partial tiles)
-    // Or the number of tiles seems unreasonable (one million) : This can
+    // Or the number of tiles seems unreasonable : This can
     // happen if you set grid 1x1 for example.
   
     Disable_tilemap(&Main);
     return;
   }
+
+  // Hash table at most half full
+  for (hash_mask=1; hash_mask < 2*width*height; hash_mask<<=1)
+    ;
+  hash_table = (T_Tile_hash_entry *)malloc(hash_mask*sizeof(T_Tile_hash_entry));
+  if (hash_table == NULL)
+  {
+    free(tile_ptr);
+    Disable_tilemap(&Main);
+    return;
+  }
   
   if (Main.tilemap)
   {
     // Recycle existing tilemap
     free(Main.tilemap);
-    Main.tilemap=NULL;
+    free(Main.tilemap_hash);
   }
   Main.tilemap=tile_ptr;
+  Main.tilemap_hash=hash_table;
+  Main.tilemap_hash_mask=hash_mask-1;
+  Main.tilemap_unique=0;
+  Main.tilemap_dirty=0;
   
   Main.tilemap_width=width;
   Main.tilemap_height=height;
 
-  if (width*height > 1000 || Config.Tilemap_show_count)
+  if (width*height > TILEMAP_WAIT_TILES || Config.Tilemap_show_count)
   {
     wait_window=1;
     old_cursor=Cursor_shape;
@@ -224,118 +422,15 @@ void Tilemap_update(void)
     Get_input(0);
   }
   
-  // Initialize array with all tiles unique by default
-  for (tile=0; tile<width*height; tile++)
-  {
-    Main.tilemap[tile].Previous = tile;
-    Main.tilemap[tile].Next = tile;
-    Main.tilemap[tile].Flipped = 0;
-  }
+  for (tile=0; tile<hash_mask; tile++)
+    hash_table[tile].Tile = -1;
   
   // Now find similar tiles and link them in circular linked list
   //It will be used to modify all tiles whenever you draw on one.
-  for (tile=1; tile<width*height; tile++)
+  for (tile=0; tile<width*height; tile++)
   {
-    int ref_tile;
-    
-    // Try normal comparison
-    
-    for (ref_tile=0; ref_tile<tile; ref_tile++)
-    {
-      if (Main.tilemap[ref_tile].Previous<=ref_tile && Tile_is_same(ref_tile, tile))
-      {
-        break; // stop loop on ref_tile
-      }
-    }
-    if (ref_tile<tile)
-    {
-      // New occurrence of a known tile
-      // Insert at the end. classic doubly-linked-list.
-      int last_tile=Main.tilemap[ref_tile].Previous;
-      Main.tilemap[tile].Previous=last_tile;
-      Main.tilemap[tile].Next=ref_tile;
-      Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped;
-      Main.tilemap[ref_tile].Previous=tile;
-      Main.tilemap[last_tile].Next=tile;
-      continue; // next tile
-    }
-    
-    // Try flipped-y comparison
-    if (Config.Tilemap_allow_flipped_y)
-    {
-      for (ref_tile=0; ref_tile<tile; ref_tile++)
-      {
-        if (Main.tilemap[ref_tile].Previous<=ref_tile && Tile_is_same_flipped_y(ref_tile, tile))
-        {
-          break; // stop loop on ref_tile
-        }
-      }
-      if (ref_tile<tile)
-      {
-        // New occurrence of a known tile
-        // Insert at the end. classic doubly-linked-list.
-        int last_tile=Main.tilemap[ref_tile].Previous;
-        Main.tilemap[tile].Previous=last_tile;
-        Main.tilemap[tile].Next=ref_tile;
-        Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped ^ TILE_FLIPPED_Y;
-        Main.tilemap[ref_tile].Previous=tile;
-        Main.tilemap[last_tile].Next=tile;
-        continue; // next tile
-      }
-    }
-    
-    // Try flipped-x comparison
-    if (Config.Tilemap_allow_flipped_x)
-    {
-      for (ref_tile=0; ref_tile<tile; ref_tile++)
-      {
-        if (Main.tilemap[ref_tile].Previous<=ref_tile && Tile_is_same_flipped_x(ref_tile, tile))
-        {
-          break; // stop loop on ref_tile
-        }
-      }
-      if (ref_tile<tile)
-      {
-        // New occurrence of a known tile
-        // Insert at the end. classic doubly-linked-list.
-        int last_tile=Main.tilemap[ref_tile].Previous;
-        Main.tilemap[tile].Previous=last_tile;
-        Main.tilemap[tile].Next=ref_tile;
-        Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped ^ TILE_FLIPPED_X;
-        Main.tilemap[ref_tile].Previous=tile;
-        Main.tilemap[last_tile].Next=tile;
-        continue; // next tile
-      }
-    }
-    
-    // Try flipped-xy comparison
-    if (Config.Tilemap_allow_flipped_x && Config.Tilemap_allow_flipped_y)
-    {
-      for (ref_tile=0; ref_tile<tile; ref_tile++)
-      {
-        if (Main.tilemap[ref_tile].Previous<=ref_tile && Tile_is_same_flipped_xy(ref_tile, tile))
-        {
-          break; // stop loop on ref_tile
-        }
-      }
-      if (ref_tile<tile)
-      {
-        // New occurrence of a known tile
-        // Insert at the end. classic doubly-linked-list.
-        int last_tile=Main.tilemap[ref_tile].Previous;
-        Main.tilemap[tile].Previous=last_tile;
-        Main.tilemap[tile].Next=ref_tile;
-        Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped ^ TILE_FLIPPED_XY;
-        Main.tilemap[ref_tile].Previous=tile;
-        Main.tilemap[last_tile].Next=tile;
-        continue; // next tile
-      }
-    }
-    
-    // This tile is really unique.
-    // Nothing to do at this time: the initialization
-    // has already set the right data for Main.tilemap[tile].
-    count++;
+    Main.tilemap[tile].Dirty = 0;
+    Tile_insert(tile);
   }
   
   if (wait_window)
@@ -345,7 +440,7 @@ void Tilemap_update(void)
     
     if (Config.Tilemap_show_count)
     {
-      Num2str(count,str,7);
+      Num2str(Main.tilemap_unique,str,7);
       Hide_cursor();
       Print_in_window(6, 20, "Unique tiles: ",MC_Black,MC_Light);
       Print_in_window(6+8*14,20,str,MC_Black,MC_Light);
@@ -365,6 +460,52 @@ void Tilemap_update(void)
   }
 }
 
+///
+/// Updates the tilemap after drawing : the tiles which were drawn on are
+/// analyzed again, and linked with the tiles they are now similar to.
+void Tilemap_refresh(void)
+{
+  int tile;
+
+  if (!Main.tilemap_mode || Main.tilemap == NULL || Main.tilemap_dirty == 0)
+    return;
+
+  // All the modified tiles are removed before any is inserted again, so
+  // they can't be compared with a tile of the hash table which has changed.
+  for (tile=0; tile<Main.tilemap_width*Main.tilemap_height; tile++)
+  {
+    if (Main.tilemap[tile].Dirty)
+      Tile_remove(tile);
+  }
+  for (tile=0; tile<Main.tilemap_width*Main.tilemap_height; tile++)
+  {
+    if (Main.tilemap[tile].Dirty)
+    {
+      Main.tilemap[tile].Dirty = 0;
+      Tile_insert(tile);
+    }
+  }
+  Main.tilemap_dirty = 0;
+
+  if (Config.Tilemap_show_stats)
+    Print_coordinates();
+}
+
+///
+/// Marks all tiles as modified, for when the pixels of the layer were
+/// changed without Tilemap_draw(). They are analyzed by the next call to
+/// Tilemap_refresh().
+void Tilemap_invalidate(void)
+{
+  int tile;
+
+  if (!Main.tilemap_mode || Main.tilemap == NULL)
+    return;
+  for (tile=0; tile<Main.tilemap_width*Main.tilemap_height; tile++)
+    Main.tilemap[tile].Dirty = 1;
+  Main.tilemap_dirty = Main.tilemap_width*Main.tilemap_height;
+}
+
 ///
 /// Clears all tilemap data and settings
 /// Safe to call again.
@@ -375,7 +516,11 @@ void Disable_tilemap(T_Document * doc)
     // Recycle existing tilemap
     free(doc->tilemap);
     doc->tilemap=NULL;
+    free(doc->tilemap_hash);
+    doc->tilemap_hash=NULL;
   }
+  doc->tilemap_unique=0;
+  doc->tilemap_dirty=0;
   doc->tilemap_width=0;
   doc->tilemap_height=0;
   doc->tilemap_mode=0;
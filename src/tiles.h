@@ -27,6 +27,17 @@
 /// Create or update a tilemap based on current screen pixels.
 void Tilemap_update(void);
 
+///
+/// Updates the tilemap after drawing : the tiles which were drawn on are
+/// analyzed again, and linked with the tiles they are now similar to.
+void Tilemap_refresh(void);
+
+///
+/// Marks all tiles as modified, for when the pixels of the layer were
+/// changed without Tilemap_draw(). They are analyzed by the next call to
+/// Tilemap_refresh().
+void Tilemap_invalidate(void);
+
 ///
 /// Draw a pixel while Tilemap mode is active : This will paint on all
 /// similar tiles of the layer, visible on the screen or not.
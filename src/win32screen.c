@@ -48,6 +48,13 @@ static int Windows_DIB_width = 0;
 static int Windows_DIB_height = 0;
 static HWND Win32_hwnd = NULL;
 static int Win32_Is_Fullscreen = 0;
+/// No window, see GFX2_Set_headless()
+static int Win32_headless = 0;
+
+void GFX2_Set_headless(void)
+{
+  Win32_headless = 1;
+}
 
 HWND GFX2_Get_Window_Handle()
 {
@@ -522,6 +529,8 @@ void GFX2_Set_mode(int *width, int *height, int fullscreen)
 {
   Win32_Is_Fullscreen = fullscreen;
   Video_AllocateDib(*width, *height);
+  if (Win32_headless)
+    return;
   if (Win32_hwnd == NULL)
     Win32_CreateWindow(*width, *height, fullscreen);
   else
@@ -610,6 +619,8 @@ void Screen_FillRect(int x, int y, int w, int h, byte color)
 
 void Update_rect(short x, short y, unsigned short width, unsigned short height)
 {
+  if (Win32_hwnd == NULL)
+    return;
   if (width == 0 && height == 0)
   {
     // update whole window
@@ -657,7 +668,8 @@ int SetPalette(const T_Components * colors, int firstcolor, int ncolors)
 	SelectObject(dc2, old_bmp);
 	DeleteDC(dc2);
 	ReleaseDC(Win32_hwnd, dc);
-  InvalidateRect(Win32_hwnd, NULL, FALSE);  // Refresh the whole window
+  if (Win32_hwnd != NULL)
+    InvalidateRect(Win32_hwnd, NULL, FALSE);  // Refresh the whole window
   return 1;
 }
 
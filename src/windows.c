@@ -1076,6 +1076,15 @@ void Print_coordinates(void)
         Update_status_line(19, 4);
       }
     }
+    else if (Main.tilemap_mode && Config.Tilemap_show_stats)
+    {
+      // Number of unique tiles
+      char count[8];
+
+      Num2str(Main.tilemap_unique < 99999 ? Main.tilemap_unique : 99999, count, 5);
+      Print_in_menu("T:", 17);
+      Print_in_menu(count, 19);
+    }
 
     Num2str(Paintbrush_X,temp,4);
     Print_in_menu(temp,2);
@@ -3099,7 +3108,45 @@ void Display_all_screen(void)
 
 
 
-byte Best_color(byte r,byte g,byte b)
+/// Size of the cache of Best_color(), Best_color_nonexcluded() and Best_color_perceptual()
+#define BEST_COLOR_CACHE_SIZE 4096
+
+/// Kinds of searches stored in the cache
+enum BEST_COLOR_SEARCH
+{
+  BEST_COLOR_SEARCH = 1,   ///< Best_color()
+  BEST_COLOR_NONEXCLUDED,  ///< Best_color_nonexcluded()
+  BEST_COLOR_PERCEPTUAL    ///< Best_color_perceptual()
+};
+
+///
+/// Recent results of the Best_color functions, which are called for
+/// each pixel by the effects. The cache is only valid for the palette
+/// and the excluded colors it was filled with : it is emptied as soon
+/// as ::Palette_generation changes.
+static struct
+{
+  dword Palette_generation; ///< ::Palette_generation when the cache was emptied
+  dword Key[BEST_COLOR_CACHE_SIZE];  ///< Kind of search and RGB, or 0 when the entry is empty
+  byte Color[BEST_COLOR_CACHE_SIZE];
+} Best_color_cache;
+
+///
+/// Returns the index in ::Best_color_cache for a search, and its key.
+/// The cache is emptied first if the palette has changed.
+static int Best_color_cache_index(byte r, byte g, byte b, enum BEST_COLOR_SEARCH search, dword * key)
+{
+  if (Best_color_cache.Palette_generation != Palette_generation)
+  {
+    Best_color_cache.Palette_generation = Palette_generation;
+    memset(Best_color_cache.Key, 0, sizeof(Best_color_cache.Key));
+  }
+  *key = ((dword)search << 24) | ((dword)r << 16) | ((dword)g << 8) | b;
+  // Multiplicative hashing, keeps the 12 upper bits
+  return (int)((*key * 2654435761u) >> 20) & (BEST_COLOR_CACHE_SIZE - 1);
+}
+
+static byte Search_best_color(byte r,byte g,byte b)
 {
   int col;
   int   delta_r,delta_g,delta_b;
@@ -3133,7 +3180,20 @@ byte Best_color(byte r,byte g,byte b)
   return best_color;
 }
 
-byte Best_color_nonexcluded(byte red,byte green,byte blue)
+byte Best_color(byte r,byte g,byte b)
+{
+  dword key;
+  int index = Best_color_cache_index(r, g, b, BEST_COLOR_SEARCH, &key);
+
+  if (Best_color_cache.Key[index] != key)
+  {
+    Best_color_cache.Key[index] = key;
+    Best_color_cache.Color[index] = Search_best_color(r, g, b);
+  }
+  return Best_color_cache.Color[index];
+}
+
+static byte Search_best_color_nonexcluded(byte red,byte green,byte blue)
 {
   int   col;
   int   delta_r,delta_g,delta_b;
@@ -3164,6 +3224,19 @@ byte Best_color_nonexcluded(byte red,byte green,byte blue)
   return best_color;
 }
 
+byte Best_color_nonexcluded(byte red,byte green,byte blue)
+{
+  dword key;
+  int index = Best_color_cache_index(red, green, blue, BEST_COLOR_NONEXCLUDED, &key);
+
+  if (Best_color_cache.Key[index] != key)
+  {
+    Best_color_cache.Key[index] = key;
+    Best_color_cache.Color[index] = Search_best_color_nonexcluded(red, green, blue);
+  }
+  return Best_color_cache.Color[index];
+}
+
 byte Best_color_range(byte r, byte g, byte b, byte max)
 {
 
@@ -3207,7 +3280,7 @@ byte Best_color_range(byte r, byte g, byte b, byte max)
   return best_color;
 }
 
-byte Best_color_perceptual(byte r,byte g,byte b)
+static byte Search_best_color_perceptual(byte r,byte g,byte b)
 {
 
   int col;
@@ -3250,6 +3323,19 @@ byte Best_color_perceptual(byte r,byte g,byte b)
   return best_color;
 }
 
+byte Best_color_perceptual(byte r,byte g,byte b)
+{
+  dword key;
+  int index = Best_color_cache_index(r, g, b, BEST_COLOR_PERCEPTUAL, &key);
+
+  if (Best_color_cache.Key[index] != key)
+  {
+    Best_color_cache.Key[index] = key;
+    Best_color_cache.Color[index] = Search_best_color_perceptual(r, g, b);
+  }
+  return Best_color_cache.Color[index];
+}
+
 byte Best_color_perceptual_except(byte r,byte g,byte b, byte except)
 {
 
@@ -3485,6 +3571,8 @@ void Compute_optimal_menu_colors(const T_Components * palette)
 	Old_light = MC_Light;
 	Old_white = MC_White;
 	Old_trans = MC_Trans;
+	// Called after a change of the palette
+	Palette_generation++;
 
 	// First method:
 	// If all close matches for the ideal colors exist, pick them.
@@ -39,6 +39,13 @@ static XTextProperty windowName;
 static GC X11_gc = 0;
 static T_GFX2_Surface * screen = NULL;
 static T_GFX2_Surface * icon = NULL;
+/// No display connection and no window, see GFX2_Set_headless()
+static int X11_headless = 0;
+
+void GFX2_Set_headless(void)
+{
+  X11_headless = 1;
+}
 
 void GFX2_Set_mode(int *width, int *height, int fullscreen)
 {
@@ -49,6 +56,20 @@ void GFX2_Set_mode(int *width, int *height, int fullscreen)
   Visual * visual;
   (void)fullscreen;
 
+  if (X11_headless)
+  {
+    if (screen == NULL)
+      screen = New_GFX2_Surface(*width, *height);
+    else if (*width > screen->w || *height > screen->h)
+    {
+      screen->pixels = realloc(screen->pixels, *width * *height);
+      screen->w = *width;
+      screen->h = *height;
+    }
+    memset(screen->pixels, 0, *width * *height);
+    return;
+  }
+
   if (X11_display == NULL)
     X11_display = XOpenDisplay(NULL);// NULL is equivalent to getenv("DISPLAY")
   if (X11_display == NULL)
@@ -324,6 +345,8 @@ void Allow_drag_and_drop(int flag)
 {
   Atom version = flag ? 5 : 0;
 
+  if (X11_display == NULL)
+    return;
   XChangeProperty(X11_display, X11_window, XInternAtom(X11_display, "XdndAware", False), XA_ATOM, 32, PropModeReplace, (unsigned char *)&version, 1);
 }
 
@@ -338,6 +361,8 @@ void Define_icon(void)
 
 void Set_mouse_position(void)
 {
+  if (X11_display == NULL)
+    return;
   XWarpPointer(X11_display, None, X11_window,
                0, 0, 0, 0,
                Mouse_X * Pixel_width, Mouse_Y * Pixel_height);
@@ -0,0 +1,185 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file zoomline.c
+/// Pixel replication, used by the magnifier and the pixel renderers.
+
+#include <string.h>
+#include "struct.h"
+#include "zoomline.h"
+
+// SSE2 is part of the x86-64 instruction set, and can be enabled with
+// -msse2 on 32bits x86. It is checked at compile time.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ZOOMLINE_SSE2
+#include <emmintrin.h>
+#endif
+
+// -- Plain C --
+
+void Zoom_a_line_scalar(const byte * original_line, byte * zoomed_line, word factor, word width)
+{
+  word x;
+
+  // Pour chaque pixel
+  for (x = 0; x < width; x++)
+  {
+    memset(zoomed_line, *original_line, factor);
+    zoomed_line += factor;
+    original_line++;
+  }
+}
+
+#ifdef ZOOMLINE_SSE2
+
+// -- SSE2 --
+
+/// Factor 2 : 16 pixels give 32 bytes.
+/// @return the number of pixels done, the caller finishes the line.
+static int Zoom_a_line_2_sse2(const byte * src, byte * dest, int width)
+{
+  int x;
+
+  for (x = 0; x + 16 <= width; x += 16)
+  {
+    __m128i p = _mm_loadu_si128((const __m128i *)(src + x));
+
+    _mm_storeu_si128((__m128i *)(dest), _mm_unpacklo_epi8(p, p));
+    _mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi8(p, p));
+    dest += 32;
+  }
+  return x;
+}
+
+/// Factor 4 : 16 pixels give 64 bytes.
+static int Zoom_a_line_4_sse2(const byte * src, byte * dest, int width)
+{
+  int x;
+
+  for (x = 0; x + 16 <= width; x += 16)
+  {
+    __m128i p = _mm_loadu_si128((const __m128i *)(src + x));
+    __m128i lo = _mm_unpacklo_epi8(p, p);
+    __m128i hi = _mm_unpackhi_epi8(p, p);
+
+    _mm_storeu_si128((__m128i *)(dest), _mm_unpacklo_epi16(lo, lo));
+    _mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi16(lo, lo));
+    _mm_storeu_si128((__m128i *)(dest + 32), _mm_unpacklo_epi16(hi, hi));
+    _mm_storeu_si128((__m128i *)(dest + 48), _mm_unpackhi_epi16(hi, hi));
+    dest += 64;
+  }
+  return x;
+}
+
+/// Factor 8 : 16 pixels give 128 bytes.
+static int Zoom_a_line_8_sse2(const byte * src, byte * dest, int width)
+{
+  int x, i;
+
+  for (x = 0; x + 16 <= width; x += 16)
+  {
+    __m128i p = _mm_loadu_si128((const __m128i *)(src + x));
+    __m128i v[4];
+
+    v[0] = _mm_unpacklo_epi8(p, p);
+    v[2] = _mm_unpackhi_epi8(p, p);
+    v[1] = _mm_unpackhi_epi16(v[0], v[0]);
+    v[0] = _mm_unpacklo_epi16(v[0], v[0]);
+    v[3] = _mm_unpackhi_epi16(v[2], v[2]);
+    v[2] = _mm_unpacklo_epi16(v[2], v[2]);
+    for (i = 0; i < 4; i++)
+    {
+      _mm_storeu_si128((__m128i *)(dest), _mm_unpacklo_epi32(v[i], v[i]));
+      _mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi32(v[i], v[i]));
+      dest += 32;
+    }
+  }
+  return x;
+}
+
+/// Factors 3, 5, 6, 7 and 9 to 15 : one 16 bytes store per pixel. Each
+/// store goes over the next pixels, which are written afterwards, so it
+/// stops 16 bytes before the end of the line.
+static int Zoom_a_line_small_sse2(const byte * src, byte * dest, int factor, int width)
+{
+  int x;
+  int last = (width * factor - 16) / factor; // first pixel which can't be stored this way
+
+  if (width * factor < 16)
+    return 0;
+  for (x = 0; x < last; x++)
+  {
+    _mm_storeu_si128((__m128i *)dest, _mm_set1_epi8((char)src[x]));
+    dest += factor;
+  }
+  return x;
+}
+
+/// Factors 16 and more : the last store of a pixel overlaps the previous
+/// one instead of going over the next pixel.
+static int Zoom_a_line_large_sse2(const byte * src, byte * dest, int factor, int width)
+{
+  int x, i;
+
+  for (x = 0; x < width; x++)
+  {
+    __m128i color = _mm_set1_epi8((char)src[x]);
+
+    for (i = 0; i + 16 < factor; i += 16)
+      _mm_storeu_si128((__m128i *)(dest + i), color);
+    _mm_storeu_si128((__m128i *)(dest + factor - 16), color);
+    dest += factor;
+  }
+  return x;
+}
+#endif
+
+void Zoom_a_line(const byte * original_line, byte * zoomed_line, word factor, word width)
+{
+  int done = 0;
+
+  if (factor == 1)
+  {
+    memcpy(zoomed_line, original_line, width);
+    return;
+  }
+#ifdef ZOOMLINE_SSE2
+  switch (factor)
+  {
+    case 2:
+      done = Zoom_a_line_2_sse2(original_line, zoomed_line, width);
+      break;
+    case 4:
+      done = Zoom_a_line_4_sse2(original_line, zoomed_line, width);
+      break;
+    case 8:
+      done = Zoom_a_line_8_sse2(original_line, zoomed_line, width);
+      break;
+    default:
+      if (factor >= 16)
+        done = Zoom_a_line_large_sse2(original_line, zoomed_line, factor, width);
+      else
+        done = Zoom_a_line_small_sse2(original_line, zoomed_line, factor, width);
+  }
+#endif
+  if (done < width)
+    Zoom_a_line_scalar(original_line + done, zoomed_line + done * factor, factor, (word)(width - done));
+}
@@ -0,0 +1,43 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2007-2017 Adrien Destugues
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+
+///@file zoomline.h
+/// Pixel replication, used by the magnifier and the pixel renderers.
+///
+/// On x86 CPUs with SSE2, the common factors are replicated 16 pixels
+/// at a time.
+
+#ifndef ZOOMLINE_H_INCLUDED
+#define ZOOMLINE_H_INCLUDED
+
+#include "struct.h"
+
+///
+/// Writes each of the @a width pixels of @a original_line @a factor times
+/// in @a zoomed_line, which must hold width * factor pixels.
+void Zoom_a_line(const byte * original_line, byte * zoomed_line, word factor, word width);
+
+///
+/// Plain C version of Zoom_a_line(), one pixel at a time.
+/// Used as a reference by the benchmark.
+void Zoom_a_line_scalar(const byte * original_line, byte * zoomed_line, word factor, word width);
+
+#endif